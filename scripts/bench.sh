@@ -0,0 +1,77 @@
+#!/bin/bash
+
+# throughput of view, freq and summary on the bundled test data at several thread counts and batch sizes
+# usage: scripts/bench.sh [out.tsv]
+# run from the repository root after make, or with make bench
+# throughput is in reads/s and in bases/s of the processed reads, from the exact counts printed by minimod
+# override the grid with THREADS="1 8", BATCHES="512 4096", SUBTOOLS="freq", DATASETS="ont hifi" and REPEATS=3
+# DATASETS=sim uses a synthetic BAM made by build/simbam (make simbam) with the options in SIM_ARGS
+
+REF=test/tmp/genome_chr22.fa
+TMP=test/tmp/bench
+OUT=${1:-${TMP}/bench.tsv}
+THREADS=${THREADS:-"1 4 8"}
+BATCHES=${BATCHES:-"512 4096"}
+SUBTOOLS=${SUBTOOLS:-"view freq summary"}
+DATASETS=${DATASETS:-"ont hifi drna 6mA 4mC"}
+REPEATS=${REPEATS:-1}
+SIM_ARGS=${SIM_ARGS:-"--synth-ref 100M --contigs 4 -c 10 -m C+m,C+h --cpg --supplementary 0.05"}
+
+source $(dirname $0)/datasets.sh
+
+[ -x ./minimod ] || die "minimod not found, run make first"
+mkdir -p ${TMP} || die "Creating ${TMP} failed"
+fetch_ref
+
+# value after the given prefix on the log line that starts with it
+log_value() {
+    grep "$2" $1 | tail -1 | sed "s/.*$2 *//" | awk '{print $1}'
+}
+
+VERSION=$(./minimod --version | awk '{print $2}')
+HOST=$(hostname)
+CPUS=$(nproc 2> /dev/null || echo 0)
+
+echo -e "version\thost\tcpus\tdataset\tsubtool\tthreads\tbatch_size\trepeat\twall_s\tcpu_s\tcpu_util\treads\tbases\treads_per_s\tbases_per_s\tpeak_rss_mb" > ${OUT}
+
+for d in ${DATASETS}; do
+    [ $d = sim ] && make_sim
+    bam=$(dataset_bam $d)
+    codes=$(dataset_codes $d)
+    ref=$(dataset_ref $d)
+    [ -f ${bam} ] || die "${bam} not found"
+    for s in ${SUBTOOLS}; do
+        if [ $s = summary ]; then
+            args="${bam}"
+        else
+            args="-c ${codes} ${ref} ${bam}"
+        fi
+        ./minimod $s ${args} > /dev/null 2>&1 || die "minimod $s on ${bam} failed" # warm the page cache
+        for t in ${THREADS}; do
+            for k in ${BATCHES}; do
+                for r in $(seq 1 ${REPEATS}); do
+                    log=${TMP}/${d}.${s}.t${t}.K${k}.${r}.log
+                    ./minimod $s -t $t -K $k ${args} > /dev/null 2> ${log} || die "minimod $s -t $t -K $k on ${bam} failed, see ${log}"
+
+                    # the timing line printed by main, and the processed reads and bases printed by the subtool
+                    wall=$(log_value ${log} "Real time:")
+                    cpu=$(log_value ${log} "CPU time:")
+                    rss=$(log_value ${log} "Peak RAM:")
+                    reads=$(log_value ${log} "total processed entries:")
+                    bases=$(log_value ${log} "total processed bases:")
+                    [ -n "${wall}" ] && [ -n "${reads}" ] && [ -n "${bases}" ] || die "Could not read the timers from ${log}"
+
+                    awk -v OFS='\t' -v ver=${VERSION} -v host=${HOST} -v cpus=${CPUS} -v d=$d -v s=$s -v t=$t -v k=$k -v r=$r \
+                        -v wall=${wall} -v cpu=${cpu} -v rss=${rss} -v reads=${reads} -v bases=${bases} 'BEGIN {
+                        if (wall <= 0) wall = 0.001
+                        printf "%s\t%s\t%d\t%s\t%s\t%d\t%d\t%d\t%.3f\t%.3f\t%.2f\t%d\t%.0f\t%.1f\t%.1f\t%.1f\n",
+                            ver, host, cpus, d, s, t, k, r, wall, cpu, cpu / wall, reads, bases,
+                            reads / wall, bases / wall, rss * 1024 }' >> ${OUT}
+                    tail -1 ${OUT} | cut -f4-
+                done
+            done
+        done
+    done
+done
+
+echo "Results written to ${OUT}" >&2
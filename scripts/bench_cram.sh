@@ -0,0 +1,52 @@
+#!/bin/bash
+
+# BAM vs CRAM throughput of minimod freq on the same reads
+# usage: scripts/bench_cram.sh [ref.fa] [reads.bam] [threads]
+# needs samtools in PATH to make the CRAM, run from the repository root after make
+
+RED='\033[0;31m'
+NC='\033[0m'
+
+# terminate script
+die() {
+	echo -e "${RED}$1${NC}" >&2
+	exit 1
+}
+
+REF=${1:-test/tmp/genome_chr22.fa}
+BAM=${2:-test/data/example-ont.bam}
+THREADS=${3:-8}
+TMP=test/tmp/bench_cram
+CRAM=${TMP}/$(basename ${BAM} .bam).cram
+
+[ -x ./minimod ] || die "minimod not found, run make first"
+[ -f ${REF} ] || die "${REF} not found, run make test once to download it"
+command -v samtools > /dev/null || die "samtools not found in PATH"
+mkdir -p ${TMP} || die "Creating ${TMP} failed"
+
+if [ ! -f ${CRAM} ] || [ ${BAM} -nt ${CRAM} ]; then
+    samtools view -C -T ${REF} -o ${CRAM} ${BAM} || die "Converting ${BAM} to CRAM failed"
+fi
+
+n_reads=$(samtools view -c -F 0x904 ${BAM}) || die "Counting reads failed"
+
+# wall time in seconds of the given command, output discarded
+run_time() {
+    local t0=$(date +%s.%N)
+    "$@" > /dev/null 2> ${TMP}/log || die "$* failed, see ${TMP}/log"
+    local t1=$(date +%s.%N)
+    echo "$t1 - $t0" | bc -l
+}
+
+echo -e "format\tsize_bytes\tthreads\ttime_s\treads_per_s"
+for f in ${BAM} ${CRAM}; do
+    ./minimod freq -t ${THREADS} ${REF} ${f} > /dev/null 2>&1 # warm the page cache
+    t=$(run_time ./minimod freq -t ${THREADS} ${REF} ${f})
+    size=$(wc -c < ${f})
+    printf "%s\t%s\t%s\t%.3f\t%.0f\n" "${f##*.}" ${size} ${THREADS} ${t} $(echo "${n_reads} / ${t}" | bc -l)
+done
+
+# the CRAM output must match the BAM output
+./minimod freq -t ${THREADS} ${REF} ${BAM} | sort > ${TMP}/bam.tsv || die "Running on BAM failed"
+./minimod freq -t ${THREADS} ${REF} ${CRAM} | sort > ${TMP}/cram.tsv || die "Running on CRAM failed"
+diff -q ${TMP}/bam.tsv ${TMP}/cram.tsv > /dev/null || die "BAM and CRAM outputs differ"
@@ -0,0 +1,59 @@
+#!/bin/bash
+
+# datasets shared by scripts/bench.sh and scripts/perf_stat.sh, sourced after TMP, REF and SIM_ARGS are set
+# ont, hifi, drna, 6mA and 4mC are the BAM files in test/data, sim is a synthetic BAM made by build/simbam
+
+RED='\033[0;31m'
+NC='\033[0m'
+
+# terminate script
+die() {
+	echo -e "${RED}$1${NC}" >&2
+	exit 1
+}
+
+# the chr22 reference of the bundled BAM files, downloaded once
+fetch_ref() {
+    if [ ! -f ${REF} ]; then
+        wget -N -O ${REF} "https://raw.githubusercontent.com/imsuneth/shared-files/main/genome_chr22.fa" || die "Downloading the genome chr22 failed"
+    fi
+}
+
+# bam file and modification codes of each dataset
+dataset_bam() {
+    case $1 in
+        ont) echo test/data/example-ont.bam ;;
+        hifi) echo test/data/example-hifi.bam ;;
+        drna) echo test/data/dRNA.bam ;;
+        6mA) echo test/data/dna_6mA_mm_chr22.bam ;;
+        4mC) echo test/data/dna_4mC_5mC_mm_chr22.bam ;;
+        sim) echo ${TMP}/sim.bam ;;
+        *) die "Unknown dataset $1" ;;
+    esac
+}
+
+dataset_codes() {
+    case $1 in
+        ont|hifi) echo "m[CG]" ;;
+        drna) echo "17802[*]" ;;
+        6mA) echo "a[A]" ;;
+        4mC) echo "21839[C]" ;;
+        sim) echo "m[CG],h[CG]" ;;
+    esac
+}
+
+dataset_ref() {
+    case $1 in
+        sim) echo ${TMP}/sim.fa ;;
+        *) echo ${REF} ;;
+    esac
+}
+
+# the synthetic dataset is made once for a given SIM_ARGS
+make_sim() {
+    [ -x build/simbam ] || die "build/simbam not found, run make simbam first"
+    if [ ! -f ${TMP}/sim.bam ] || [ "$(cat ${TMP}/sim.args 2> /dev/null)" != "${SIM_ARGS}" ]; then
+        build/simbam ${SIM_ARGS} -o ${TMP}/sim.bam ${TMP}/sim.fa || die "Generating the synthetic dataset failed"
+        echo "${SIM_ARGS}" > ${TMP}/sim.args
+    fi
+}
@@ -0,0 +1,66 @@
+#!/bin/bash
+
+# cache misses of view and freq on the bundled test data, counted by perf stat
+# usage: scripts/perf_stat.sh [out.tsv]
+# run from the repository root after make, or with make perfstat
+# BINARIES="./minimod /path/to/old/minimod" counts each binary on the same runs, to compare a change against the build before it
+# override the runs with THREADS="1 8", SUBTOOLS="freq", DATASETS="ont hifi", EVENTS="cache-misses,cycles" and REPEATS=3
+# DATASETS=sim uses a synthetic BAM made by build/simbam (make simbam) with the options in SIM_ARGS, as in scripts/bench.sh
+
+REF=test/tmp/genome_chr22.fa
+TMP=test/tmp/perf
+OUT=${1:-${TMP}/perf_stat.tsv}
+BINARIES=${BINARIES:-"./minimod"}
+THREADS=${THREADS:-"1 8"}
+SUBTOOLS=${SUBTOOLS:-"view freq"}
+DATASETS=${DATASETS:-"ont hifi"}
+EVENTS=${EVENTS:-"cache-references,cache-misses,LLC-load-misses,instructions,cycles"}
+REPEATS=${REPEATS:-1}
+SIM_ARGS=${SIM_ARGS:-"--synth-ref 100M --contigs 4 -c 10 -m C+m,C+h --cpg --supplementary 0.05"}
+
+source $(dirname $0)/datasets.sh
+
+command -v perf > /dev/null || die "perf not found, install linux-tools for this kernel"
+for b in ${BINARIES}; do
+    [ -x $b ] || die "$b not found, run make first"
+done
+mkdir -p ${TMP} || die "Creating ${TMP} failed"
+fetch_ref
+
+HOST=$(hostname)
+
+# one row per event, so that rows of different binaries line up on the other columns
+echo -e "binary\tversion\thost\tdataset\tsubtool\tthreads\trepeat\tevent\tcount\tper_read" > ${OUT}
+
+for d in ${DATASETS}; do
+    [ $d = sim ] && make_sim
+    bam=$(dataset_bam $d)
+    codes=$(dataset_codes $d)
+    ref=$(dataset_ref $d)
+    [ -f ${bam} ] || die "${bam} not found"
+    for s in ${SUBTOOLS}; do
+        args="-c ${codes} ${ref} ${bam}"
+        for b in ${BINARIES}; do
+            version=$($b --version | awk '{print $2}')
+            $b $s ${args} > /dev/null 2>&1 || die "$b $s on ${bam} failed" # warm the page cache
+            for t in ${THREADS}; do
+                for r in $(seq 1 ${REPEATS}); do
+                    tag=$(echo $b | tr '/' '_').${d}.${s}.t${t}.${r}
+                    log=${TMP}/${tag}.log
+                    csv=${TMP}/${tag}.csv
+                    perf stat -x, -o ${csv} -e ${EVENTS} $b $s -t $t ${args} > /dev/null 2> ${log} || die "perf stat of $b $s -t $t on ${bam} failed, see ${log}"
+                    reads=$(grep "total processed entries:" ${log} | tail -1 | sed 's/.*total processed entries: *//' | awk '{print $1}')
+                    [ -n "${reads}" ] || die "Could not read the processed entries from ${log}"
+
+                    # perf stat -x, writes value,unit,event,... per event, and <not counted> or <not supported> for events the CPU lacks
+                    grep -v '^#' ${csv} | grep -v '^$' | awk -F, -v OFS='\t' -v b=$b -v ver=${version} -v host=${HOST} -v d=$d -v s=$s -v t=$t -v r=$r -v reads=${reads} '{
+                        if ($1 ~ /^</) { count = "NA"; per_read = "NA" } else { count = $1; per_read = reads > 0 ? sprintf("%.1f", $1 / reads) : "NA" }
+                        print b, ver, host, d, s, t, r, $3, count, per_read }' >> ${OUT}
+                done
+            done
+        done
+    done
+done
+
+column -t -s $'\t' ${OUT} >&2
+echo "Results written to ${OUT}" >&2
@@ -0,0 +1,111 @@
+/**
+ * @file cat_main.c
+ * @brief entry point to cat - convert binary view output to tsv
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+#include "minimod.h"
+#include "viewbin.h"
+#include "error.h"
+#include "misc.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct option long_options[] = {
+    {"output",required_argument, 0, 'o'},          //0 output file
+    {"verbose", required_argument, 0, 'v'},        //1 verbosity level [1]
+    {"help", no_argument, 0, 'h'},                 //2
+    {"version", no_argument, 0, 'V'},              //3
+    {0, 0, 0, 0}};
+
+static inline void print_help_msg(FILE *fp_help){
+    fprintf(fp_help,"Usage: minimod cat view.bin [view2.bin ...]\n");
+    fprintf(fp_help,"\nbasic options:\n");
+    fprintf(fp_help,"   -o FILE                    output file [stdout]\n");
+    fprintf(fp_help,"   -h                         help\n");
+    fprintf(fp_help,"   --verbose INT              verbosity level [%d]\n",(int)get_log_level());
+    fprintf(fp_help,"   --version                  print version\n");
+}
+
+int cat_main(int argc, char* argv[]) {
+
+    const char* optstring = "o:v:hV";
+
+    int longindex = 0;
+    int32_t c = -1;
+
+    FILE *fp_help = stderr;
+    FILE *out_fp = stdout;
+
+    while ((c = getopt_long(argc, argv, optstring, long_options, &longindex)) >= 0) {
+        if (c=='o'){
+            out_fp = fopen(optarg, "w");
+            if (out_fp == NULL) {
+                ERROR("Cannot open file %s for writing", optarg);
+                exit(EXIT_FAILURE);
+            }
+        } else if (c=='v'){
+            int v = atoi(optarg);
+            set_log_level((enum log_level_opt)v);
+        } else if (c=='V'){
+            fprintf(stdout,"minimod %s\n",MINIMOD_VERSION);
+            exit(EXIT_SUCCESS);
+        } else if (c=='h'){
+            fp_help = stdout;
+        } else {
+            print_help_msg(fp_help);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc - optind < 1 || fp_help == stdout) {
+        print_help_msg(fp_help);
+        if(fp_help == stdout){
+            exit(EXIT_SUCCESS);
+        }
+        exit(EXIT_FAILURE);
+    }
+
+    int64_t n_rows = 0;
+    for (int i = optind; i < argc; i++) {
+        FILE *in_fp = strcmp(argv[i], "-") == 0 ? stdin : fopen(argv[i], "rb");
+        F_CHK(in_fp, argv[i]);
+        n_rows += viewbin_to_tsv(in_fp, argv[i], out_fp, i == optind);
+        if (in_fp != stdin) {
+            fclose(in_fp);
+        }
+    }
+
+    fprintf(stderr, "[%s] %ld entries written\n", __func__, (long)n_rows);
+
+    if(out_fp != stdout){
+        fclose(out_fp);
+    }
+
+    return 0;
+}
@@ -35,6 +35,9 @@ SOFTWARE.
 #include "error.h"
 #include "misc.h"
 #include "ref.h"
+#include "profile.h"
+#include "freqdump.h"
+#include "freqbin.h"
 #include <assert.h>
 #include <getopt.h>
 #include <pthread.h>
@@ -61,11 +64,24 @@ static struct option long_options[] = {
     {"allow-secondary",no_argument, 0, 0},         //14 enable secondary alignments
     {"include-non-ref",no_argument, 0, 0},         //15 include modifications occuring on non-reference alleles (eg. due to SNPs)
     {"skip-supplementary",no_argument, 0, 0},      //16 skip supplementary alignments
+    {"bam-list",required_argument, 0, 0},          //17 file with input BAM file names, one per line
+    {"per-sample",no_argument, 0, 0},              //18 per sample counts in addition to the pooled counts
+    {"dump",required_argument, 0, 0},              //19 write the site table to a binary checkpoint
+    {"checkpoint-in",required_argument, 0, 0},     //20 sum a checkpoint from an earlier run into the counts
+    {"adaptive-batch",required_argument, 0, 0},    //21 tune -K and -B at runtime under this memory cap
+    {"max-mem",required_argument, 0, 0},           //22 memory budget, loading waits and the freq table spills when reached
+    {"profile",required_argument, 0, 0},           //23 per thread and per stage profile report
+    {"bin-size",required_argument, 0, 0},          //24 sum the sites into windows of this size
+    {"regions",required_argument, 0, 0},           //25 sum the sites into the intervals of a BED file
+    {"io-threads",required_argument, 0, 0},        //26 BAM decompression and decode threads
+    {"min-mapq",required_argument, 0, 0},          //27 skip alignments with a lower MAPQ
+    {"min-length",required_argument, 0, 0},        //28 skip reads with fewer bases
     {0, 0, 0, 0}};
 
 
 static inline void print_help_msg(FILE *fp_help, opt_t opt){
-    fprintf(fp_help,"Usage: minimod freq ref.fa reads.bam\n");
+    fprintf(fp_help,"Usage: minimod freq ref.fa reads.bam [reads2.bam ...]\n");
+    fprintf(fp_help,"reads can be SAM, BAM or CRAM. Use - to read from stdin\n");
     fprintf(fp_help,"\nbasic options:\n");
     fprintf(fp_help,"   -b                         output in bedMethyl format [%s]\n", (opt.bedmethyl_out?"yes":"not set"));
     fprintf(fp_help,"   -c STR                     modification code(s) (eg. m, h or mh or as ChEBI) [%s]\n", opt.mod_codes_str);
@@ -83,9 +99,21 @@ static inline void print_help_msg(FILE *fp_help, opt_t opt){
     fprintf(fp_help,"   --allow-secondary          allow secondary alignments [%s]\n", (opt.allow_secondary?"yes":"no"));
     // fprintf(fp_help,"   --include-non-ref          include modifications on bases not matching reference (eg. due to SNPs) [%s]\n", (opt.alt_alleles?"yes":"no"));
     fprintf(fp_help,"   --skip-supplementary       skip supplementary alignments [%s]\n", (opt.skip_supplementary?"yes":"no"));
+    fprintf(fp_help,"   --min-mapq INT             skip alignments with a lower MAPQ [%d]\n", opt.min_mapq);
+    fprintf(fp_help,"   --min-length INT           skip reads with fewer bases [%d]\n", opt.min_length);
+    fprintf(fp_help,"   --bam-list FILE            read input BAM files from FILE, one per line\n");
+    fprintf(fp_help,"   --per-sample               n_called, n_mod and freq columns for each input file [%s]\n", (opt.per_sample?"yes":"no"));
+    fprintf(fp_help,"   --dump FILE                also write the site counts to a binary checkpoint FILE\n");
+    fprintf(fp_help,"   --checkpoint-in FILE       add the counts in checkpoint FILE from an earlier run (can be repeated)\n");
+    fprintf(fp_help,"   --bin-size INT[K/M]        one row per window of INT bases and mod code instead of per site\n");
+    fprintf(fp_help,"   --regions FILE             one row per interval in the BED FILE and mod code instead of per site\n");
 
     fprintf(fp_help,"\nadvanced options:\n");
+    fprintf(fp_help,"   --io-threads INT           BAM decompression and decode threads, apart from -t [-t/4]\n");
+    fprintf(fp_help,"   --max-mem FLOAT[K/M/G]     memory budget, reading waits and the site table is spilled to $TMPDIR when it is reached [no limit]\n");
     fprintf(fp_help,"   --debug-break INT          break after processing the specified no. of batches\n");
+    fprintf(fp_help,"   --profile FILE             write per thread and per stage timers and counters to FILE (JSON)\n");
+    fprintf(fp_help,"   --adaptive-batch FLOAT[K/M/G] tune -K and -B at runtime, keeping the batches in memory under FLOAT bytes\n");
 
 }
 
@@ -173,6 +201,7 @@ int freq_main(int argc, char* argv[]) {
     int32_t c = -1;
 
     FILE *fp_help = stderr;
+    char *bam_list_file = NULL;
 
     opt_t opt;
     init_opt(&opt); //initialise options to defaults
@@ -249,6 +278,56 @@ int freq_main(int argc, char* argv[]) {
             opt.alt_alleles = 1;
         } else if(c == 0 && longindex == 16){ //skip supplementary alignments
             opt.skip_supplementary = 1;
+        } else if(c == 0 && longindex == 17){ //file of input file names
+            bam_list_file = optarg;
+        } else if(c == 0 && longindex == 18){ //per sample output
+            opt.per_sample = 1;
+        } else if(c == 0 && longindex == 19){ //checkpoint output
+            opt.dump_file = optarg;
+        } else if(c == 0 && longindex == 20){ //checkpoint input
+            opt.checkpoint_files = (char**)realloc(opt.checkpoint_files, sizeof(char*) * (opt.n_checkpoints + 1));
+            MALLOC_CHK(opt.checkpoint_files);
+            opt.checkpoint_files[opt.n_checkpoints++] = optarg;
+        } else if(c == 0 && longindex == 21){ //adaptive batch sizing
+            opt.adaptive_batch = mm_parse_num(optarg);
+            if(opt.adaptive_batch <= 0){
+                ERROR("%s","Memory cap for --adaptive-batch should be larger than 0.");
+                exit(EXIT_FAILURE);
+            }
+        } else if(c == 0 && longindex == 22){ //memory budget
+            opt.max_mem = mm_parse_num(optarg);
+            if(opt.max_mem <= 0){
+                ERROR("%s","--max-mem should be larger than 0.");
+                exit(EXIT_FAILURE);
+            }
+        } else if(c == 0 && longindex == 23){ //profiling report
+            opt.profile_file = optarg;
+        } else if(c == 0 && longindex == 24){ //window size
+            opt.bin_size = mm_parse_num(optarg);
+            if(opt.bin_size <= 0){
+                ERROR("%s","--bin-size should be larger than 0.");
+                exit(EXIT_FAILURE);
+            }
+        } else if(c == 0 && longindex == 25){ //BED regions
+            opt.regions_file = optarg;
+        } else if(c == 0 && longindex == 26){ //decompression and decode threads
+            opt.io_threads = atoi(optarg);
+            if (opt.io_threads < 0) {
+                ERROR("Number of I/O threads should be 0 or larger. You entered %d", opt.io_threads);
+                exit(EXIT_FAILURE);
+            }
+        } else if(c == 0 && longindex == 27){ //minimum MAPQ
+            opt.min_mapq = atoi(optarg);
+            if (opt.min_mapq < 0 || opt.min_mapq > 255) {
+                ERROR("Minimum MAPQ should be between 0 and 255. You entered %d", opt.min_mapq);
+                exit(EXIT_FAILURE);
+            }
+        } else if(c == 0 && longindex == 28){ //minimum read length
+            opt.min_length = atoi(optarg);
+            if (opt.min_length < 0) {
+                ERROR("Minimum read length should be 0 or larger. You entered %d", opt.min_length);
+                exit(EXIT_FAILURE);
+            }
         } else {
             print_help_msg(fp_help, opt);
             if(fp_help == stdout){
@@ -286,7 +365,7 @@ int freq_main(int argc, char* argv[]) {
     parse_mod_threshes(&opt);
     
     // No arguments given
-    if (argc - optind != 2 || fp_help == stdout) {
+    if (argc - optind < (bam_list_file ? 1 : 2) || fp_help == stdout) {
         WARNING("%s","Missing arguments");
         print_help_msg(fp_help, opt);
         if(fp_help == stdout){
@@ -296,7 +375,6 @@ int freq_main(int argc, char* argv[]) {
     }
 
     opt.ref_file = argv[optind];
-    opt.bam_file = argv[optind+1];
 
     if (opt.ref_file == NULL) {
         WARNING("%s","Reference file not provided");
@@ -307,18 +385,26 @@ int freq_main(int argc, char* argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    if (opt.bam_file == NULL) {
-        WARNING("%s","BAM file not provided");
-        print_help_msg(fp_help, opt);
-        if(fp_help == stdout){
-            exit(EXIT_SUCCESS);
-        }
+    // input files after the reference, checked for existence
+    set_bam_files(&opt, &argv[optind+1], argc - optind - 1, bam_list_file);
+
+    if (opt.bedmethyl_out && opt.per_sample) {
+        ERROR("%s", "--per-sample is not supported with bedMethyl output");
+        exit(EXIT_FAILURE);
+    }
+
+    if (opt.bin_size > 0 && opt.regions_file) {
+        ERROR("%s", "--bin-size and --regions cannot be used together");
         exit(EXIT_FAILURE);
     }
 
-    // check if the bam file exists
-    if (access(opt.bam_file, F_OK) == -1) {
-        ERROR("BAM file %s does not exist", opt.bam_file);
+    if (opt.bedmethyl_out && (opt.bin_size > 0 || opt.regions_file)) {
+        ERROR("%s", "--bin-size and --regions are not supported with bedMethyl output");
+        exit(EXIT_FAILURE);
+    }
+
+    if ((opt.dump_file || opt.n_checkpoints) && opt.per_sample) {
+        ERROR("%s", "--per-sample is not supported with checkpoints");
         exit(EXIT_FAILURE);
     }
 
@@ -344,6 +430,17 @@ int freq_main(int argc, char* argv[]) {
 
     //initialise the core data structure
     core_t* core = init_core(opt, realtime0);
+    set_fixed_mem(core, ref_mem(opt.n_mods));
+
+    // counts from earlier runs
+    for (int32_t i = 0; i < opt.n_checkpoints; i++) {
+        freqdump_hdr_t hdr;
+        int64_t n_sites = freqdump_read(opt.checkpoint_files[i], core->freq_map, &hdr);
+        freqdump_check_opt(&hdr, &opt, opt.checkpoint_files[i]);
+        freqdump_hdr_destroy(&hdr);
+        fprintf(stderr, "[%s] %ld sites loaded from checkpoint %s\n", __func__, (long)n_sites, opt.checkpoint_files[i]);
+    }
+    check_map_mem(core);
 
     int32_t counter=0;
 
@@ -356,8 +453,14 @@ int freq_main(int argc, char* argv[]) {
     //initialise a databatch
     db_t* db = init_db(core);
 
-    ret_status_t status = {core->opt.batch_size,core->opt.batch_size_bases};
-    while (status.num_reads >= core->opt.batch_size || status.num_bases>=core->opt.batch_size_bases) {
+    ret_status_t status = {core->batch_size,core->batch_size_bases};
+    while (status.num_reads >= core->batch_size || status.num_bases>=core->batch_size_bases) {
+
+        //the batch is reused, reallocate it if adapt_batch changed the read limit
+        if(db->cap_bam_recs != core->next_batch_size){
+            free_db(core, db);
+            db = init_db(core);
+        }
 
         //load a databatch
         status = load_db(core, db);
@@ -370,6 +473,8 @@ int freq_main(int argc, char* argv[]) {
 
         free_db_tmp(core, db);
 
+        adapt_batch(core);
+
         //print progress
         int32_t skipped_reads = db->total_reads-db->n_bam_recs;
         int64_t skipped_bytes = db->total_bytes-db->processed_bytes;
@@ -401,13 +506,13 @@ int freq_main(int argc, char* argv[]) {
 
 #else //IO_PROC_INTERLEAVE
 
-    ret_status_t status = {core->opt.batch_size,core->opt.batch_size_bases};
+    ret_status_t status = {core->batch_size,core->batch_size_bases};
     int8_t first_flag_p=0;
     int8_t first_flag_pp=0;
     pthread_t tid_p; //process thread
     pthread_t tid_pp; //post-process thread
 
-    while (status.num_reads >= core->opt.batch_size || status.num_bases>=core->opt.batch_size_bases) {
+    while (status.num_reads >= core->batch_size || status.num_bases>=core->batch_size_bases) {
 
         //init and load a databatch
         db_t* db = init_db(core);
@@ -454,6 +559,7 @@ int freq_main(int argc, char* argv[]) {
                 realtime() - realtime0, cputime() / (realtime() - realtime0),
                 (long)tid_pp);
             }
+            adapt_batch(core); // the previous batch is finished, tune the next load
         }
         first_flag_pp=1;
 
@@ -492,6 +598,10 @@ int freq_main(int argc, char* argv[]) {
 #endif
 
     output_core(core);
+    if(core->freq_bin){
+        freqbin_destroy(core->freq_bin);
+        core->freq_bin = NULL;
+    }
 
     destroy_ref(opt.n_mods);
 
@@ -499,17 +609,26 @@ int freq_main(int argc, char* argv[]) {
     fprintf(stderr,"\n[%s] total bytes: %.1f M",__func__,core->total_bytes/(float)(1000*1000));
     fprintf(stderr,"\n[%s] total skipped entries: %ld",__func__,(long)(core->total_reads-core->processed_reads));
     fprintf(stderr,"\n[%s] total skipped bytes: %.1f M",__func__,(core->total_bytes-core->processed_bytes)/(float)(1000*1000));
+    print_skipped_reads(core, __func__);
     fprintf(stderr,"\n[%s] total processed entries: %ld",__func__,(long)core->processed_reads);
     fprintf(stderr,"\n[%s] total processed bytes: %.1f M",__func__,(core->processed_bytes)/(float)(1000*1000));
+    fprintf(stderr,"\n[%s] total processed bases: %lu",__func__,(unsigned long)core->processed_bases);
 
     fprintf(stderr, "\n[%s] Data loading time: %.3f sec", __func__,core->load_db_time);
     fprintf(stderr, "\n[%s] Data processing time: %.3f sec", __func__,core->process_db_time);
     fprintf(stderr, "\n[%s] Data merging time: %.3f sec", __func__,core->merge_db_time);
     fprintf(stderr, "\n[%s] Data sorting time: %.3f sec", __func__,core->sort_time);
     fprintf(stderr, "\n[%s] Data output time: %.3f sec", __func__,core->output_time);
+    if(opt.max_mem > 0){
+        fprintf(stderr, "\n[%s] Peak memory estimate: %.1f M of --max-mem %.1f M", __func__,core->mem_peak/(float)(1000*1000),opt.max_mem/(float)(1000*1000));
+    }
 
     fprintf(stderr,"\n");
 
+    if(core->prof){
+        profile_write(core, opt.profile_file);
+    }
+
     //free the core data structure
     free_core(core,opt);
 
@@ -0,0 +1,313 @@
+/**
+ * @file freqbin.c
+ * @brief per window and per region aggregates for freq
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+
+#define _XOPEN_SOURCE 700 // getline
+#include "freqbin.h"
+#include "error.h"
+#include "khash.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* regions of a contig sorted by start, max_end[i] is the largest end of the first i+1 */
+struct freqbin_contig_s {
+    int32_t n;
+    int32_t *idx; // indices into fb->regions
+    int32_t *max_end;
+};
+
+KHASH_MAP_INIT_STR(bedc, freqbin_contig_t *);
+
+static freqbin_region_t *sort_regions; // qsort has no context argument
+
+static int cmp_region_idx(const void *a, const void *b) {
+    const freqbin_region_t *ra = &sort_regions[*(const int32_t *)a];
+    const freqbin_region_t *rb = &sort_regions[*(const int32_t *)b];
+    if (ra->start != rb->start) return ra->start < rb->start ? -1 : 1;
+    return *(const int32_t *)a - *(const int32_t *)b;
+}
+
+static void load_regions(freqbin_t *fb, const char *bed_file) {
+    FILE *fp = fopen(bed_file, "r");
+    F_CHK(fp, bed_file);
+
+    int32_t cap = 0;
+    char *line = NULL;
+    size_t line_cap = 0;
+    int64_t line_no = 0;
+    while (getline(&line, &line_cap, fp) != -1) {
+        line_no++;
+        if (line[0] == '#' || strncmp(line, "track", 5) == 0 || strncmp(line, "browser", 7) == 0) continue;
+        char *contig = strtok(line, "\t \r\n");
+        if (contig == NULL) continue; // empty line
+        char *start = strtok(NULL, "\t \r\n");
+        char *end = strtok(NULL, "\t \r\n");
+        char *name = strtok(NULL, "\t \r\n");
+        char *s_end = NULL, *e_end = NULL;
+        long beg = start ? strtol(start, &s_end, 10) : -1;
+        long fin = end ? strtol(end, &e_end, 10) : -1;
+        if (start == NULL || end == NULL || *s_end != '\0' || *e_end != '\0' || beg < 0 || fin < beg || fin > INT32_MAX) {
+            ERROR("Malformed BED entry at line %ld of %s", (long)line_no, bed_file);
+            exit(EXIT_FAILURE);
+        }
+
+        if (fb->n_regions == cap) {
+            cap = cap ? cap * 2 : 1024;
+            fb->regions = (freqbin_region_t *)realloc(fb->regions, sizeof(freqbin_region_t) * cap);
+            MALLOC_CHK(fb->regions);
+        }
+        freqbin_region_t *r = &fb->regions[fb->n_regions++];
+        r->contig = strdup(contig);
+        MALLOC_CHK(r->contig);
+        r->start = (int32_t)beg;
+        r->end = (int32_t)fin;
+        r->name = strdup(name ? name : ".");
+        MALLOC_CHK(r->name);
+    }
+    free(line);
+    fclose(fp);
+
+    if (fb->n_regions == 0) {
+        ERROR("No regions in %s", bed_file);
+        exit(EXIT_FAILURE);
+    }
+
+    // group the regions by contig
+    khash_t(bedc) *map = kh_init(bedc);
+    for (int32_t i = 0; i < fb->n_regions; i++) {
+        int ret;
+        khiter_t k = kh_put(bedc, map, fb->regions[i].contig, &ret);
+        if (ret != 0) { // new contig, the key is owned by the region
+            freqbin_contig_t *c = (freqbin_contig_t *)calloc(1, sizeof(freqbin_contig_t));
+            MALLOC_CHK(c);
+            kh_value(map, k) = c;
+        }
+        kh_value(map, k)->n++;
+    }
+    for (khiter_t k = kh_begin(map); k != kh_end(map); k++) {
+        if (!kh_exist(map, k)) continue;
+        freqbin_contig_t *c = kh_value(map, k);
+        c->idx = (int32_t *)malloc(sizeof(int32_t) * c->n);
+        MALLOC_CHK(c->idx);
+        c->max_end = (int32_t *)malloc(sizeof(int32_t) * c->n);
+        MALLOC_CHK(c->max_end);
+        c->n = 0;
+    }
+    for (int32_t i = 0; i < fb->n_regions; i++) {
+        freqbin_contig_t *c = kh_value(map, kh_get(bedc, map, fb->regions[i].contig));
+        c->idx[c->n++] = i;
+    }
+    sort_regions = fb->regions;
+    for (khiter_t k = kh_begin(map); k != kh_end(map); k++) {
+        if (!kh_exist(map, k)) continue;
+        freqbin_contig_t *c = kh_value(map, k);
+        qsort(c->idx, c->n, sizeof(int32_t), cmp_region_idx);
+        int32_t max_end = 0;
+        for (int32_t j = 0; j < c->n; j++) {
+            if (fb->regions[c->idx[j]].end > max_end) max_end = fb->regions[c->idx[j]].end;
+            c->max_end[j] = max_end;
+        }
+    }
+    sort_regions = NULL;
+    fb->contig_map = map;
+
+    fprintf(stderr, "[%s] %d regions loaded from %s\n", __func__, fb->n_regions, bed_file);
+}
+
+freqbin_t *freqbin_init(FILE *fp, int64_t bin_size, const char *bed_file) {
+    freqbin_t *fb = (freqbin_t *)calloc(1, sizeof(freqbin_t));
+    MALLOC_CHK(fb);
+    fb->fp = fp;
+    fb->bin_size = bin_size;
+    if (bed_file) {
+        load_regions(fb, bed_file);
+    }
+    return fb;
+}
+
+static int get_code(freqbin_t *fb, const char *mod_code) {
+    for (int i = 0; i < fb->n_codes; i++) { // only a few codes
+        if (strcmp(fb->codes[i], mod_code) == 0) return i;
+    }
+    if (fb->n_codes == FREQBIN_MAX_CODES) {
+        ERROR("More than %d modification codes", FREQBIN_MAX_CODES);
+        exit(EXIT_FAILURE);
+    }
+    int c = fb->n_codes++;
+    fb->codes[c] = strdup(mod_code);
+    MALLOC_CHK(fb->codes[c]);
+    if (fb->bin_size > 0 && fb->cap_bins > 0) {
+        fb->bins[c] = (freqbin_stat_t *)calloc(fb->cap_bins, sizeof(freqbin_stat_t));
+        MALLOC_CHK(fb->bins[c]);
+    }
+    if (fb->n_regions > 0) {
+        fb->region_stats[c] = (freqbin_stat_t *)calloc(fb->n_regions, sizeof(freqbin_stat_t));
+        MALLOC_CHK(fb->region_stats[c]);
+    }
+    return c;
+}
+
+static inline void add_stat(freqbin_stat_t *st, uint32_t n_called, uint32_t n_mod) {
+    st->n_sites++;
+    st->n_called += n_called;
+    st->n_mod += n_mod;
+    st->freq_sum += (double)n_mod / n_called;
+}
+
+static void print_stat(FILE *fp, const char *contig, int64_t start, int64_t end, const char *mod_code, const freqbin_stat_t *st, const char *name) {
+    fprintf(fp, "%s\t%ld\t%ld\t%s\t%u\t%lu\t%lu\t", contig, (long)start, (long)end, mod_code, st->n_sites, (unsigned long)st->n_called, (unsigned long)st->n_mod);
+    if (st->n_sites == 0) {
+        fputs("0.000000\tNA", fp);
+    } else {
+        fprintf(fp, "%f\t%f", (double)st->n_called / st->n_sites, st->freq_sum / st->n_sites);
+    }
+    if (name) {
+        fprintf(fp, "\t%s", name);
+    }
+    fputc('\n', fp);
+}
+
+// print the windows of the current contig that have sites and reset them
+static void flush_bins(freqbin_t *fb) {
+    for (int64_t b = 0; b < fb->n_bins; b++) {
+        for (int c = 0; c < fb->n_codes; c++) {
+            freqbin_stat_t *st = &fb->bins[c][b];
+            if (st->n_sites == 0) continue;
+            print_stat(fb->fp, fb->contig, b * fb->bin_size, (b + 1) * fb->bin_size, fb->codes[c], st, NULL);
+        }
+    }
+    for (int c = 0; c < fb->n_codes; c++) {
+        memset(fb->bins[c], 0, sizeof(freqbin_stat_t) * fb->n_bins);
+    }
+    fb->n_bins = 0;
+}
+
+static void add_bin(freqbin_t *fb, const char *contig, int32_t pos, int c, uint32_t n_called, uint32_t n_mod) {
+    if (fb->contig == NULL || strcmp(fb->contig, contig) != 0) {
+        if (fb->contig) {
+            flush_bins(fb);
+            free(fb->contig);
+        }
+        fb->contig = strdup(contig);
+        MALLOC_CHK(fb->contig);
+    }
+
+    int64_t b = pos / fb->bin_size;
+    if (b >= fb->cap_bins) { // grows to the length of the longest contig once
+        int64_t cap = fb->cap_bins ? fb->cap_bins : 1024;
+        while (cap <= b) cap *= 2;
+        for (int i = 0; i < fb->n_codes; i++) {
+            fb->bins[i] = (freqbin_stat_t *)realloc(fb->bins[i], sizeof(freqbin_stat_t) * cap);
+            MALLOC_CHK(fb->bins[i]);
+            memset(fb->bins[i] + fb->cap_bins, 0, sizeof(freqbin_stat_t) * (cap - fb->cap_bins));
+        }
+        fb->cap_bins = cap;
+    }
+    if (b >= fb->n_bins) {
+        fb->n_bins = b + 1;
+    }
+    add_stat(&fb->bins[c][b], n_called, n_mod);
+}
+
+static void add_region(freqbin_t *fb, const char *contig, int32_t pos, int c, uint32_t n_called, uint32_t n_mod) {
+    khash_t(bedc) *map = (khash_t(bedc) *)fb->contig_map;
+    if (fb->contig == NULL || strcmp(fb->contig, contig) != 0) {
+        free(fb->contig);
+        fb->contig = strdup(contig);
+        MALLOC_CHK(fb->contig);
+        khiter_t k = kh_get(bedc, map, contig);
+        fb->cur = k == kh_end(map) ? NULL : kh_value(map, k);
+    }
+    freqbin_contig_t *cur = fb->cur;
+    if (cur == NULL) return; // no regions on this contig
+
+    // last region starting at or before pos, then back while an earlier region can still reach pos
+    int32_t lo = 0, hi = cur->n;
+    while (lo < hi) {
+        int32_t mid = lo + (hi - lo) / 2;
+        if (fb->regions[cur->idx[mid]].start <= pos) lo = mid + 1; else hi = mid;
+    }
+    for (int32_t j = lo - 1; j >= 0 && cur->max_end[j] > pos; j--) {
+        if (fb->regions[cur->idx[j]].end > pos) {
+            add_stat(&fb->region_stats[c][cur->idx[j]], n_called, n_mod);
+        }
+    }
+}
+
+void freqbin_add(freqbin_t *fb, const char *contig, int32_t pos, const char *mod_code, uint32_t n_called, uint32_t n_mod) {
+    if (n_called == 0) return;
+    int c = get_code(fb, mod_code);
+    if (fb->n_regions > 0) {
+        add_region(fb, contig, pos, c, n_called, n_mod);
+    } else {
+        add_bin(fb, contig, pos, c, n_called, n_mod);
+    }
+}
+
+/* print what is left, the windows of the last contig or all regions */
+void freqbin_write(freqbin_t *fb) {
+    if (fb->n_regions == 0) {
+        if (fb->contig) {
+            flush_bins(fb);
+        }
+        return;
+    }
+    for (int32_t i = 0; i < fb->n_regions; i++) {
+        freqbin_region_t *r = &fb->regions[i];
+        for (int c = 0; c < fb->n_codes; c++) {
+            print_stat(fb->fp, r->contig, r->start, r->end, fb->codes[c], &fb->region_stats[c][i], r->name);
+        }
+    }
+}
+
+void freqbin_destroy(freqbin_t *fb) {
+    for (int c = 0; c < fb->n_codes; c++) {
+        free(fb->codes[c]);
+        free(fb->bins[c]);
+        free(fb->region_stats[c]);
+    }
+    if (fb->contig_map) {
+        khash_t(bedc) *map = (khash_t(bedc) *)fb->contig_map;
+        for (khiter_t k = kh_begin(map); k != kh_end(map); k++) {
+            if (!kh_exist(map, k)) continue;
+            freqbin_contig_t *c = kh_value(map, k);
+            free(c->idx);
+            free(c->max_end);
+            free(c);
+        }
+        kh_destroy(bedc, map);
+    }
+    for (int32_t i = 0; i < fb->n_regions; i++) {
+        free(fb->regions[i].contig);
+        free(fb->regions[i].name);
+    }
+    free(fb->regions);
+    free(fb->contig);
+    free(fb);
+}
@@ -0,0 +1,92 @@
+/**
+ * @file freqbin.h
+ * @brief per window and per region aggregates for freq
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+
+#ifndef FREQBIN_H
+#define FREQBIN_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * freq --bin-size and --regions: instead of one row per site, the sites are summed into
+ * fixed size windows of a contig or into the intervals of a BED file, one row per window
+ * (or region) and mod code. Sites are fed in the order they are printed, which is grouped
+ * by contig, so the windows of a contig are printed and reset when the next contig starts.
+ * Region counters are kept for the whole run and printed at the end in the BED file order.
+ * Both strands and all haplotypes are pooled.
+ */
+
+#define FREQBIN_MAX_CODES 256
+
+typedef struct {
+    uint32_t n_sites; // sites with at least one call
+    uint64_t n_called;
+    uint64_t n_mod;
+    double freq_sum; // sum of the per site frequencies
+} freqbin_stat_t;
+
+typedef struct {
+    char *contig;
+    int32_t start;
+    int32_t end; // exclusive
+    char *name;
+} freqbin_region_t;
+
+typedef struct freqbin_contig_s freqbin_contig_t;
+
+struct freqbin_s {
+    FILE *fp;
+    int64_t bin_size; // 0 in region mode
+
+    int n_codes;
+    char *codes[FREQBIN_MAX_CODES];
+
+    // windows of the current contig, bins[code][window]
+    char *contig;
+    freqbin_stat_t *bins[FREQBIN_MAX_CODES];
+    int64_t n_bins; // windows in use
+    int64_t cap_bins;
+
+    // regions in the BED file order, region_stats[code][region]
+    freqbin_region_t *regions;
+    int32_t n_regions;
+    freqbin_stat_t *region_stats[FREQBIN_MAX_CODES];
+    void *contig_map; // contig name to its regions sorted by start
+    freqbin_contig_t *cur; // regions of the contig of the last site
+};
+
+typedef struct freqbin_s freqbin_t;
+
+freqbin_t *freqbin_init(FILE *fp, int64_t bin_size, const char *bed_file);
+void freqbin_add(freqbin_t *fb, const char *contig, int32_t pos, const char *mod_code, uint32_t n_called, uint32_t n_mod);
+void freqbin_write(freqbin_t *fb);
+void freqbin_destroy(freqbin_t *fb);
+
+#endif
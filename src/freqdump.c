@@ -0,0 +1,518 @@
+/**
+ * @file freqdump.c
+ * @brief mergeable binary checkpoints of the freq site table
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+#include "freqdump.h"
+#include "minimod.h"
+#include "mod.h"
+#include "error.h"
+#include "khash.h"
+#include <stdlib.h>
+#include <string.h>
+
+KHASH_MAP_INIT_STR(dictm, uint32_t);
+
+#define FD_READ_CHK(ret) { \
+    if ((ret) != 0) { \
+        ERROR("Truncated or corrupted freq checkpoint %s", file); \
+        exit(EXIT_FAILURE); \
+    } \
+}
+
+static inline void fd_write(FILE *fp, const void *ptr, size_t size, size_t n, const char *file) {
+    if (n == 0) return;
+    if (fwrite(ptr, size, n, fp) != n) {
+        ERROR("Writing freq checkpoint %s failed", file);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static inline int fd_read(FILE *fp, void *ptr, size_t size, size_t n) {
+    if (n == 0) return 0;
+    return fread(ptr, size, n, fp) == n ? 0 : -1;
+}
+
+static char *copy_str(const char *str, size_t len) {
+    char *s = (char *)malloc(len + 1);
+    MALLOC_CHK(s);
+    memcpy(s, str, len);
+    s[len] = '\0';
+    return s;
+}
+
+// threshold of a mod code, exact match first then the wildcard, -1 if the code is not in hdr
+static double get_thresh(const freqdump_hdr_t *hdr, const char *code, int allow_wildcard) {
+    double wildcard = -1;
+    for (uint32_t i = 0; i < hdr->n_codes; i++) {
+        if (strcmp(hdr->codes[i], code) == 0) return hdr->threshes[i];
+        if (allow_wildcard && strcmp(hdr->codes[i], "*") == 0) wildcard = hdr->threshes[i];
+    }
+    return wildcard;
+}
+
+static void add_code(freqdump_hdr_t *hdr, const char *code, double thresh) {
+    if (hdr->n_codes >= FREQDUMP_MAX_CODES) {
+        ERROR("More than %d modification codes in a freq checkpoint", FREQDUMP_MAX_CODES);
+        exit(EXIT_FAILURE);
+    }
+    hdr->codes[hdr->n_codes] = copy_str(code, strlen(code));
+    hdr->threshes[hdr->n_codes] = thresh;
+    hdr->n_codes++;
+}
+
+/* flags and thresholds of the current freq run. the wildcard code is kept as "*" */
+void freqdump_hdr_from_opt(freqdump_hdr_t *hdr, opt_t *opt) {
+    memset(hdr, 0, sizeof(freqdump_hdr_t));
+    hdr->flags = (opt->insertions ? FREQDUMP_FLAG_INS : 0) | (opt->haplotypes ? FREQDUMP_FLAG_HAP : 0);
+    for (khint_t k = kh_begin(opt->modcodes_map); k < kh_end(opt->modcodes_map); ++k) {
+        if (!kh_exist(opt->modcodes_map, k)) continue;
+        add_code(hdr, kh_key(opt->modcodes_map, k), kh_value(opt->modcodes_map, k)->thresh);
+    }
+}
+
+/* add the codes of src to dst, quit if a code was called with a different threshold or the flags differ */
+void freqdump_hdr_merge(freqdump_hdr_t *dst, const freqdump_hdr_t *src, const char *file) {
+    if (dst->flags != src->flags) {
+        ERROR("%s was written with different --insertions/--haplotypes options", file);
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < src->n_codes; i++) {
+        double thresh = get_thresh(dst, src->codes[i], 0);
+        if (thresh < 0) {
+            add_code(dst, src->codes[i], src->threshes[i]);
+        } else if (thresh != src->threshes[i]) {
+            ERROR("Mod code %s in %s was called with threshold %f, expected %f", src->codes[i], file, src->threshes[i], thresh);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/* quit if a checkpoint cannot be summed into the current freq run */
+void freqdump_check_opt(const freqdump_hdr_t *hdr, opt_t *opt, const char *file) {
+    freqdump_hdr_t run;
+    freqdump_hdr_from_opt(&run, opt);
+    if (run.flags != hdr->flags) {
+        ERROR("%s was written with different --insertions/--haplotypes options", file);
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < hdr->n_codes; i++) {
+        double thresh = get_thresh(&run, hdr->codes[i], 1);
+        if (thresh < 0) {
+            ERROR("Mod code %s in %s is not in the requested mod codes", hdr->codes[i], file);
+            exit(EXIT_FAILURE);
+        }
+        if (thresh != hdr->threshes[i]) {
+            ERROR("Mod code %s in %s was called with threshold %f, this run uses %f", hdr->codes[i], file, hdr->threshes[i], thresh);
+            exit(EXIT_FAILURE);
+        }
+    }
+    freqdump_hdr_destroy(&run);
+}
+
+void freqdump_hdr_destroy(freqdump_hdr_t *hdr) {
+    for (uint32_t i = 0; i < hdr->n_codes; i++) {
+        free(hdr->codes[i]);
+    }
+    hdr->n_codes = 0;
+}
+
+// id of a name in a dictionary, added if new
+static uint32_t get_dict_id(khash_t(dictm) *dict, const char *name, size_t len, char ***names, uint32_t *n_names, uint32_t *cap_names) {
+    char *buf = copy_str(name, len);
+    int ret;
+    khint_t k = kh_put(dictm, dict, buf, &ret);
+    if (ret == 0) { // already present
+        free(buf);
+        return kh_value(dict, k);
+    }
+    if (*n_names == *cap_names) {
+        *cap_names = *cap_names ? *cap_names * 2 : 64;
+        *names = (char **)realloc(*names, sizeof(char *) * (*cap_names));
+        MALLOC_CHK(*names);
+    }
+    (*names)[*n_names] = buf; // owned by the dictionary
+    kh_value(dict, k) = *n_names;
+    return (*n_names)++;
+}
+
+// record order: contig, pos, strand, code, ins_offset, haplotype. ids are ranks in the sorted dictionaries
+static int cmp_rec(const void *pa, const void *pb) {
+    const uint8_t *a = (const uint8_t *)pa;
+    const uint8_t *b = (const uint8_t *)pb;
+    uint32_t ca, cb;
+    int32_t pos_a, pos_b, hap_a, hap_b;
+    uint16_t ins_a, ins_b;
+    memcpy(&ca, a, 4);
+    memcpy(&cb, b, 4);
+    if (ca != cb) return ca < cb ? -1 : 1;
+    memcpy(&pos_a, a + 4, 4);
+    memcpy(&pos_b, b + 4, 4);
+    if (pos_a != pos_b) return pos_a < pos_b ? -1 : 1;
+    if (a[22] != b[22]) return a[22] < b[22] ? -1 : 1;
+    if (a[23] != b[23]) return a[23] < b[23] ? -1 : 1;
+    memcpy(&ins_a, a + 20, 2);
+    memcpy(&ins_b, b + 20, 2);
+    if (ins_a != ins_b) return ins_a < ins_b ? -1 : 1;
+    memcpy(&hap_a, a + 16, 4);
+    memcpy(&hap_b, b + 16, 4);
+    return cmp_haplotype(hap_a, hap_b);
+}
+
+static int cmp_name(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* a contig and its tid in the header, -1 if not in it */
+typedef struct {
+    char *name;
+    int32_t tid;
+} dict_ctg_t;
+
+// contigs in the header by tid, then the others by name, as in the output
+static int cmp_ctg(const void *pa, const void *pb) {
+    const dict_ctg_t *a = (const dict_ctg_t *)pa;
+    const dict_ctg_t *b = (const dict_ctg_t *)pb;
+    if (a->tid != b->tid) {
+        if (a->tid == -1) return 1;
+        if (b->tid == -1) return -1;
+        return a->tid < b->tid ? -1 : 1;
+    }
+    return strcmp(a->name, b->name);
+}
+
+// tid of a contig in the header, -1 if not in it
+static inline int32_t contig_tid(bam_hdr_t *contig_order, const char *name) {
+    int32_t tid = bam_name2id(contig_order, name);
+    return tid >= 0 ? tid : -1;
+}
+
+// sort the names, in header order if contig_order is given, and return the new id of each old id
+static uint32_t *sort_dict(char **names, uint32_t n, khash_t(dictm) *dict, bam_hdr_t *contig_order) {
+    if (contig_order != NULL) {
+        dict_ctg_t *ctgs = (dict_ctg_t *)malloc(sizeof(dict_ctg_t) * (n > 0 ? n : 1));
+        MALLOC_CHK(ctgs);
+        for (uint32_t i = 0; i < n; i++) {
+            ctgs[i].name = names[i];
+            ctgs[i].tid = contig_tid(contig_order, names[i]);
+        }
+        qsort(ctgs, n, sizeof(dict_ctg_t), cmp_ctg);
+        for (uint32_t i = 0; i < n; i++) {
+            names[i] = ctgs[i].name;
+        }
+        free(ctgs);
+    } else {
+        qsort(names, n, sizeof(char *), cmp_name);
+    }
+    uint32_t *rank = (uint32_t *)malloc(sizeof(uint32_t) * (n > 0 ? n : 1));
+    MALLOC_CHK(rank);
+    for (uint32_t i = 0; i < n; i++) {
+        khint_t k = kh_get(dictm, dict, names[i]);
+        rank[kh_value(dict, k)] = i;
+    }
+    return rank;
+}
+
+/* site order used by checkpoints and the output, -1, 0 or 1. contigs are in header order if ranked, else in name order */
+int freqdump_cmp_site(const freqdump_site_t *a, const freqdump_site_t *b) {
+    if (a->contig_tid != b->contig_tid) {
+        if (a->contig_tid == -1) return 1;
+        if (b->contig_tid == -1) return -1;
+        return a->contig_tid < b->contig_tid ? -1 : 1;
+    }
+    int cmp = strcmp(a->contig, b->contig);
+    if (cmp != 0) return cmp;
+    if (a->pos != b->pos) return a->pos < b->pos ? -1 : 1;
+    if (a->strand != b->strand) return (uint8_t)a->strand < (uint8_t)b->strand ? -1 : 1;
+    cmp = strcmp(a->code, b->code);
+    if (cmp != 0) return cmp;
+    if (a->ins_offset != b->ins_offset) return a->ins_offset < b->ins_offset ? -1 : 1;
+    return cmp_haplotype(a->haplotype, b->haplotype);
+}
+
+/* write the site table to a checkpoint in site order, keys are left untouched.
+ * contigs are in the order of the contig_order header if given, else in name order */
+void freqdump_write(const char *file, khash_t(freqm) *freq_map, const freqdump_hdr_t *hdr, bam_hdr_t *contig_order) {
+    FILE *fp = fopen(file, "wb");
+    F_CHK(fp, file);
+
+    khash_t(dictm) *contig_dict = kh_init(dictm);
+    khash_t(dictm) *code_dict = kh_init(dictm);
+    char **contigs = NULL, **codes = NULL;
+    uint32_t n_contigs = 0, cap_contigs = 0, n_codes = 0, cap_codes = 0;
+
+    // with haplotypes, each counter slot of a site with calls becomes a record
+    int n_slots = (hdr->flags & FREQDUMP_FLAG_HAP) ? FREQ_HP_SLOTS : 1;
+    uint64_t cap_recs = (uint64_t)kh_size(freq_map) * n_slots;
+    uint8_t *recs = (uint8_t *)malloc(FREQDUMP_REC_SIZE * (cap_recs > 0 ? cap_recs : 1));
+    MALLOC_CHK(recs);
+
+    // key is chrom \t pos \t strand \t mod_code \t ins_offset \t haplotype, the last two may be empty
+    uint64_t r = 0;
+    for (khint_t k = kh_begin(freq_map); k != kh_end(freq_map); ++k) {
+        if (!kh_exist(freq_map, k)) continue;
+        const char *key = kh_key(freq_map, k);
+        freq_t *freq = kh_value(freq_map, k);
+
+        const char *t1 = strchr(key, '\t');
+        const char *t2 = strchr(t1 + 1, '\t');
+        const char *t3 = strchr(t2 + 1, '\t');
+        const char *t4 = strchr(t3 + 1, '\t');
+        const char *t5 = strchr(t4 + 1, '\t');
+
+        uint32_t contig_id = get_dict_id(contig_dict, key, t1 - key, &contigs, &n_contigs, &cap_contigs);
+        uint32_t code_id = get_dict_id(code_dict, t3 + 1, t4 - t3 - 1, &codes, &n_codes, &cap_codes);
+        if (code_id >= FREQDUMP_MAX_CODES) {
+            ERROR("More than %d modification codes in a freq checkpoint", FREQDUMP_MAX_CODES);
+            exit(EXIT_FAILURE);
+        }
+        int32_t pos = atoi(t1 + 1);
+        uint8_t strand = (uint8_t)t2[1];
+        uint16_t ins_offset = t4[1] != '\t' ? (uint16_t)strtoul(t4 + 1, NULL, 10) : 0; // empty if not inserted
+        int32_t haplotype = t5[1] != '\0' ? atoi(t5 + 1) : -1; // empty without a haplotype
+
+        for (int slot = 0; slot < n_slots; slot++) {
+            if (n_slots > 1) {
+                if (freq[slot].n_called == 0) continue;
+                haplotype = slot == FREQ_HP_ALL ? -1 : slot;
+            }
+            uint8_t *rec = recs + FREQDUMP_REC_SIZE * r;
+            memcpy(rec, &contig_id, 4);
+            memcpy(rec + 4, &pos, 4);
+            memcpy(rec + 8, &freq[slot].n_called, 4);
+            memcpy(rec + 12, &freq[slot].n_mod, 4);
+            memcpy(rec + 16, &haplotype, 4);
+            memcpy(rec + 20, &ins_offset, 2);
+            rec[22] = strand;
+            rec[23] = (uint8_t)code_id;
+            r++;
+        }
+    }
+    uint64_t n_sites = r;
+
+    // renumber the dictionaries in site order so that sorting the records by id sorts them by name or header rank
+    uint32_t *contig_rank = sort_dict(contigs, n_contigs, contig_dict, contig_order);
+    uint32_t *code_rank = sort_dict(codes, n_codes, code_dict, NULL);
+    for (r = 0; r < n_sites; r++) {
+        uint8_t *rec = recs + FREQDUMP_REC_SIZE * r;
+        uint32_t contig_id;
+        memcpy(&contig_id, rec, 4);
+        contig_id = contig_rank[contig_id];
+        memcpy(rec, &contig_id, 4);
+        rec[23] = (uint8_t)code_rank[rec[23]];
+    }
+    free(contig_rank);
+    free(code_rank);
+    qsort(recs, n_sites, FREQDUMP_REC_SIZE, cmp_rec);
+
+    uint16_t version = FREQDUMP_VERSION;
+    fd_write(fp, FREQDUMP_MAGIC, 1, 4, file);
+    fd_write(fp, &version, sizeof(uint16_t), 1, file);
+    fd_write(fp, &hdr->flags, sizeof(uint16_t), 1, file);
+    fd_write(fp, &n_contigs, sizeof(uint32_t), 1, file);
+    for (uint32_t i = 0; i < n_contigs; i++) {
+        uint32_t len = strlen(contigs[i]);
+        fd_write(fp, &len, sizeof(uint32_t), 1, file);
+        fd_write(fp, contigs[i], 1, len, file);
+    }
+    fd_write(fp, &n_codes, sizeof(uint32_t), 1, file);
+    for (uint32_t i = 0; i < n_codes; i++) {
+        uint8_t len = strlen(codes[i]);
+        double thresh = get_thresh(hdr, codes[i], 1);
+        fd_write(fp, &len, sizeof(uint8_t), 1, file);
+        fd_write(fp, codes[i], 1, len, file);
+        fd_write(fp, &thresh, sizeof(double), 1, file);
+    }
+    fd_write(fp, &n_sites, sizeof(uint64_t), 1, file);
+    fd_write(fp, recs, FREQDUMP_REC_SIZE, n_sites, file);
+
+    fclose(fp);
+
+    for (uint32_t i = 0; i < n_contigs; i++) free(contigs[i]);
+    for (uint32_t i = 0; i < n_codes; i++) free(codes[i]);
+    free(contigs);
+    free(codes);
+    free(recs);
+    kh_destroy(dictm, contig_dict);
+    kh_destroy(dictm, code_dict);
+
+    fprintf(stderr, "[%s] %ld sites written to %s\n", __func__, (long)n_sites, file);
+}
+
+// add counts to a counter slot of a site, key is freed if the site is already present
+static inline freq_t *add_site(khash_t(freqm) *freq_map, char *key, int n_slots, int slot, uint32_t n_called, uint32_t n_mod) {
+    int ret;
+    khint_t k = kh_put(freqm, freq_map, key, &ret);
+    if (ret == 0) {
+        free(key);
+    } else {
+        freq_t *freq = (freq_t *)calloc(n_slots, sizeof(freq_t));
+        MALLOC_CHK(freq);
+        kh_value(freq_map, k) = freq;
+    }
+    freq_t *freq = kh_value(freq_map, k);
+    freq[slot].n_called += n_called;
+    freq[slot].n_mod += n_mod;
+    return freq;
+}
+
+/* open a checkpoint and read its header */
+freqdump_reader_t *freqdump_open(const char *file) {
+    freqdump_reader_t *rd = (freqdump_reader_t *)calloc(1, sizeof(freqdump_reader_t));
+    MALLOC_CHK(rd);
+    rd->file = copy_str(file, strlen(file));
+    rd->fp = fopen(file, "rb");
+    F_CHK(rd->fp, file);
+    FILE *fp = rd->fp;
+    freqdump_hdr_t *hdr = &rd->hdr;
+
+    char magic[4];
+    uint16_t version;
+    if (fd_read(fp, magic, 1, 4) != 0 || memcmp(magic, FREQDUMP_MAGIC, 4) != 0) {
+        ERROR("%s is not a minimod freq checkpoint", file);
+        exit(EXIT_FAILURE);
+    }
+    FD_READ_CHK(fd_read(fp, &version, sizeof(uint16_t), 1));
+    if (version != FREQDUMP_VERSION) {
+        ERROR("Unsupported freq checkpoint version %d in %s", version, file);
+        exit(EXIT_FAILURE);
+    }
+    FD_READ_CHK(fd_read(fp, &hdr->flags, sizeof(uint16_t), 1));
+
+    FD_READ_CHK(fd_read(fp, &rd->n_contigs, sizeof(uint32_t), 1));
+    rd->contigs = (char **)malloc(sizeof(char *) * (rd->n_contigs > 0 ? rd->n_contigs : 1));
+    MALLOC_CHK(rd->contigs);
+    for (uint32_t i = 0; i < rd->n_contigs; i++) {
+        uint32_t len;
+        FD_READ_CHK(fd_read(fp, &len, sizeof(uint32_t), 1));
+        rd->contigs[i] = (char *)malloc(len + 1);
+        MALLOC_CHK(rd->contigs[i]);
+        FD_READ_CHK(fd_read(fp, rd->contigs[i], 1, len));
+        rd->contigs[i][len] = '\0';
+    }
+
+    FD_READ_CHK(fd_read(fp, &hdr->n_codes, sizeof(uint32_t), 1));
+    if (hdr->n_codes > FREQDUMP_MAX_CODES) FD_READ_CHK(-1);
+    for (uint32_t i = 0; i < hdr->n_codes; i++) {
+        uint8_t len;
+        FD_READ_CHK(fd_read(fp, &len, sizeof(uint8_t), 1));
+        hdr->codes[i] = (char *)malloc(len + 1);
+        MALLOC_CHK(hdr->codes[i]);
+        FD_READ_CHK(fd_read(fp, hdr->codes[i], 1, len));
+        hdr->codes[i][len] = '\0';
+        FD_READ_CHK(fd_read(fp, &hdr->threshes[i], sizeof(double), 1));
+    }
+
+    FD_READ_CHK(fd_read(fp, &rd->n_sites, sizeof(uint64_t), 1));
+
+    return rd;
+}
+
+/* look up the contigs of a checkpoint in a header, so that freqdump_cmp_site orders them as in the output */
+void freqdump_rank_contigs(freqdump_reader_t *rd, bam_hdr_t *contig_order) {
+    rd->contig_tids = (int32_t *)malloc(sizeof(int32_t) * (rd->n_contigs > 0 ? rd->n_contigs : 1));
+    MALLOC_CHK(rd->contig_tids);
+    for (uint32_t i = 0; i < rd->n_contigs; i++) {
+        rd->contig_tids[i] = contig_tid(contig_order, rd->contigs[i]);
+    }
+}
+
+/* read the next record into site, 0 at the end of the checkpoint */
+int freqdump_next(freqdump_reader_t *rd, freqdump_site_t *site) {
+    const char *file = rd->file;
+    if (rd->i_buf == rd->n_buf) {
+        if (rd->done == rd->n_sites) return 0;
+        uint64_t n = rd->n_sites - rd->done < 1024 ? rd->n_sites - rd->done : 1024;
+        FD_READ_CHK(fd_read(rd->fp, rd->buf, FREQDUMP_REC_SIZE, n));
+        rd->done += n;
+        rd->n_buf = (uint32_t)n;
+        rd->i_buf = 0;
+    }
+
+    const uint8_t *rec = rd->buf + FREQDUMP_REC_SIZE * rd->i_buf++;
+    uint32_t contig_id;
+    memcpy(&contig_id, rec, 4);
+    memcpy(&site->pos, rec + 4, 4);
+    memcpy(&site->n_called, rec + 8, 4);
+    memcpy(&site->n_mod, rec + 12, 4);
+    memcpy(&site->haplotype, rec + 16, 4);
+    memcpy(&site->ins_offset, rec + 20, 2);
+    if (contig_id >= rd->n_contigs || rec[23] >= rd->hdr.n_codes) FD_READ_CHK(-1);
+    site->contig = rd->contigs[contig_id];
+    site->contig_tid = rd->contig_tids ? rd->contig_tids[contig_id] : -1;
+    site->code = rd->hdr.codes[rec[23]];
+    site->strand = (char)rec[22];
+    return 1;
+}
+
+void freqdump_close(freqdump_reader_t *rd) {
+    fclose(rd->fp);
+    for (uint32_t i = 0; i < rd->n_contigs; i++) free(rd->contigs[i]);
+    free(rd->contigs);
+    free(rd->contig_tids);
+    freqdump_hdr_destroy(&rd->hdr);
+    free(rd->file);
+    free(rd);
+}
+
+/* sum a checkpoint into freq_map, hdr gets its flags and thresholds. returns the number of sites read */
+int64_t freqdump_read(const char *file, khash_t(freqm) *freq_map, freqdump_hdr_t *hdr) {
+    freqdump_reader_t *rd = freqdump_open(file);
+
+    // with haplotypes, the records of a site are folded into the counter slots of one key
+    int n_slots = (rd->hdr.flags & FREQDUMP_FLAG_HAP) ? FREQ_HP_SLOTS : 1;
+    freqdump_site_t site;
+    while (freqdump_next(rd, &site)) {
+        int slot = n_slots > 1 ? freq_hp_slot(site.haplotype) : 0;
+        if (slot < 0) FD_READ_CHK(-1);
+        char *key = make_key(site.contig, site.pos, site.ins_offset, (char *)site.code, site.strand, n_slots > 1 ? -1 : site.haplotype);
+        add_site(freq_map, key, n_slots, slot, site.n_called, site.n_mod);
+    }
+
+    int64_t n_sites = (int64_t)rd->n_sites;
+    *hdr = rd->hdr; // the codes are handed over to hdr
+    rd->hdr.n_codes = 0;
+    freqdump_close(rd);
+
+    return n_sites;
+}
+
+/* move all sites of src into dst and destroy src, each site has n_slots counters */
+void freqdump_merge_maps(khash_t(freqm) *dst, khash_t(freqm) *src, int n_slots) {
+    for (khint_t k = kh_begin(src); k != kh_end(src); ++k) {
+        if (!kh_exist(src, k)) continue;
+        char *key = (char *)kh_key(src, k);
+        freq_t *freq = kh_value(src, k);
+        freq_t *dst_freq = add_site(dst, key, n_slots, 0, freq[0].n_called, freq[0].n_mod);
+        for (int slot = 1; slot < n_slots; slot++) {
+            dst_freq[slot].n_called += freq[slot].n_called;
+            dst_freq[slot].n_mod += freq[slot].n_mod;
+        }
+        free(freq);
+    }
+    kh_destroy(freqm, src);
+}
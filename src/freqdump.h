@@ -0,0 +1,115 @@
+/**
+ * @file freqdump.h
+ * @brief mergeable binary checkpoints of the freq site table
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+#ifndef FREQDUMP_H
+#define FREQDUMP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "minimod.h"
+
+/*
+ * File layout (integers in host byte order)
+ *
+ *  header  : magic "MMFQ", uint16 version, uint16 flags,
+ *            uint32 n_contigs, n_contigs x {uint32 len, char name[len]},
+ *            uint32 n_codes, n_codes x {uint8 len, char code[len], double thresh},
+ *            uint64 n_sites
+ *  records : n_sites x 24 bytes
+ *              uint32 contig_id, int32 pos, uint32 n_called, uint32 n_mod,
+ *              int32 haplotype, uint16 ins_offset, uint8 strand, uint8 code_id
+ *
+ * Counts are pooled over all input files. With haplotypes, the counters of a site are
+ * written as one record per haplotype (-1 for all haplotypes) and folded back on reading. The threshold of each mod code is kept
+ * so that only checkpoints called with the same thresholds are summed.
+ * Contig and code dictionaries are in name order and records are sorted by contig, pos,
+ * strand, code, ins_offset and haplotype (HP ascending, -1 last as in the output), so checkpoints
+ * can be merged as sorted runs. The spill runs of --max-mem instead have their contigs in the
+ * order of the BAM header, as in the output, and are merged with freqdump_rank_contigs set.
+ */
+
+#define FREQDUMP_MAGIC "MMFQ"
+#define FREQDUMP_VERSION 1
+#define FREQDUMP_FLAG_INS 0x1
+#define FREQDUMP_FLAG_HAP 0x2
+#define FREQDUMP_MAX_CODES 256
+#define FREQDUMP_REC_SIZE 24
+
+/* flags and mod code thresholds of a checkpoint */
+typedef struct {
+    uint16_t flags;
+    uint32_t n_codes;
+    char *codes[FREQDUMP_MAX_CODES];
+    double threshes[FREQDUMP_MAX_CODES];
+} freqdump_hdr_t;
+
+void freqdump_hdr_from_opt(freqdump_hdr_t *hdr, opt_t *opt);
+void freqdump_hdr_merge(freqdump_hdr_t *dst, const freqdump_hdr_t *src, const char *file);
+void freqdump_check_opt(const freqdump_hdr_t *hdr, opt_t *opt, const char *file);
+void freqdump_hdr_destroy(freqdump_hdr_t *hdr);
+
+/* one record of a checkpoint, names point into the reader */
+typedef struct {
+    const char *contig;
+    const char *code;
+    int32_t contig_tid; // tid in the header given to freqdump_rank_contigs, -1 if not in it or not ranked
+    int32_t pos;
+    int32_t haplotype;
+    uint32_t n_called;
+    uint32_t n_mod;
+    uint16_t ins_offset;
+    char strand;
+} freqdump_site_t;
+
+/* sequential reader of a checkpoint */
+typedef struct {
+    FILE *fp;
+    char *file;
+    freqdump_hdr_t hdr;
+    char **contigs;
+    int32_t *contig_tids; // NULL unless ranked by a header
+    uint32_t n_contigs;
+    uint64_t n_sites;
+    uint64_t done;
+    uint32_t n_buf;
+    uint32_t i_buf;
+    uint8_t buf[FREQDUMP_REC_SIZE * 1024];
+} freqdump_reader_t;
+
+void freqdump_write(const char *file, khash_t(freqm) *freq_map, const freqdump_hdr_t *hdr, bam_hdr_t *contig_order);
+int64_t freqdump_read(const char *file, khash_t(freqm) *freq_map, freqdump_hdr_t *hdr);
+void freqdump_merge_maps(khash_t(freqm) *dst, khash_t(freqm) *src, int n_slots);
+
+freqdump_reader_t *freqdump_open(const char *file);
+void freqdump_rank_contigs(freqdump_reader_t *rd, bam_hdr_t *contig_order);
+int freqdump_next(freqdump_reader_t *rd, freqdump_site_t *site);
+void freqdump_close(freqdump_reader_t *rd);
+int freqdump_cmp_site(const freqdump_site_t *a, const freqdump_site_t *b);
+
+#endif
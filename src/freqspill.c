@@ -0,0 +1,140 @@
+/**
+ * @file freqspill.c
+ * @brief spilling the freq table to sorted runs under --max-mem
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+
+#include "freqspill.h"
+#include "freqdump.h"
+#include "freqbin.h"
+#include "minimod.h"
+#include "mod.h"
+#include "misc.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* sort the freq table into a new run file and empty it */
+void freqspill_write(core_t *core) {
+    const char *tmp_dir = getenv("TMPDIR");
+    if (tmp_dir == NULL || tmp_dir[0] == '\0') {
+        tmp_dir = "/tmp";
+    }
+
+    size_t len = strlen(tmp_dir) + 64;
+    char *file = (char *)malloc(len);
+    MALLOC_CHK(file);
+    snprintf(file, len, "%s/minimod.%ld.%d.run", tmp_dir, (long)getpid(), core->n_spills);
+
+    freqdump_hdr_t hdr;
+    freqdump_hdr_from_opt(&hdr, &core->opt);
+    freqdump_write(file, core->freq_map, &hdr, core->bam_hdrs[0]); // contigs in the output order
+    freqdump_hdr_destroy(&hdr);
+
+    destroy_freq_map(core->freq_map);
+    core->freq_map = kh_init(freqm);
+
+    core->spill_files = (char **)realloc(core->spill_files, sizeof(char *) * (core->n_spills + 1));
+    MALLOC_CHK(core->spill_files);
+    core->spill_files[core->n_spills++] = file;
+}
+
+/* print the runs merged in site order, the rest of the table is spilled first. runs are deleted afterwards */
+void freqspill_print(core_t *core) {
+    double output_start = realtime();
+
+    if (kh_size(core->freq_map) > 0) {
+        freqspill_write(core);
+    }
+
+    int32_t n = core->n_spills;
+    freqdump_reader_t **rds = (freqdump_reader_t **)malloc(sizeof(freqdump_reader_t *) * n);
+    MALLOC_CHK(rds);
+    freqdump_site_t *heads = (freqdump_site_t *)malloc(sizeof(freqdump_site_t) * n);
+    MALLOC_CHK(heads);
+    int *live = (int *)malloc(sizeof(int) * n);
+    MALLOC_CHK(live);
+
+    for (int32_t i = 0; i < n; i++) {
+        rds[i] = freqdump_open(core->spill_files[i]);
+        freqdump_rank_contigs(rds[i], core->bam_hdrs[0]);
+        live[i] = freqdump_next(rds[i], &heads[i]);
+    }
+
+    // there are only a few runs, a linear scan for the smallest head is enough
+    int64_t n_sites = 0;
+    while (1) {
+        int32_t min = -1;
+        for (int32_t i = 0; i < n; i++) {
+            if (live[i] && (min < 0 || freqdump_cmp_site(&heads[i], &heads[min]) < 0)) {
+                min = i;
+            }
+        }
+        if (min < 0) {
+            break;
+        }
+
+        freqdump_site_t site = heads[min]; // names stay valid until the reader is closed
+        freq_t freq = {0, 0};
+        for (int32_t i = min; i < n; i++) { // the same site is at most once in each run
+            if (live[i] && freqdump_cmp_site(&heads[i], &site) == 0) {
+                freq.n_called += heads[i].n_called;
+                freq.n_mod += heads[i].n_mod;
+                live[i] = freqdump_next(rds[i], &heads[i]);
+            }
+        }
+
+        print_freq_site(core, site.contig, site.pos, site.strand, site.code, site.ins_offset, site.haplotype, &freq);
+        n_sites++;
+    }
+
+    for (int32_t i = 0; i < n; i++) {
+        freqdump_close(rds[i]);
+        if (remove(core->spill_files[i]) != 0) {
+            WARNING("Could not delete %s", core->spill_files[i]);
+        }
+        free(core->spill_files[i]);
+    }
+    free(core->spill_files);
+    core->spill_files = NULL;
+    core->n_spills = 0;
+    free(rds);
+    free(heads);
+    free(live);
+
+    if (core->freq_bin) {
+        freqbin_write(core->freq_bin);
+    }
+    FILE *out_fp = sink_fp(&core->opt, FREQ);
+    if (out_fp != stdout) {
+        fclose(out_fp);
+    }
+
+    fprintf(stderr, "[%s] %ld sites merged from %d runs\n", __func__, (long)n_sites, n);
+    core->output_time += realtime() - output_start;
+}
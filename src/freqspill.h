@@ -0,0 +1,47 @@
+/**
+ * @file freqspill.h
+ * @brief spilling the freq table to sorted runs under --max-mem
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+
+#ifndef FREQSPILL_H
+#define FREQSPILL_H
+
+#include "minimod.h"
+
+/*
+ * When the freq table grows over its share of --max-mem, it is written to a run file
+ * in the checkpoint format (records in site order) and emptied. At the end the runs and
+ * what is left in the table are merged in site order and printed, summing the counts
+ * of the same site, so the whole table is never held in memory at once.
+ * Run files go to $TMPDIR (/tmp if unset) and are deleted after the merge.
+ */
+
+void freqspill_write(core_t *core);
+void freqspill_print(core_t *core);
+
+#endif
@@ -42,6 +42,9 @@ SOFTWARE.
 int view_main(int argc, char* argv[]);
 int freq_main(int argc, char* argv[]);
 int summary_main(int argc, char* argv[]);
+int cat_main(int argc, char* argv[]);
+int merge_main(int argc, char* argv[]);
+int multi_main(int argc, char* argv[]);
 
 int print_usage(FILE *fp_help){
 
@@ -50,6 +53,9 @@ int print_usage(FILE *fp_help){
     fprintf(fp_help,"         view       view base modifications\n");
     fprintf(fp_help,"         freq       output base modification frequencies\n");
     fprintf(fp_help,"         summary    output summary\n");
+    fprintf(fp_help,"         cat        convert binary view output to tsv\n");
+    fprintf(fp_help,"         merge      merge freq checkpoints\n");
+    fprintf(fp_help,"         multi      view, freq and summary outputs from a single pass\n");
 
     if(fp_help==stderr){
         return(EXIT_FAILURE);
@@ -78,6 +84,12 @@ int main(int argc, char* argv[]){
         ret=freq_main(argc-1, argv+1);
     } else if (strcmp(argv[1],"summary")==0){
         ret=summary_main(argc-1, argv+1);
+    } else if (strcmp(argv[1],"cat")==0){
+        ret=cat_main(argc-1, argv+1);
+    } else if (strcmp(argv[1],"merge")==0){
+        ret=merge_main(argc-1, argv+1);
+    } else if (strcmp(argv[1],"multi")==0){
+        ret=multi_main(argc-1, argv+1);
     } else if(strcmp(argv[1],"--version")==0 || strcmp(argv[1],"-V")==0){
         fprintf(stdout,"minimod %s\n",MINIMOD_VERSION);
         exit(EXIT_SUCCESS);
@@ -0,0 +1,223 @@
+/**
+ * @file merge_main.c
+ * @brief entry point to merge - combine freq checkpoints
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+#include "minimod.h"
+#include "mod.h"
+#include "freqdump.h"
+#include "error.h"
+#include "misc.h"
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct option long_options[] = {
+    {"bedmethyl", no_argument, 0, 'b'},            //0 output in bedMethyl format
+    {"threads", required_argument, 0, 't'},        //1 number of threads [8]
+    {"output",required_argument, 0, 'o'},          //2 output file
+    {"verbose", required_argument, 0, 'v'},        //3 verbosity level [1]
+    {"help", no_argument, 0, 'h'},                 //4
+    {"version", no_argument, 0, 'V'},              //5
+    {"dump",required_argument, 0, 0},              //6 write the merged counts to a checkpoint
+    {0, 0, 0, 0}};
+
+static inline void print_help_msg(FILE *fp_help, opt_t opt){
+    fprintf(fp_help,"Usage: minimod merge a.ckpt b.ckpt [c.ckpt ...]\n");
+    fprintf(fp_help,"\nbasic options:\n");
+    fprintf(fp_help,"   -b                         output in bedMethyl format [%s]\n", (opt.bedmethyl_out?"yes":"not set"));
+    fprintf(fp_help,"   -t INT                     number of threads [%d]\n",opt.num_thread);
+    fprintf(fp_help,"   -o FILE                    output file [%s]\n", opt.output_file==NULL?"stdout":opt.output_file);
+    fprintf(fp_help,"   -h                         help\n");
+    fprintf(fp_help,"   --dump FILE                also write the merged counts to a checkpoint FILE\n");
+    fprintf(fp_help,"   --verbose INT              verbosity level [%d]\n",(int)get_log_level());
+    fprintf(fp_help,"   --version                  print version\n");
+}
+
+typedef struct {
+    char **files;
+    int32_t n_files;
+    int32_t start; // first file of this thread
+    int32_t step; // files start, start+step, ...
+    freqdump_hdr_t *hdrs; // one per file
+    khash_t(freqm) *freq_map;
+    khash_t(freqm) *merge_from; // only for the reduction
+    int n_slots; // counters per site, only for the reduction
+} merge_arg_t;
+
+// sum the files of a thread into its own map
+static void *read_checkpoints(void *voidargs) {
+    merge_arg_t *args = (merge_arg_t *)voidargs;
+    for (int32_t f = args->start; f < args->n_files; f += args->step) {
+        int64_t n_sites = freqdump_read(args->files[f], args->freq_map, &args->hdrs[f]);
+        VERBOSE("%ld sites loaded from %s", (long)n_sites, args->files[f]);
+    }
+    pthread_exit(0);
+}
+
+static void *merge_maps(void *voidargs) {
+    merge_arg_t *args = (merge_arg_t *)voidargs;
+    freqdump_merge_maps(args->freq_map, args->merge_from, args->n_slots);
+    args->merge_from = NULL;
+    pthread_exit(0);
+}
+
+int merge_main(int argc, char* argv[]) {
+
+    const char* optstring = "bt:o:v:hV";
+
+    int longindex = 0;
+    int32_t c = -1;
+
+    FILE *fp_help = stderr;
+
+    opt_t opt;
+    init_opt(&opt); //initialise options to defaults
+    opt.subtool = FREQ;
+
+    while ((c = getopt_long(argc, argv, optstring, long_options, &longindex)) >= 0) {
+        if (c == 'b') {
+            opt.bedmethyl_out = 1;
+        } else if (c == 't') {
+            opt.num_thread = atoi(optarg);
+            if (opt.num_thread < 1) {
+                ERROR("Number of threads should larger than 0. You entered %d", opt.num_thread);
+                exit(EXIT_FAILURE);
+            }
+        } else if (c == 'o') {
+            FILE *fp = fopen(optarg, "w");
+            if (fp == NULL) {
+                ERROR("Cannot open file %s for writing", optarg);
+                exit(EXIT_FAILURE);
+            }
+            opt.output_file = optarg;
+            opt.output_fp = fp;
+        } else if (c=='v'){
+            int v = atoi(optarg);
+            set_log_level((enum log_level_opt)v);
+        } else if (c=='V'){
+            fprintf(stdout,"minimod %s\n",MINIMOD_VERSION);
+            exit(EXIT_SUCCESS);
+        } else if (c=='h'){
+            fp_help = stdout;
+        } else if (c == 0 && longindex == 6) { //checkpoint output
+            opt.dump_file = optarg;
+        } else {
+            print_help_msg(fp_help, opt);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc - optind < 1 || fp_help == stdout) {
+        print_help_msg(fp_help, opt);
+        if(fp_help == stdout){
+            exit(EXIT_SUCCESS);
+        }
+        exit(EXIT_FAILURE);
+    }
+
+    char **files = &argv[optind];
+    int32_t n_files = argc - optind;
+    int32_t n_threads = opt.num_thread < n_files ? opt.num_thread : n_files;
+
+    freqdump_hdr_t *hdrs = (freqdump_hdr_t *)calloc(n_files, sizeof(freqdump_hdr_t));
+    MALLOC_CHK(hdrs);
+    merge_arg_t *args = (merge_arg_t *)calloc(n_threads, sizeof(merge_arg_t));
+    MALLOC_CHK(args);
+    pthread_t *tids = (pthread_t *)malloc(sizeof(pthread_t) * n_threads);
+    MALLOC_CHK(tids);
+
+    // each thread sums every n_threads-th file into its own map
+    for (int32_t t = 0; t < n_threads; t++) {
+        args[t].files = files;
+        args[t].n_files = n_files;
+        args[t].start = t;
+        args[t].step = n_threads;
+        args[t].hdrs = hdrs;
+        args[t].freq_map = kh_init(freqm);
+        int ret = pthread_create(&tids[t], NULL, read_checkpoints, (void *)(&args[t]));
+        NEG_CHK(ret);
+    }
+    for (int32_t t = 0; t < n_threads; t++) {
+        int ret = pthread_join(tids[t], NULL);
+        NEG_CHK(ret);
+    }
+
+    // all checkpoints must have been called the same way
+    freqdump_hdr_t merged_hdr;
+    memset(&merged_hdr, 0, sizeof(freqdump_hdr_t));
+    merged_hdr.flags = hdrs[0].flags;
+    for (int32_t f = 0; f < n_files; f++) {
+        freqdump_hdr_merge(&merged_hdr, &hdrs[f], files[f]);
+        freqdump_hdr_destroy(&hdrs[f]);
+    }
+
+    // pairwise reduction of the thread maps into the first one
+    for (int32_t step = 1; step < n_threads; step *= 2) {
+        int32_t n_pairs = 0;
+        for (int32_t t = 0; t + step < n_threads; t += 2 * step) {
+            args[t].merge_from = args[t + step].freq_map;
+            args[t].n_slots = (merged_hdr.flags & FREQDUMP_FLAG_HAP) ? FREQ_HP_SLOTS : 1;
+            int ret = pthread_create(&tids[n_pairs++], NULL, merge_maps, (void *)(&args[t]));
+            NEG_CHK(ret);
+        }
+        for (int32_t p = 0; p < n_pairs; p++) {
+            int ret = pthread_join(tids[p], NULL);
+            NEG_CHK(ret);
+        }
+    }
+
+    opt.insertions = (merged_hdr.flags & FREQDUMP_FLAG_INS) != 0;
+    opt.haplotypes = (merged_hdr.flags & FREQDUMP_FLAG_HAP) != 0;
+
+    core_t *core = (core_t *)calloc(1, sizeof(core_t));
+    MALLOC_CHK(core);
+    core->opt = opt;
+    core->n_bams = 1;
+    core->freq_map = args[0].freq_map;
+
+    fprintf(stderr, "[%s] %d checkpoints merged into %d sites\n", __func__, n_files, (int)kh_size(core->freq_map));
+
+    if (opt.dump_file) { // before printing, which consumes the keys
+        freqdump_write(opt.dump_file, core->freq_map, &merged_hdr, NULL);
+    }
+
+    print_freq_header(core);
+    print_freq_output(core);
+
+    destroy_freq_map(core->freq_map);
+    freqdump_hdr_destroy(&merged_hdr);
+    free(core);
+    free(args);
+    free(tids);
+    free(hdrs);
+    free_opt(&opt);
+
+    return 0;
+}
@@ -43,10 +43,126 @@ SOFTWARE.
 #include "error.h"
 #include "khash.h"
 #include "ref.h"
+#include "seqkernel.h"
+#include "freqdump.h"
+#include "freqspill.h"
+#include "profile.h"
+
+#include <htslib/bgzf.h>
+#include <htslib/cram.h>
 
 #include <sys/wait.h>
 #include <unistd.h>
 
+/* sample name of an input file: the file name without the directory and the extension */
+static char *get_sample_name(const char *bam_file) {
+    if (strcmp(bam_file, "-") == 0) {
+        bam_file = "stdin";
+    }
+    const char *base = strrchr(bam_file, '/');
+    base = base ? base + 1 : bam_file;
+    size_t len = strlen(base);
+    const char *exts[] = {".bam", ".cram", ".sam"};
+    for(int i = 0; i < 3; i++){
+        size_t ext_len = strlen(exts[i]);
+        if(len > ext_len && strcmp(base + len - ext_len, exts[i]) == 0){
+            len -= ext_len;
+            break;
+        }
+    }
+    char *name = (char *)malloc(len + 1);
+    MALLOC_CHK(name);
+    memcpy(name, base, len);
+    name[len] = '\0';
+    return name;
+}
+
+/* files with the same name in different directories get the file number appended, so that the --per-sample columns stay apart */
+static void make_sample_names_unique(char **names, int32_t n) {
+    for (int32_t b = 1; b < n; b++) {
+        int32_t dup = 0;
+        for (int32_t a = 0; a < b; a++) {
+            if (strcmp(names[a], names[b]) == 0) {
+                dup = 1;
+                break;
+            }
+        }
+        if (!dup) continue;
+        for (int32_t suffix = b + 1; ; suffix++) { // 1-based file number, then the next free one
+            size_t len = strlen(names[b]) + 16;
+            char *name = (char *)malloc(len);
+            MALLOC_CHK(name);
+            snprintf(name, len, "%s_%d", names[b], suffix);
+            int32_t taken = 0;
+            for (int32_t a = 0; a < n; a++) {
+                if (a != b && strcmp(names[a], name) == 0) {
+                    taken = 1;
+                    break;
+                }
+            }
+            if (taken) {
+                free(name);
+                continue;
+            }
+            WARNING("Input file %d has the same sample name %s as an earlier file, using %s", b + 1, names[b], name);
+            free(names[b]);
+            names[b] = name;
+            break;
+        }
+    }
+}
+
+/* same contigs in the same order, so that reference ids of one file are valid in the other */
+static int same_contigs(bam_hdr_t *a, bam_hdr_t *b) {
+    if (a->n_targets != b->n_targets) {
+        return 0;
+    }
+    for (int32_t i = 0; i < a->n_targets; i++) {
+        if (a->target_len[i] != b->target_len[i] || strcmp(a->target_name[i], b->target_name[i]) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * CRAM decoding options. Only the fields minimod reads are decoded, qualities, mate fields and MD/NM are skipped.
+ * The reference comes from the same fasta as load_ref, and CRAM files with the same contigs as an earlier one
+ * share its htslib reference cache so each contig is loaded once however many CRAM files are given.
+ */
+static void set_cram_opts(core_t *core, int32_t b, int32_t *shared) {
+    htsFile *fp = core->bam_fps[b];
+    const char *fn = core->opt.bam_files[b];
+
+    if (hts_set_opt(fp, CRAM_OPT_REQUIRED_FIELDS, SAM_QNAME | SAM_FLAG | SAM_RNAME | SAM_POS | SAM_MAPQ | SAM_CIGAR | SAM_SEQ | SAM_AUX) != 0 ||
+        hts_set_opt(fp, CRAM_OPT_DECODE_MD, 0) != 0) {
+        WARNING("Could not set the CRAM decoding options for %s", fn);
+    }
+
+    if (core->opt.ref_file == NULL) {
+        return; // summary, htslib finds the reference through the header, REF_PATH and REF_CACHE
+    }
+
+#if defined(HTS_VERSION) && HTS_VERSION >= 101000
+    if (*shared >= 0 && same_contigs(core->bam_hdrs[*shared], core->bam_hdrs[b])) {
+        if (hts_set_opt(fp, CRAM_OPT_SHARED_REF, cram_get_refs(core->bam_fps[*shared])) != 0) {
+            ERROR("Could not share the CRAM reference of %s with %s", core->opt.bam_files[*shared], fn);
+            exit(EXIT_FAILURE);
+        }
+        LOG_DEBUG("%s shares the CRAM reference of %s", fn, core->opt.bam_files[*shared]);
+        return;
+    }
+#endif
+
+    if (hts_set_fai_filename(fp, core->opt.ref_file) != 0) {
+        ERROR("Could not set the reference %s for CRAM input %s", core->opt.ref_file, fn);
+        exit(EXIT_FAILURE);
+    }
+    if (*shared < 0) {
+        *shared = b;
+    }
+}
+
 /* initialise the core data structure */
 core_t* init_core(opt_t opt,double realtime0) {
 
@@ -55,6 +171,10 @@ core_t* init_core(opt_t opt,double realtime0) {
 
     core->opt = opt;
 
+    // pick the sequence kernels for this cpu
+    seqkernel_init();
+    VERBOSE("using %s sequence kernels", seqkernel_name());
+
     //realtime0
     core->realtime0=realtime0;
 
@@ -64,17 +184,84 @@ core_t* init_core(opt_t opt,double realtime0) {
     core->merge_db_time=0;
     core->sort_time=0;
 
+    core->batch_size = core->next_batch_size = opt.batch_size;
+    core->batch_size_bases = core->next_batch_size_bases = opt.batch_size_bases;
+    core->last_reads = 0;
+    core->last_bytes = 0;
+    core->last_load_time = core->last_process_time = core->last_output_time = 0;
+    core->adapt_rss = 0;
+
+    core->mem_fixed = 0;
+    core->mem_batches = 0;
+    core->mem_map = 0;
+    core->mem_peak = 0;
+    pthread_mutex_init(&core->mem_lock, NULL);
+    pthread_cond_init(&core->mem_cond, NULL);
+    core->spill_files = NULL;
+    core->n_spills = 0;
+
+    core->prof = opt.profile_file ? profile_init(opt.num_thread) : NULL;
+
     core->total_bytes=0;
     core->total_reads=0;
     core->processed_reads=0;
     core->processed_bytes=0;
+    core->processed_bases=0;
+    memset(core->skipped, 0, sizeof(core->skipped));
+    core->skip_buf = NULL;
+    core->skip_buf_cap = 0;
+
+    // open the bam files, all of them share one decompression thread pool
+    core->n_bams = opt.n_bams;
+    core->bam_fps = (htsFile**)malloc(sizeof(htsFile*) * core->n_bams);
+    MALLOC_CHK(core->bam_fps);
+    core->bam_hdrs = (bam_hdr_t**)malloc(sizeof(bam_hdr_t*) * core->n_bams);
+    MALLOC_CHK(core->bam_hdrs);
+    core->sample_names = (char**)malloc(sizeof(char*) * core->n_bams);
+    MALLOC_CHK(core->sample_names);
+
+    // decompression and decode threads, sized apart from -t so that they do not oversubscribe the processing threads
+    core->n_io_threads = opt.io_threads >= 0 ? opt.io_threads : (opt.num_thread > 1 ? (opt.num_thread + 3) / 4 : 0);
+    core->hts_pool = NULL;
+    core->decode_queue = NULL;
+    if(core->n_io_threads > 0){
+        core->hts_pool = hts_tpool_init(core->n_io_threads);
+        NULL_CHK(core->hts_pool);
+        // decode jobs of load_db, no results are kept
+        core->decode_queue = hts_tpool_process_init(core->hts_pool, core->n_io_threads * 2, 1);
+        NULL_CHK(core->decode_queue);
+    }
+    htsThreadPool thread_pool = {core->hts_pool, 0};
+
+    int32_t shared_cram = -1; // first CRAM file, the others reuse its reference
+    for(int32_t b = 0; b < core->n_bams; b++){
+        core->bam_fps[b] = sam_open(opt.bam_files[b], "r"); // SAM, BAM or CRAM, - for stdin
+        if(core->bam_fps[b] == NULL){
+            ERROR("Could not open %s", strcmp(opt.bam_files[b], "-") == 0 ? "stdin" : opt.bam_files[b]);
+            exit(EXIT_FAILURE);
+        }
 
-    // load bam file
-    core->bam_fp = sam_open(opt.bam_file, "r");
-    NULL_CHK(core->bam_fp);
+        if(core->hts_pool){
+            hts_set_thread_pool(core->bam_fps[b], &thread_pool);
+        }
+
+        core->bam_hdrs[b] = sam_hdr_read(core->bam_fps[b]);
+        NULL_CHK(core->bam_hdrs[b]);
+
+        // the CRAM header is read by sam_open, no sequence is decoded before this
+        if(hts_get_format(core->bam_fps[b])->format == cram){
+            set_cram_opts(core, b, &shared_cram);
+        }
 
-    if(opt.num_thread > 1){
-        hts_set_threads(core->bam_fp, opt.num_thread);
+        core->sample_names[b] = get_sample_name(opt.bam_files[b]);
+    }
+    make_sample_names_unique(core->sample_names, core->n_bams);
+    core->bam_i = 0;
+    core->bam_fp = core->bam_fps[0];
+    core->bam_hdr = core->bam_hdrs[0];
+
+    if(core->n_bams > 1){
+        INFO("%d input files, %s", core->n_bams, opt.per_sample ? "counted per sample" : "pooled");
     }
 
     // // load bam index file
@@ -85,10 +272,6 @@ core_t* init_core(opt_t opt,double realtime0) {
     //     exit(EXIT_FAILURE);
     // }
 
-    // read the bam header
-    core->bam_hdr = sam_hdr_read(core->bam_fp);
-    NULL_CHK(core->bam_hdr);
-
     // // If processing a region of the genome, get clipping coordinates
     // core->clip_start = -1;
     // core->clip_end = -1;
@@ -129,9 +312,17 @@ core_t* init_core(opt_t opt,double realtime0) {
     //     }
     // }
 
-    if (opt.subtool == FREQ) {
+    if (HAS_OUTPUT(opt, FREQ)) {
         core->freq_map = kh_init(freqm);
     }
+
+    core->view_bin = NULL;
+    core->freq_bin = NULL;
+
+    core->mod_hists = NULL;
+    core->n_mod_hists = 0;
+    core->cap_mod_hists = 0;
+    core->ml_hist_bases = 0;
     
     return core;
 }
@@ -149,14 +340,36 @@ void free_core(core_t* core,opt_t opt) {
     //     free(core->reg_list);
     // }
 
-    bam_hdr_destroy(core->bam_hdr);
+    for(int32_t b = 0; b < core->n_bams; b++){
+        bam_hdr_destroy(core->bam_hdrs[b]);
+        sam_close(core->bam_fps[b]);
+        free(core->sample_names[b]);
+    }
+    free(core->bam_hdrs);
+    free(core->bam_fps);
+    free(core->sample_names);
+    free(core->skip_buf);
     // hts_idx_destroy(core->bam_idx);
-    sam_close(core->bam_fp);
+    if(core->hts_pool){
+        hts_tpool_process_destroy(core->decode_queue);
+        hts_tpool_destroy(core->hts_pool);
+    }
 
-    if (opt.subtool == FREQ) {
+    if (HAS_OUTPUT(opt, FREQ)) {
         destroy_freq_map(core->freq_map);
     }
 
+    free(core->mod_hists);
+
+    pthread_mutex_destroy(&core->mem_lock);
+    pthread_cond_destroy(&core->mem_cond);
+    for(int32_t i = 0; i < core->n_spills; i++){
+        free(core->spill_files[i]);
+    }
+    free(core->spill_files);
+
+    profile_destroy(core->prof);
+
     free(core);
 }
 
@@ -165,11 +378,18 @@ db_t* init_db(core_t* core) {
     db_t* db = (db_t*)(malloc(sizeof(db_t)));
     MALLOC_CHK(db);
 
-    db->cap_bam_recs = core->opt.batch_size;
+    db->cap_bam_recs = core->next_batch_size;
     db->n_bam_recs = 0;
+    db->mem = 0;
     db->processed_bytes=0;
+    db->processed_bases=0;
     db->total_reads=0;
     db->total_bytes=0;
+    db->rec_threads = NULL;
+    db->freq_maps = NULL; // only the arrays of the outputs in use are allocated below
+    db->view_maps = NULL;
+    db->read_mods = NULL;
+    db->summary_maps = NULL;
 
     db->bam_recs = (bam1_t**)(malloc(sizeof(bam1_t*) * db->cap_bam_recs));
     MALLOC_CHK(db->bam_recs);
@@ -180,35 +400,53 @@ db_t* init_db(core_t* core) {
     MALLOC_CHK(db->ml_lens);
     db->ml = (uint8_t**)(malloc(sizeof(uint8_t*) * db->cap_bam_recs));
     MALLOC_CHK(db->ml);
-    db->aln = (int**)(malloc(sizeof(int*) * db->cap_bam_recs));
-    MALLOC_CHK(db->aln);
-
-    if(core->opt.insertions) {
-        db->ins = (int**)(malloc(sizeof(int*) * db->cap_bam_recs));
-        MALLOC_CHK(db->ins);
-        db->ins_offset = (int**)(malloc(sizeof(int*) * db->cap_bam_recs));
-        MALLOC_CHK(db->ins_offset);
-    }
+    db->bam_idx = (int32_t*)(malloc(sizeof(int32_t) * db->cap_bam_recs));
+    MALLOC_CHK(db->bam_idx);
+    db->hps = (uint8_t*)(calloc(db->cap_bam_recs, sizeof(uint8_t)));
+    MALLOC_CHK(db->hps);
+    db->aln_segs = (aln_seg_t**)(malloc(sizeof(aln_seg_t*) * db->cap_bam_recs));
+    MALLOC_CHK(db->aln_segs);
+    db->n_aln_segs = (int*)(malloc(sizeof(int) * db->cap_bam_recs));
+    MALLOC_CHK(db->n_aln_segs);
     
-    db->bases_pos = (int***)(malloc(sizeof(int**) * db->cap_bam_recs));
-    MALLOC_CHK(db->bases_pos);
-    db->skip_counts = (int**)(malloc(sizeof(int*) * db->cap_bam_recs));
-    MALLOC_CHK(db->skip_counts);
     db->mod_codes = (char**)(malloc(sizeof(char*) * db->cap_bam_recs));
     MALLOC_CHK(db->mod_codes);
     db->mod_codes_cap = (uint8_t*)(malloc(sizeof(uint8_t) * db->cap_bam_recs));
     MALLOC_CHK(db->mod_codes_cap);
     
 
-    if(core->opt.subtool == FREQ) {
+    if(HAS_OUTPUT(core->opt, FREQ)) {
         db->freq_maps = (khash_t(freqm)**)(malloc(sizeof(khash_t(freqm)*) * db->cap_bam_recs));
         MALLOC_CHK(db->freq_maps);
-    } else if (core->opt.subtool == VIEW) {
+    }
+    if (HAS_OUTPUT(core->opt, VIEW) && core->opt.read_level) {
+        db->read_mods = (readmod_t**)(calloc(db->cap_bam_recs, sizeof(readmod_t*)));
+        MALLOC_CHK(db->read_mods);
+        db->n_read_mods = (int*)(calloc(db->cap_bam_recs, sizeof(int)));
+        MALLOC_CHK(db->n_read_mods);
+        db->cap_read_mods = (int*)(calloc(db->cap_bam_recs, sizeof(int)));
+        MALLOC_CHK(db->cap_read_mods);
+    } else if (HAS_OUTPUT(core->opt, VIEW)) {
         db->view_maps = (khash_t(viewm)**)(malloc(sizeof(khash_t(viewm)*) * db->cap_bam_recs));
         MALLOC_CHK(db->view_maps);
-    } else if (core->opt.subtool == SUMMARY) {
+    }
+    if (HAS_OUTPUT(core->opt, SUMMARY)) {
         db->summary_maps = (khash_t(summarym)**)(malloc(sizeof(khash_t(summarym)*) * db->cap_bam_recs));
         MALLOC_CHK(db->summary_maps);
+        if(core->opt.ml_hist) {
+            db->ml_counts = (mlcount_t*)(malloc(sizeof(mlcount_t) * db->cap_bam_recs * ML_HIST_READ_CODES));
+            MALLOC_CHK(db->ml_counts);
+            db->n_ml_counts = (int*)(calloc(db->cap_bam_recs, sizeof(int)));
+            MALLOC_CHK(db->n_ml_counts);
+            db->thread_hists = (modhist_t**)(calloc(core->opt.num_thread, sizeof(modhist_t*)));
+            MALLOC_CHK(db->thread_hists);
+            db->n_thread_hists = (int*)(calloc(core->opt.num_thread, sizeof(int)));
+            MALLOC_CHK(db->n_thread_hists);
+            db->cap_thread_hists = (int*)(calloc(core->opt.num_thread, sizeof(int)));
+            MALLOC_CHK(db->cap_thread_hists);
+            db->rec_threads = (int32_t*)(calloc(db->cap_bam_recs, sizeof(int32_t)));
+            MALLOC_CHK(db->rec_threads);
+        }
     }
 
     int32_t i = 0;
@@ -216,21 +454,254 @@ db_t* init_db(core_t* core) {
         db->bam_recs[i] = bam_init1();
         NULL_CHK(db->bam_recs[i]);
 
-        db->bases_pos[i] = (int**)malloc(sizeof(int*)*N_BASES);
-        MALLOC_CHK(db->bases_pos[i]);
-
         db->mod_codes[i] = (char*)malloc(sizeof(char)*(MOD_CODE_LEN));
         MALLOC_CHK(db->mod_codes[i]);
 
         db->mod_codes_cap[i] = MOD_CODE_LEN;
     }
 
-    db->means = (double*)calloc(db->cap_bam_recs,sizeof(double));
-    MALLOC_CHK(db->means);
+    db->prof = NULL;
+    if(core->prof) {
+        db->prof = (prof_stat_t*)calloc(db->cap_bam_recs,sizeof(prof_stat_t));
+        MALLOC_CHK(db->prof);
+    }
 
     return db;
 }
 
+#define BATCH_MEM_FACTOR 2 // bam records plus the per read segments and maps, roughly the records again
+#define BATCH_SLOT_BYTES 128 // bam1_t and the per read pointers of each slot in a batch
+#define FREQ_KEY_BYTES 48 // key string of a freq site with the malloc overhead
+#define MALLOC_OVERHEAD 16
+
+// bytes held by a loaded batch, an estimate
+static inline int64_t batch_mem(db_t* db) {
+    return db->processed_bytes * BATCH_MEM_FACTOR + (int64_t)db->cap_bam_recs * BATCH_SLOT_BYTES;
+}
+
+// bytes held by the freq table, an estimate: two pointers per bucket, the key and the counters of each site
+static int64_t freq_map_mem(core_t* core) {
+    khash_t(freqm) *map = core->freq_map;
+    int64_t freq_bytes = sizeof(freq_t) * freq_n_counts(core) + MALLOC_OVERHEAD;
+    return (int64_t)kh_n_buckets(map) * 2 * sizeof(void*) + (int64_t)kh_size(map) * (FREQ_KEY_BYTES + freq_bytes);
+}
+
+// call with mem_lock held
+static inline void update_mem_peak(core_t* core) {
+    int64_t total = core->mem_fixed + core->mem_map + core->mem_batches;
+    if (total > core->mem_peak) {
+        core->mem_peak = total;
+    }
+}
+
+void set_fixed_mem(core_t* core, int64_t bytes) {
+    core->mem_fixed = bytes;
+    if (core->opt.max_mem <= 0) {
+        return;
+    }
+    if (bytes >= core->opt.max_mem) {
+        WARNING("The reference and context masks need %.1fM, more than --max-mem %.1fM. Reads are loaded one batch at a time.", bytes/(1000.0*1000.0), core->opt.max_mem/(1000.0*1000.0));
+    } else {
+        INFO("Memory budget %.1fM, %.1fM for the reference and context masks", core->opt.max_mem/(1000.0*1000.0), bytes/(1000.0*1000.0));
+    }
+}
+
+/*
+ * Backpressure for --max-mem. Called by the loading thread before a batch is read: waits while a full batch
+ * does not fit next to the batch in flight, then returns the bytes limit of the new batch. Only the batch loaded
+ * last can be in flight here and it is freed by the post-processing thread without the loading thread's help,
+ * so the wait always ends.
+ */
+static int64_t wait_for_mem(core_t* core, int64_t max_bytes) {
+    double wait_start = realtime();
+    pthread_mutex_lock(&core->mem_lock);
+    while (core->mem_batches > 0 && core->mem_fixed + core->mem_map + core->mem_batches + max_bytes * BATCH_MEM_FACTOR > core->opt.max_mem) {
+        pthread_cond_wait(&core->mem_cond, &core->mem_lock);
+    }
+    int64_t avail = core->opt.max_mem - core->mem_fixed - core->mem_map - core->mem_batches;
+    pthread_mutex_unlock(&core->mem_lock);
+
+    double waited = realtime() - wait_start;
+    if (waited > 0.01) {
+        LOG_DEBUG("waited %.3f s for memory before loading a batch", waited);
+    }
+
+    int64_t bytes = avail / BATCH_MEM_FACTOR;
+    if (bytes < max_bytes) {
+        LOG_DEBUG("batch limited to %.1fM bytes by --max-mem", (bytes > 0 ? bytes : 0)/(1000.0*1000.0));
+        max_bytes = bytes > 0 ? bytes : 1; // at least one read, otherwise the batch would look like the end of the input
+    }
+    return max_bytes;
+}
+
+/*
+ * Account the freq table against --max-mem. If the total is over the budget and the table holds a good part of it,
+ * the table is spilled to a sorted run and emptied. Called by the thread merging into the table.
+ */
+void check_map_mem(core_t* core) {
+    if (core->opt.max_mem <= 0) {
+        return;
+    }
+
+    int64_t map = freq_map_mem(core);
+    pthread_mutex_lock(&core->mem_lock);
+    int64_t total = core->mem_fixed + map + core->mem_batches;
+    pthread_mutex_unlock(&core->mem_lock);
+
+    // a run is at least a quarter of what the reference leaves, and never tiny so that the runs stay few
+    int64_t min_run = (core->opt.max_mem - core->mem_fixed) / 4;
+    if (min_run < core->opt.max_mem / 64) {
+        min_run = core->opt.max_mem / 64;
+    }
+    if (total > core->opt.max_mem && map >= min_run) {
+        if (core->opt.per_sample || core->opt.dump_file) {
+            static int warned = 0;
+            if (!warned) {
+                WARNING("%s", "The freq table is over --max-mem but cannot be spilled with --per-sample or --dump, it keeps growing.");
+                warned = 1;
+            }
+        } else {
+            INFO("freq table of %ld sites (%.1fM) spilled to disk, total %.1fM over --max-mem %.1fM", (long)kh_size(core->freq_map), map/(1000.0*1000.0), total/(1000.0*1000.0), core->opt.max_mem/(1000.0*1000.0));
+            freqspill_write(core);
+            map = freq_map_mem(core);
+        }
+    }
+
+    pthread_mutex_lock(&core->mem_lock);
+    core->mem_map = map;
+    update_mem_peak(core);
+    pthread_cond_broadcast(&core->mem_cond);
+    pthread_mutex_unlock(&core->mem_lock);
+}
+
+static const char *skip_reason_names[N_SKIP_REASONS] = {"unmapped", "secondary", "supplementary", "zero length", "low MAPQ", "short", "no MM tag"};
+
+/* the reason a record is skipped on its flags, MAPQ and length alone, -1 if it is kept */
+static inline int skip_on_core(const opt_t* opt, uint16_t flag, uint8_t mapq, int32_t l_qseq) {
+    if (flag & BAM_FUNMAP) return SKIP_UNMAPPED;
+    if (!opt->allow_secondary && flag & BAM_FSECONDARY) return SKIP_SECONDARY;
+    if (opt->skip_supplementary && flag & BAM_FSUPPLEMENTARY) return SKIP_SUPPLEMENTARY;
+    if (l_qseq == 0) return SKIP_ZERO_LEN;
+    if (mapq < opt->min_mapq) return SKIP_MAPQ;
+    if (l_qseq < opt->min_length) return SKIP_SHORT;
+    return -1;
+}
+
+static inline int32_t le_to_i32(const uint8_t *p) {
+    return (int32_t)((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+#define BAM_CORE_SIZE 32 // fixed size part of a BAM record after its block_size
+
+/* skip the next record of a BAM input without reading it into a bam1_t when its core fields filter it out.
+ * the block_size and core are peeked in the current decompressed BGZF block. returns 1 if the record was skipped,
+ * 0 if it is left to sam_read1 (kept, not BAM, or its core is across two blocks) */
+static int peek_skip_bam(core_t* core, db_t* db) {
+    htsFile *hts = core->bam_fp;
+    if (hts->format.format != bam || !hts->is_bgzf) {
+        return 0;
+    }
+    BGZF *fp = hts->fp.bgzf;
+    int avail = fp->block_length - fp->block_offset;
+    if (avail < 4 + BAM_CORE_SIZE) {
+        return 0;
+    }
+    const uint8_t *p = (const uint8_t *)fp->uncompressed_block + fp->block_offset;
+    int32_t block_size = le_to_i32(p);
+    if (block_size < BAM_CORE_SIZE) { // truncated, sam_read1 reports it
+        return 0;
+    }
+    uint8_t l_read_name = p[4 + 8];
+    uint8_t mapq = p[4 + 9];
+    uint16_t flag = (uint16_t)(p[4 + 14] | p[4 + 15] << 8);
+    int32_t l_qseq = le_to_i32(p + 4 + 16);
+
+    int reason = skip_on_core(&core->opt, flag, mapq, l_qseq);
+    if (reason < 0) {
+        return 0;
+    }
+    LOG_TRACE("Skipping %s read %s", skip_reason_names[reason], 4 + BAM_CORE_SIZE + l_read_name <= avail ? (const char *)p + 4 + BAM_CORE_SIZE : "(name across BGZF blocks)");
+
+    int64_t n = 4 + (int64_t)block_size;
+    if (n < avail) { // consumed as bgzf_read does, without copying it out
+        fp->block_offset += n;
+        fp->uncompressed_address += n;
+    } else {
+        if (n > core->skip_buf_cap) {
+            core->skip_buf_cap = n;
+            core->skip_buf = (uint8_t *)realloc(core->skip_buf, core->skip_buf_cap);
+            MALLOC_CHK(core->skip_buf);
+        }
+        if (bgzf_read(fp, core->skip_buf, n) != n) {
+            ERROR("Truncated record in %s", core->opt.bam_files[core->bam_i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    db->total_reads++;
+    db->total_bytes += block_size - BAM_CORE_SIZE + (l_read_name % 4 ? 4 - l_read_name % 4 : 0); // l_data as sam_read1 sets it, the read name padded to 4 bytes
+    db->skipped[reason]++;
+    return 1;
+}
+
+/* the skipped reads by reason, printed at the end of a run */
+void print_skipped_reads(core_t* core, const char *func) {
+    fprintf(stderr, "\n[%s] skipped entries by reason:", func);
+    for (int r = 0; r < N_SKIP_REASONS; r++) {
+        fprintf(stderr, " %s %ld%s", skip_reason_names[r], (long)core->skipped[r], r + 1 < N_SKIP_REASONS ? "," : "");
+    }
+}
+
+/* locate the MM and ML tags of records [start, end) of a batch */
+static void decode_recs(db_t* db, int32_t start, int32_t end) {
+    for (int32_t i = start; i < end; i++) {
+        bam1_t *rec = db->bam_recs[i];
+        db->mm[i] = get_mm_tag_ptr(rec);
+        db->ml_lens[i] = 0;
+        db->ml[i] = db->mm[i] ? get_ml_tag(rec, &db->ml_lens[i]) : NULL;
+    }
+}
+
+typedef struct {
+    db_t* db;
+    int32_t start;
+    int32_t end;
+} decode_arg_t;
+
+static void* tpool_decode(void* voidargs) {
+    decode_arg_t* args = (decode_arg_t*)voidargs;
+    decode_recs(args->db, args->start, args->end);
+    return NULL;
+}
+
+/* decode the records [start, end) of a batch on the --io-threads pool and the calling thread. the tags of long reads
+ * are long, and walking past them and copying out ML is most of the loading time once decompression is threaded */
+static void decode_db(core_t* core, db_t* db, int32_t start, int32_t end) {
+    int32_t n_jobs = core->n_io_threads + 1;
+    if (end - start < DECODE_MIN_RECS * n_jobs) {
+        n_jobs = (end - start) / DECODE_MIN_RECS;
+    }
+    if (n_jobs <= 1 || core->decode_queue == NULL) {
+        decode_recs(db, start, end);
+        return;
+    }
+
+    decode_arg_t args[n_jobs];
+    int32_t step = (end - start + n_jobs - 1) / n_jobs;
+    for (int32_t j = 0; j < n_jobs; j++) {
+        args[j].db = db;
+        args[j].start = start + j * step < end ? start + j * step : end;
+        args[j].end = args[j].start + step < end ? args[j].start + step : end;
+    }
+    for (int32_t j = 1; j < n_jobs; j++) { // the first range is decoded here while the pool takes the others
+        int ret = hts_tpool_dispatch(core->hts_pool, core->decode_queue, tpool_decode, &args[j]);
+        NEG_CHK(ret);
+    }
+    decode_recs(db, args[0].start, args[0].end);
+    int ret = hts_tpool_process_flush(core->decode_queue); // all ranges done, args can go out of scope
+    NEG_CHK(ret);
+}
+
 /* load a data batch from disk */
 ret_status_t load_db(core_t* core, db_t* db) {
 
@@ -239,103 +710,134 @@ ret_status_t load_db(core_t* core, db_t* db) {
     // unset previous counts
     db->n_bam_recs = 0;
     db->processed_bytes = 0;
+    db->processed_bases = 0;
     db->total_reads = 0;
     db->total_bytes = 0;
+    memset(db->skipped, 0, sizeof(db->skipped));
+
+    // limits set by adapt_batch take effect here, the caller compares the status against the limits of this load
+    core->batch_size = core->next_batch_size < db->cap_bam_recs ? core->next_batch_size : db->cap_bam_recs;
+    core->batch_size_bases = core->next_batch_size_bases;
+    if (core->opt.max_mem > 0) {
+        core->batch_size_bases = wait_for_mem(core, core->batch_size_bases);
+    }
 
     ret_status_t status = {0, 0};
     int32_t i;
     bam1_t* rec;
 
-    while (db->n_bam_recs < db->cap_bam_recs && db->processed_bytes < core->opt.batch_size_bases) {
-        if (sam_read1(core->bam_fp, core->bam_hdr, db->bam_recs[db->n_bam_recs]) < 0) {
-            break;
-        }
-        
-        i = db->n_bam_recs;
-        rec = db->bam_recs[i];
-
-        db->total_reads++;
-        db->total_bytes += rec->l_data;
-        
-        if(rec->core.flag & BAM_FUNMAP){
-            LOG_TRACE("Skipping unmapped read %s",bam_get_qname(rec));
-            continue;
-        }
+    // records are read and filtered on their flags here, their tags are located by the decode threads.
+    // records without an MM tag are only known after decoding, reading continues until they are made up for
+    int eof = 0;
+    while (!eof) {
+        int32_t start = db->n_bam_recs;
+        int32_t n = start;
+        int64_t bytes = db->processed_bytes;
+        while (n < core->batch_size && bytes < core->batch_size_bases) {
+            if (peek_skip_bam(core, db)) {
+                continue;
+            }
+            if (sam_read1(core->bam_fp, core->bam_hdr, db->bam_recs[n]) < 0) {
+                if(core->bam_i + 1 < core->n_bams){ // continue with the next input file in the same batch
+                    core->bam_i++;
+                    core->bam_fp = core->bam_fps[core->bam_i];
+                    core->bam_hdr = core->bam_hdrs[core->bam_i];
+                    continue;
+                }
+                eof = 1;
+                break;
+            }
 
-        if(!core->opt.allow_secondary && rec->core.flag & BAM_FSECONDARY){
-            LOG_TRACE("Skipping secondary alignment read %s",bam_get_qname(rec));
-            continue;
-        }
+            rec = db->bam_recs[n];
 
-        if(core->opt.skip_supplementary && rec->core.flag & BAM_FSUPPLEMENTARY){
-            LOG_TRACE("Skipping supplementary alignment read %s",bam_get_qname(rec));
-            continue;
-        }
+            db->total_reads++;
+            db->total_bytes += rec->l_data;
 
-        if(rec->core.l_qseq == 0){
-            LOG_TRACE("Skipping read with 0 length %s",bam_get_qname(rec));
-            continue;
-        }
+            int reason = skip_on_core(&core->opt, rec->core.flag, rec->core.qual, rec->core.l_qseq);
+            if (reason >= 0) {
+                LOG_TRACE("Skipping %s read %s", skip_reason_names[reason], bam_get_qname(rec));
+                db->skipped[reason]++;
+                continue;
+            }
 
-        const char *mm = get_mm_tag_ptr(rec);
-        if (!mm) {
-            LOG_TRACE("Skipping read %s with empty MM tag", bam_get_qname(rec));
-            continue;
+            db->bam_idx[n] = core->bam_i;
+            bytes += rec->l_data;
+            n++;
         }
 
-        uint32_t ml_len;
-        uint8_t *ml = get_ml_tag(rec, &ml_len);
-        // if (!ml) {
-        //     continue;
-        // }
-
-        db->aln[i] = (int*)malloc(sizeof(int)*rec->core.l_qseq);
-        MALLOC_CHK(db->aln[i]);
+        decode_db(core, db, start, n);
 
-        if(core->opt.insertions) {
-            db->ins[i] = (int*)malloc(sizeof(int)*rec->core.l_qseq);
-            MALLOC_CHK(db->ins[i]);
-            db->ins_offset[i] = (int*)malloc(sizeof(int)*rec->core.l_qseq);
-            MALLOC_CHK(db->ins_offset[i]);
-        }
-        
-
-        for(int j=0;j<N_BASES;j++){
-            db->bases_pos[i][j] = (int*)malloc(sizeof(int)*rec->core.l_qseq);
-            MALLOC_CHK(db->bases_pos[i][j]);
-        }
+        // keep the decoded records with an MM tag in order, a skipped record is swapped to the back for reuse
+        for (int32_t j = start; j < n; j++) {
+            if (!db->mm[j]) {
+                LOG_TRACE("Skipping read %s with empty MM tag", bam_get_qname(db->bam_recs[j]));
+                db->skipped[SKIP_NO_MM]++;
+                continue;
+            }
+            i = db->n_bam_recs;
+            if (i != j) {
+                rec = db->bam_recs[i];
+                db->bam_recs[i] = db->bam_recs[j];
+                db->bam_recs[j] = rec;
+                db->bam_idx[i] = db->bam_idx[j];
+                db->mm[i] = db->mm[j];
+                db->ml_lens[i] = db->ml_lens[j];
+                db->ml[i] = db->ml[j];
+                db->ml[j] = NULL;
+            }
+            rec = db->bam_recs[i];
 
-        db->skip_counts[i] = (int*)malloc(sizeof(int)*rec->core.l_qseq);
-        MALLOC_CHK(db->skip_counts[i]);
+            // at most one segment per CIGAR operation
+            db->aln_segs[i] = (aln_seg_t*)malloc(sizeof(aln_seg_t)*(rec->core.n_cigar > 0 ? rec->core.n_cigar : 1));
+            MALLOC_CHK(db->aln_segs[i]);
+            db->n_aln_segs[i] = 0;
 
-        db->mm[i] = mm;
-        db->ml_lens[i] = ml_len;
-        db->ml[i] = ml;
+            if(HAS_OUTPUT(core->opt, FREQ)) {
+                db->freq_maps[i] = kh_init(freqm);
+            }
+            if (HAS_OUTPUT(core->opt, VIEW) && core->opt.read_level) {
+                db->n_read_mods[i] = 0;
+            } else if (HAS_OUTPUT(core->opt, VIEW)) {
+                db->view_maps[i] = kh_init(viewm);
+            }
+            if (HAS_OUTPUT(core->opt, SUMMARY) && core->opt.ml_hist) {
+                db->n_ml_counts[i] = 0;
+            } else if (HAS_OUTPUT(core->opt, SUMMARY)) {
+                db->summary_maps[i] = kh_init(summarym);
+            }
 
-        if(core->opt.subtool == FREQ) {
-            db->freq_maps[i] = kh_init(freqm);
-        } else if (core->opt.subtool == VIEW) {
-            db->view_maps[i] = kh_init(viewm);
-        } else if (core->opt.subtool == SUMMARY) {
-            db->summary_maps[i] = kh_init(summarym);
+            db->n_bam_recs++;
+            db->processed_bytes += rec->l_data;
+            db->processed_bases += rec->core.l_qseq;
         }
 
-        db->n_bam_recs++;
-        db->processed_bytes += rec->l_data;
+        if (db->n_bam_recs == n) { // none skipped, the batch is full or the input has ended
+            break;
+        }
     }
 
     status.num_reads = db->n_bam_recs;
     status.num_bases = db->processed_bytes;
 
-    core->load_db_time += realtime() - load_start;
+    if (core->opt.max_mem > 0) {
+        db->mem = batch_mem(db);
+        pthread_mutex_lock(&core->mem_lock);
+        core->mem_batches += db->mem;
+        update_mem_peak(core);
+        pthread_mutex_unlock(&core->mem_lock);
+    }
+
+    db->load_time = realtime() - load_start;
+    core->load_db_time += db->load_time;
 
     return status;
 }
 
 void work_per_single_read(core_t* core,db_t* db, int32_t i){
-    if(core->opt.subtool == VIEW || core->opt.subtool == FREQ) {
+    if(HAS_OUTPUT(core->opt, VIEW) || HAS_OUTPUT(core->opt, FREQ)) {
         freq_view_single(core, db, i);
-    } else if (core->opt.subtool == SUMMARY) {
+    }
+    if (HAS_OUTPUT(core->opt, SUMMARY)) { // with multi, the same decoded record is walked for both
         summary_single(core, db, i);
     }
     
@@ -346,10 +848,85 @@ void process_db(core_t* core,db_t* db){
 
     work_db(core, db, work_per_single_read);
 
-    core->process_db_time += (realtime()-proc_start);
+    db->process_time = realtime()-proc_start;
+    core->process_db_time += db->process_time;
+    if(core->prof) {
+        core->prof->batches++;
+    }
 }
 
 
+/* keep the counts and timers of a finished batch for adapt_batch, the batch itself is freed right after */
+static void set_last_batch(core_t* core, db_t* db) {
+    core->last_reads = db->n_bam_recs;
+    core->last_bytes = db->processed_bytes;
+    core->last_load_time = db->load_time;
+    core->last_process_time = db->process_time;
+    core->last_output_time = db->output_time;
+}
+
+#define ADAPT_MIN_PROC_TIME 0.5 // seconds, shorter batches spend too much on thread startup and the slowest read
+#define ADAPT_MAX_PROC_TIME 5.0 // seconds, longer batches only hold more memory
+#define ADAPT_BATCHES_IN_FLIGHT 2 // one loading, the one before it processing then merging or printing
+#define ADAPT_MIN_BYTES (1000*1000)
+#define ADAPT_MAX_READS (1<<20)
+
+/*
+ * Tune the limits of the next batch from the last finished batch. The loop is load || process || merge/output, so
+ * the workers are saturated when processing is the slowest stage. The limits are doubled while processing a batch
+ * takes less than ADAPT_MIN_PROC_TIME and halved above ADAPT_MAX_PROC_TIME, left alone when loading or merging is
+ * the slowest stage, and the bytes limit is kept so that the batches in flight stay under the memory cap.
+ * Called by the main thread once the batch has been merged or printed, the new limits apply from the next load.
+ */
+void adapt_batch(core_t* core) {
+    if (core->opt.adaptive_batch <= 0 || core->last_reads == 0) {
+        return;
+    }
+
+    int32_t reads = core->next_batch_size;
+    int64_t bytes = core->next_batch_size_bases;
+    double proc = core->last_process_time;
+    double io = core->last_load_time > core->last_output_time ? core->last_load_time : core->last_output_time;
+    const char *reason = NULL;
+
+    int64_t max_bytes = core->opt.adaptive_batch / (ADAPT_BATCHES_IN_FLIGHT * BATCH_MEM_FACTOR);
+    long rss = peakrss();
+    if (rss > core->opt.adaptive_batch && rss > core->adapt_rss) { // the estimate was too low, back off
+        core->adapt_rss = rss;
+        reads /= 2;
+        bytes /= 2;
+        reason = "peak memory over the cap";
+    } else if (proc < io) {
+        LOG_DEBUG("batch of %d reads: load %.3f s, process %.3f s, merge/output %.3f s, limited by I/O", core->last_reads, core->last_load_time, proc, core->last_output_time);
+    } else if (proc < ADAPT_MIN_PROC_TIME) {
+        reads *= 2;
+        bytes *= 2;
+        reason = "short batches";
+    } else if (proc > ADAPT_MAX_PROC_TIME) {
+        reads /= 2;
+        bytes /= 2;
+        reason = "long batches";
+    }
+
+    if (bytes > max_bytes) {
+        bytes = max_bytes;
+        if (reason == NULL) {
+            reason = "memory cap";
+        }
+    }
+    if (bytes < ADAPT_MIN_BYTES) bytes = ADAPT_MIN_BYTES;
+    if (reads > ADAPT_MAX_READS) reads = ADAPT_MAX_READS;
+    if (reads < core->opt.num_thread) reads = core->opt.num_thread;
+
+    if (reads != core->next_batch_size || bytes != core->next_batch_size_bases) {
+        INFO("batch size %d -> %d reads, %.1fM -> %.1fM bytes (%s: load %.3f s, process %.3f s, merge/output %.3f s)",
+            core->next_batch_size, reads, core->next_batch_size_bases/(1000.0*1000.0), bytes/(1000.0*1000.0), reason ? reason : "limits",
+            core->last_load_time, proc, core->last_output_time);
+        core->next_batch_size = reads;
+        core->next_batch_size_bases = bytes;
+    }
+}
+
 /* write the output for a processed data batch */
 void output_db(core_t* core, db_t* db) {
 
@@ -365,8 +942,14 @@ void output_db(core_t* core, db_t* db) {
     core->total_bytes += db->total_bytes;
     core->processed_reads += db->n_bam_recs;
     core->processed_bytes += db->processed_bytes;
+    core->processed_bases += db->processed_bases;
+    for (int r = 0; r < N_SKIP_REASONS; r++) {
+        core->skipped[r] += db->skipped[r];
+    }
 
-    core->output_time += (realtime()-output_start);
+    db->output_time = realtime()-output_start;
+    core->output_time += db->output_time;
+    set_last_batch(core, db);
 
 }
 
@@ -375,20 +958,94 @@ void merge_db(core_t* core, db_t* db) {
     double merge_start = realtime();
 
     merge_freq_maps(core, db);
+    check_map_mem(core);
+
+    core->total_reads += db->total_reads;
+    core->total_bytes += db->total_bytes;
+    core->processed_reads += db->n_bam_recs;
+    core->processed_bytes += db->processed_bytes;
+    core->processed_bases += db->processed_bases;
+    for (int r = 0; r < N_SKIP_REASONS; r++) {
+        core->skipped[r] += db->skipped[r];
+    }
+
+    db->output_time = realtime()-merge_start;
+    core->merge_db_time += db->output_time;
+    set_last_batch(core, db);
+
+}
+
+typedef struct {
+    core_t* core;
+    db_t* db;
+    int subtool; // the output this thread writes or merges
+} sink_arg_t;
+
+static void* sink_thread(void* voidargs) {
+    sink_arg_t* args = (sink_arg_t*)voidargs;
+    if (args->subtool == FREQ) {
+        merge_freq_maps(args->core, args->db);
+        check_map_mem(args->core);
+    } else if (args->subtool == VIEW) {
+        print_view_output(args->core, args->db);
+    } else {
+        print_summary_output(args->core, args->db);
+    }
+    pthread_exit(0);
+}
+
+/* merge or write a processed batch into each output of multi, one thread per output. the outputs only read the batch
+ * and each touches its own per record maps, output file and (for freq) the site table */
+void sink_db(core_t* core, db_t* db) {
+
+    double sink_start = realtime();
+
+    pthread_t tids[3];
+    sink_arg_t args[3];
+    int n_sinks = 0;
+    for (int s = VIEW; s <= SUMMARY; s++) {
+        if (!HAS_OUTPUT(core->opt, s)) continue;
+        args[n_sinks].core = core;
+        args[n_sinks].db = db;
+        args[n_sinks].subtool = s;
+        int ret = pthread_create(&tids[n_sinks], NULL, sink_thread, (void*)(&args[n_sinks]));
+        NEG_CHK(ret);
+        n_sinks++;
+    }
+    for (int i = 0; i < n_sinks; i++) {
+        int ret = pthread_join(tids[i], NULL);
+        NEG_CHK(ret);
+    }
 
     core->total_reads += db->total_reads;
     core->total_bytes += db->total_bytes;
     core->processed_reads += db->n_bam_recs;
     core->processed_bytes += db->processed_bytes;
+    core->processed_bases += db->processed_bases;
+    for (int r = 0; r < N_SKIP_REASONS; r++) {
+        core->skipped[r] += db->skipped[r];
+    }
 
-    core->merge_db_time += (realtime()-merge_start);
+    db->output_time = realtime()-sink_start;
+    core->output_time += db->output_time;
+    set_last_batch(core, db);
 
 }
 
 void output_core(core_t* core) {
 
-    if(core->opt.subtool == FREQ){
-        print_freq_output(core);
+    if(HAS_OUTPUT(core->opt, FREQ)){
+        if(core->opt.dump_file){ // before printing, which consumes the keys
+            freqdump_hdr_t hdr;
+            freqdump_hdr_from_opt(&hdr, &core->opt);
+            freqdump_write(core->opt.dump_file, core->freq_map, &hdr, NULL);
+            freqdump_hdr_destroy(&hdr);
+        }
+        if(core->n_spills > 0){ // the table was spilled under --max-mem
+            freqspill_print(core);
+        } else {
+            print_freq_output(core);
+        }
     }
 
 }
@@ -398,18 +1055,10 @@ void free_db_tmp(core_t* core, db_t* db) {
     int32_t i = 0;
     for (i = 0; i < db->n_bam_recs; i++) {        
         free(db->ml[i]);
-        free(db->aln[i]);
-        if(core->opt.insertions) {
-            free(db->ins[i]);
-            free(db->ins_offset[i]);
-        }
-
-        for(int b=0;b<N_BASES;b++){
-            free(db->bases_pos[i][b]);
-        }
+        free(db->aln_segs[i]);
 
         // destroy freq map except key
-        if(core->opt.subtool == FREQ) {
+        if(HAS_OUTPUT(core->opt, FREQ)) {
             for (khiter_t k = kh_begin(db->freq_map[i]); k != kh_end(db->freq_maps[i]); ++k) {
                 if (kh_exist(db->freq_maps[i], k)) {
                     char *key = (char*) kh_key(db->freq_maps[i], k);
@@ -419,7 +1068,8 @@ void free_db_tmp(core_t* core, db_t* db) {
                 }
             }
             kh_destroy(freqm, db->freq_maps[i]);
-        } else if (core->opt.subtool == VIEW) {
+        }
+        if (HAS_OUTPUT(core->opt, VIEW) && !core->opt.read_level) {
             for (khiter_t k = kh_begin(db->view_map[i]); k != kh_end(db->view_maps[i]); ++k) {
                 if (kh_exist(db->view_maps[i], k)) {
                     view_t *view = kh_value(db->view_maps[i], k);
@@ -429,7 +1079,8 @@ void free_db_tmp(core_t* core, db_t* db) {
                 }
             }
             kh_destroy(viewm, db->view_maps[i]);
-        } else if (core->opt.subtool == SUMMARY) {
+        }
+        if (HAS_OUTPUT(core->opt, SUMMARY) && !core->opt.ml_hist) {
             for (khiter_t k = kh_begin(db->summary_map[i]); k != kh_end(db->summary_maps[i]); ++k) {
                 if (kh_exist(db->summary_maps[i], k)) {
                     char * key = (char*) kh_key(db->summary_maps[i], k);
@@ -439,8 +1090,14 @@ void free_db_tmp(core_t* core, db_t* db) {
             kh_destroy(summarym, db->summary_maps[i]);
         }
 
-        free(db->skip_counts[i]);
+    }
 
+    if (db->mem > 0) { // the batch no longer counts against --max-mem
+        pthread_mutex_lock(&core->mem_lock);
+        core->mem_batches -= db->mem;
+        pthread_cond_broadcast(&core->mem_cond);
+        pthread_mutex_unlock(&core->mem_lock);
+        db->mem = 0;
     }
 }
 
@@ -452,32 +1109,48 @@ void free_db(core_t* core, db_t* db) {
     // free the rest of the records
     for (i = 0; i < db->cap_bam_recs; i++) {
         free(db->mod_codes[i]);
-        free(db->bases_pos[i]);
         bam_destroy1(db->bam_recs[i]);
     }
 
-    if(core->opt.subtool == FREQ) {
+    if(HAS_OUTPUT(core->opt, FREQ)) {
         free(db->freq_maps);
-    } else if (core->opt.subtool == VIEW) {
+    }
+    if (HAS_OUTPUT(core->opt, VIEW) && core->opt.read_level) {
+        for (i = 0; i < db->cap_bam_recs; i++) {
+            free(db->read_mods[i]);
+        }
+        free(db->read_mods);
+        free(db->n_read_mods);
+        free(db->cap_read_mods);
+    } else if (HAS_OUTPUT(core->opt, VIEW)) {
         free(db->view_maps);
-    } else if (core->opt.subtool == SUMMARY) {
+    }
+    if (HAS_OUTPUT(core->opt, SUMMARY)) {
         free(db->summary_maps);
+        if(core->opt.ml_hist) {
+            for (i = 0; i < core->opt.num_thread; i++) {
+                free(db->thread_hists[i]);
+            }
+            free(db->ml_counts);
+            free(db->n_ml_counts);
+            free(db->thread_hists);
+            free(db->n_thread_hists);
+            free(db->cap_thread_hists);
+            free(db->rec_threads);
+        }
     }
 
-    free(db->skip_counts);
     free(db->mod_codes);
     free(db->mod_codes_cap);
-    free(db->bases_pos);
     free(db->ml_lens);
     free(db->mm);
     free(db->ml);
-    free(db->aln);
-    if(core->opt.insertions) {
-        free(db->ins);
-        free(db->ins_offset);
-    }
+    free(db->bam_idx);
+    free(db->hps);
+    free(db->aln_segs);
+    free(db->n_aln_segs);
     free(db->bam_recs);
-    free(db->means);
+    free(db->prof);
     free(db);
 }
 
@@ -487,6 +1160,9 @@ void init_opt(opt_t* opt) {
     opt->batch_size = 512;
     opt->batch_size_bases = 20*1000*1000;
     opt->num_thread = 8;
+    opt->io_threads = -1; // a quarter of num_thread
+    opt->min_mapq = 0;
+    opt->min_length = 0;
 
     opt->debug_break=-1;
 
@@ -494,6 +1170,8 @@ void init_opt(opt_t* opt) {
     opt->progress_interval = 0;
     opt->output_file = NULL;
     opt->bam_file = NULL;
+    opt->bam_files = NULL;
+    opt->n_bams = 0;
     opt->ref_file = NULL;
     opt->mod_codes_str = NULL;
     opt->mod_threshes_str = NULL;
@@ -503,6 +1181,18 @@ void init_opt(opt_t* opt) {
     opt->allow_secondary = 0;
     opt->alt_alleles = 0;
     opt->skip_supplementary = 0;
+    opt->binary_out = 0;
+    opt->ml_hist = 0;
+    opt->ml_hist_file = NULL;
+    opt->ml_hist_fp = NULL;
+    opt->ml_thresh = 0.8;
+    opt->per_sample = 0;
+    opt->dump_file = NULL;
+    opt->checkpoint_files = NULL;
+    opt->n_checkpoints = 0;
+    opt->adaptive_batch = 0;
+    opt->max_mem = 0;
+    opt->profile_file = NULL;
 
     opt->modcodes_map = kh_init(modcodesm);
 
@@ -512,9 +1202,67 @@ void init_opt(opt_t* opt) {
 
 }
 
+static void add_bam_file(opt_t* opt, const char* file, int32_t *cap) {
+    if (strcmp(file, "-") == 0) { // stdin, can only be read once
+        for (int32_t i = 0; i < opt->n_bams; i++) {
+            if (strcmp(opt->bam_files[i], "-") == 0) {
+                ERROR("%s", "stdin (-) can only be given once as input");
+                exit(EXIT_FAILURE);
+            }
+        }
+    } else if (access(file, F_OK) == -1) {
+        ERROR("BAM file %s does not exist", file);
+        exit(EXIT_FAILURE);
+    }
+    if (opt->n_bams == *cap) {
+        *cap = *cap ? *cap * 2 : 16;
+        opt->bam_files = (char**)realloc(opt->bam_files, sizeof(char*) * (*cap));
+        MALLOC_CHK(opt->bam_files);
+    }
+    size_t len = strlen(file);
+    opt->bam_files[opt->n_bams] = (char*)malloc(len + 1);
+    MALLOC_CHK(opt->bam_files[opt->n_bams]);
+    memcpy(opt->bam_files[opt->n_bams], file, len + 1);
+    opt->n_bams++;
+}
+
+/* set the input files from the command line and an optional file of file names (one per line, # for comments) */
+void set_bam_files(opt_t* opt, char** files, int32_t n_files, const char* bam_list_file) {
+    int32_t cap = 0;
+    for (int32_t i = 0; i < n_files; i++) {
+        add_bam_file(opt, files[i], &cap);
+    }
+
+    if (bam_list_file != NULL) {
+        FILE *fp = fopen(bam_list_file, "r");
+        F_CHK(fp, bam_list_file);
+        char line[4096];
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            size_t len = strlen(line);
+            while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r' || line[len-1] == ' ' || line[len-1] == '\t')) {
+                line[--len] = '\0';
+            }
+            if (len == 0 || line[0] == '#') continue;
+            add_bam_file(opt, line, &cap);
+        }
+        fclose(fp);
+    }
+
+    if (opt->n_bams == 0) {
+        ERROR("%s", "No BAM files given");
+        exit(EXIT_FAILURE);
+    }
+    opt->bam_file = opt->bam_files[0];
+}
+
 /* free user specified options */
 void free_opt(opt_t* opt) {
     free(opt->mod_threshes_str);
+    for (int32_t b = 0; b < opt->n_bams; b++) {
+        free(opt->bam_files[b]);
+    }
+    free(opt->bam_files);
+    free(opt->checkpoint_files);
     khint_t i;
     for (i = kh_begin(opt->modcodes_map); i < kh_end(opt->modcodes_map); ++i) {
         if (kh_exist(opt->modcodes_map, i)) {
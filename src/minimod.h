@@ -38,6 +38,7 @@ SOFTWARE.
 #include <stdlib.h>
 #include <htslib/hts.h>
 #include <htslib/sam.h>
+#include <htslib/thread_pool.h>
 #include "khash.h"
 #include <pthread.h>
 #ifndef MINIMOD_VERSION
@@ -49,12 +50,14 @@ SOFTWARE.
 
 #define WORK_STEAL 1 //simple work stealing enabled or not (no work stealing mean no load balancing)
 #define STEAL_THRESH 1 //stealing threshold
+#define DECODE_MIN_RECS 64 // fewest records given to a decode job of load_db
 
 //set if input, processing and output are not to be interleaved (serial mode) - useful for debugging
 // #define IO_PROC_NO_INTERLEAVE 1
 
 #define  MOD_CODE_LEN 10 // maximum length of modification codes string
 #define N_BASES 6 // A, C, G, T, N, U
+#define THRESH_UINT8_TO_DBL(x) ((double)( (x + 0.5) / 256.0 )) // convert uint8 threshold to double with 0.5/256 added for proper rounding
 
 /* input modification code structure */
 typedef struct {
@@ -66,17 +69,76 @@ typedef struct {
 /* map of required modification codes to their contexts and thresholds */
 KHASH_MAP_INIT_STR(modcodesm, modcodem_t *);
 
+/* a read consuming CIGAR operation, in the read order (reversed CIGAR for reverse strand reads) */
+typedef struct {
+    int32_t read_start; //first read position of the segment
+    int32_t ref_start; //reference position at read_start (walking in the read order)
+    int32_t len; //length of the segment
+    int32_t op; //BAM_CMATCH, BAM_CINS or BAM_CSOFT_CLIP
+} aln_seg_t;
+
 /* frequency map entry */
 typedef struct {
     uint32_t n_called;
     uint32_t n_mod;
 } freq_t;
 
+/* with --haplotypes, a site holds the counts of HP 0, 1 and 2 and of all haplotypes, each for every sample */
+#define FREQ_HP_SLOTS 4
+#define FREQ_HP_ALL 3
+
+// counter slot of a haplotype, -1 for HP values that are only counted in the all haplotypes slot
+static inline int freq_hp_slot(int haplotype) {
+    if (haplotype == -1) return FREQ_HP_ALL;
+    return (haplotype >= 0 && haplotype < FREQ_HP_ALL) ? haplotype : -1;
+}
+
+// haplotype order of the rows of a site: HP values ascending, then the all haplotypes row (-1) last
+static inline int cmp_haplotype(int a, int b) {
+    if (a == b) return 0;
+    if (a == -1) return 1;
+    if (b == -1) return -1;
+    return a < b ? -1 : 1;
+}
+
 typedef struct {
     uint8_t mod_prob; //modification probability (0-255)
     int read_pos; //read position of the base
 } view_t;
 
+#define ML_HIST_BINS 256 // one bin per raw ML value
+
+/* ML value histogram of a modification code, only for summary --ml-hist */
+typedef struct {
+    char mod_base;
+    char mod_code[MOD_CODE_LEN+1];
+    uint32_t n_reads; //number of reads carrying the code
+    uint64_t n_sites; //number of ML values
+    uint64_t n_called; //ML values passing the threshold either way
+    uint64_t n_mod; //ML values above the threshold
+    uint64_t hist[ML_HIST_BINS];
+} modhist_t;
+
+#define ML_HIST_READ_CODES 16 // most modification codes of a read counted by summary --ml-hist
+
+/* ML counts of a modification code in one read, only for summary --ml-hist */
+typedef struct {
+    char mod_base;
+    char mod_code[MOD_CODE_LEN+1];
+    uint32_t n_sites;
+    uint32_t n_called;
+    uint32_t n_mod;
+} mlcount_t;
+
+/* modification calls of a read and a modification code, only for view --read-level */
+typedef struct {
+    char mod_code[MOD_CODE_LEN+1];
+    uint32_t n_sites; //number of sites in the context
+    uint32_t n_called; //sites passing the threshold either way
+    uint32_t n_mod; //sites called as modified
+    double prob_sum; //sum of the modification probabilities of all sites
+} readmod_t;
+
 /* frequency map */
 KHASH_MAP_INIT_STR(freqm, freq_t *);
 
@@ -86,7 +148,13 @@ KHASH_MAP_INIT_STR(viewm, view_t *);
 /* summary map */
 KHASH_MAP_INIT_STR(summarym, int);
 
-enum subtool {VIEW=0, FREQ=1, SUMMARY=2};
+enum subtool {VIEW=0, FREQ=1, SUMMARY=2, MULTI=3};
+
+/* whether the output of a subtool (VIEW, FREQ or SUMMARY) is made, by itself or as one of the outputs of multi */
+#define HAS_OUTPUT(opt, s) ((opt).subtool == (s) || ((opt).subtool == MULTI && ((opt).outputs & (1 << (s)))))
+
+/* why load_db skipped a record, counted per batch and in total */
+enum skip_reason {SKIP_UNMAPPED=0, SKIP_SECONDARY=1, SKIP_SUPPLEMENTARY=2, SKIP_ZERO_LEN=3, SKIP_MAPQ=4, SKIP_SHORT=5, SKIP_NO_MM=6, N_SKIP_REASONS=7};
 
 /* user specified options */
 typedef struct {
@@ -95,6 +163,9 @@ typedef struct {
     int64_t batch_size_bases;   //max bytes loaded at once: B
 
     int32_t num_thread; //t
+    int32_t io_threads; // BAM decompression and decode threads, -1 for a quarter of num_thread
+    int32_t min_mapq; // records with a lower MAPQ are skipped
+    int32_t min_length; // reads with fewer bases are skipped
     int32_t debug_break;
 
     // char *region_str; //the region string in format chr:start-end
@@ -103,13 +174,17 @@ typedef struct {
     char *mod_codes_str;
     char *mod_threshes_str;
     khash_t(modcodesm) *modcodes_map;
-    char * bam_file;
+    char * bam_file; //first input file
+    char ** bam_files; //all input files
+    int32_t n_bams;
     char * ref_file;
     char* output_file;
     FILE* output_fp;
     int progress_interval;
 
-    uint8_t subtool; //0:view, 1:freq, 2:summary
+    uint8_t subtool; //0:view, 1:freq, 2:summary, 3:multi
+    uint8_t outputs; // bit (1 << subtool) per output made by multi
+    FILE* sink_fps[3]; // output file of view, freq and summary in multi, output_fp if NULL
 
     uint8_t n_mods;
     uint8_t insertions; //is insertions enabled, add ins column to the output
@@ -117,9 +192,31 @@ typedef struct {
     uint8_t allow_secondary; //is secondary alignments enabled, process secondary alignments in the bam file
     uint8_t alt_alleles; // whether to require the read base to match the reference base
     uint8_t skip_supplementary; // whether to skip supplementary alignments
+    uint8_t binary_out; // write view output in the binary columnar format, only for view
+    uint8_t ml_hist; // output per read ML statistics and a run level ML histogram, only for summary
+    char* ml_hist_file;
+    FILE* ml_hist_fp;
+    double ml_thresh; // threshold used for the called fraction in ml_hist mode
+    uint8_t read_level; // one row per read and mod code instead of one per site, only for view
+    uint8_t per_sample; // per input file counts in freq, sample column in view
+    char* dump_file; // write the freq site table to a checkpoint, only for freq
+    char** checkpoint_files; // checkpoints summed into freq
+    int32_t n_checkpoints;
+    int64_t adaptive_batch; // memory cap in bytes when -K and -B are tuned at runtime, 0 keeps them fixed
+    int64_t max_mem; // memory budget in bytes, loading waits and the freq table spills when it is reached. 0: no budget
+    char* profile_file; // write a per thread and per stage profile here at the end, only for view and freq
+    int64_t bin_size; // sum the sites into windows of this many bases instead of printing them, only for freq. 0: per site
+    char* regions_file; // sum the sites into the intervals of this BED file, only for freq
 
 } opt_t;
 
+static inline FILE *sink_fp(const opt_t *opt, int subtool) {
+    return opt->sink_fps[subtool] ? opt->sink_fps[subtool] : opt->output_fp;
+}
+
+
+typedef struct prof_stat_s prof_stat_t;
+typedef struct profile_s profile_t;
 
 /* a batch of read data (dynamic data based on the reads) */
 typedef struct {
@@ -134,28 +231,49 @@ typedef struct {
     uint8_t ** ml;
 
     // alignment
-    int ** aln; // aln[rec_i][read_pos] = ref_pos
-    int ** ins; // ins[rec_i][read_pos] = ins_pos
-    int ** ins_offset; // ins_offset[rec_i][read_pos] = ins_offset
-    int *** bases_pos; // bases_pos[rec_i][base_i] = read_pos
-    int ** skip_counts; // skip_counts[rec_i][read_pos] = skip_count
+    int32_t * bam_idx; // bam_idx[rec_i] = index of the input file the record came from
+    uint8_t * hps; // hps[rec_i] = HP tag of the record, only with --haplotypes
+
+    aln_seg_t ** aln_segs; // aln_segs[rec_i][seg_i] = read consuming CIGAR segment
+    int * n_aln_segs; // n_aln_segs[rec_i] = number of segments
     char ** mod_codes; // mod_codes[rec_i][mod_i] = mod_code
     uint8_t * mod_codes_cap; // mod_codes_cap[rec_i] = mod_codes_cap
 
-    double *means;
-
     //stats
     int32_t total_reads; //number of reads in the bam file
     int64_t total_bytes; //number of bytes in the bam file
     int64_t processed_bytes; //number of bytes processed
+    int64_t processed_bases; //number of bases of the processed reads
+    int32_t skipped[N_SKIP_REASONS]; // skipped reads by reason
+
+    //timers of this batch alone, for adapt_batch
+    double load_time;
+    double process_time;
+    double output_time; // merge_db or output_db
+
+    int64_t mem; // estimated bytes held by this batch, for --max-mem
+
+    prof_stat_t *prof; // per record stats, only with --profile
 
     khash_t(freqm)** freq_maps; // frequency map per record, only for FREQ subtool
     khash_t(viewm)** view_maps; // view map per record, only for VIEW subtool
     khash_t(summarym)** summary_maps; // summary map per record, only for SUMMARY subtool
+    mlcount_t* ml_counts; // ml_counts[rec_i*ML_HIST_READ_CODES + j] = ML counts of a mod code of a record, only for SUMMARY subtool with ml_hist
+    int* n_ml_counts;
+    modhist_t** thread_hists; // thread_hists[thread_i] = ML histograms of a processing thread, merged once per batch
+    int* n_thread_hists;
+    int* cap_thread_hists;
+    int32_t* rec_threads; // rec_threads[rec_i] = processing thread of the record, only with ml_hist
+    readmod_t** read_mods; // per read counters per mod code, only for VIEW subtool with read_level
+    int* n_read_mods;
+    int* cap_read_mods;
 
 } db_t;
 
 
+typedef struct viewbin_s viewbin_t;
+typedef struct freqbin_s freqbin_t;
+
 /* core data structure (mostly static data throughout the program lifetime) */
 typedef struct {
 
@@ -163,9 +281,19 @@ typedef struct {
     opt_t opt;
 
     // bam file related
-    htsFile* bam_fp;
+    htsFile** bam_fps; // one per input file, read one after the other
+    bam_hdr_t** bam_hdrs;
+    char** sample_names; // input file names without the directory and extension
+    int32_t n_bams;
+    int32_t bam_i; // input file being read
+    htsFile* bam_fp; // bam_fps[bam_i], only for load_db
     // hts_idx_t* bam_idx;
-    bam_hdr_t* bam_hdr;
+    bam_hdr_t* bam_hdr; // bam_hdrs[bam_i], only for load_db
+    hts_tpool* hts_pool; // decompression threads shared by the input files
+    int32_t n_io_threads; // threads of hts_pool, which also decode the records of load_db
+    hts_tpool_process* decode_queue; // decode jobs of load_db on hts_pool, NULL without it
+    uint8_t *skip_buf; // a skipped record that spans BGZF blocks is read into this, only for load_db
+    int64_t skip_buf_cap;
     // hts_itr_t* itr;
 
     // //multi region related
@@ -186,16 +314,54 @@ typedef struct {
     double output_time;
     double sort_time;
 
+    // batch limits, -K and -B unless tuned at runtime with --adaptive-batch
+    int32_t batch_size; // limits of the batch loaded last
+    int64_t batch_size_bases;
+    int32_t next_batch_size; // set by adapt_batch, used from the next load
+    int64_t next_batch_size_bases;
+    int32_t last_reads; // reads and timers of the batch merged or output last
+    int64_t last_bytes;
+    double last_load_time;
+    double last_process_time;
+    double last_output_time;
+    long adapt_rss; // peak rss when the limits were last cut for memory
+
+    // memory accounting for --max-mem, estimates in bytes
+    int64_t mem_fixed; // reference and context masks
+    int64_t mem_batches; // batches loaded and not yet freed
+    int64_t mem_map; // freq table
+    int64_t mem_peak; // largest total seen
+    pthread_mutex_t mem_lock;
+    pthread_cond_t mem_cond; // signalled when a batch is freed or the freq table shrinks
+    char **spill_files; // runs of the freq table written when it was over budget
+    int32_t n_spills;
+
     //stats //set by output_db
     uint32_t total_reads; //total number entries in the bam file
     uint64_t total_bytes; //total number of bytes in the bam file
     uint32_t processed_reads; //total number of reads processed
     uint64_t processed_bytes; //total number of bytes processed
+    uint64_t processed_bases; //total number of bases of the processed reads
+    uint32_t skipped[N_SKIP_REASONS]; //total skipped reads by reason
 
     khash_t(freqm)* freq_map;
 
+    viewbin_t* view_bin; // binary view writer, only for view --binary
+    freqbin_t* freq_bin; // window or region aggregates, only for freq --bin-size and --regions
+
+    profile_t* prof; // per thread stats, only with --profile
+
+    modhist_t* mod_hists; // run level ML histograms, only for summary --ml-hist
+    int n_mod_hists;
+    int cap_mod_hists;
+    uint64_t ml_hist_bases; // bases in the processed reads
+
 } core_t;
 
+// counters held by a site of the freq table, in haplotype slot major order
+static inline int32_t freq_n_counts(const core_t *core) {
+    return (core->opt.per_sample ? core->n_bams : 1) * (core->opt.haplotypes ? FREQ_HP_SLOTS : 1);
+}
 
 /* argument wrapper for the multithreaded framework used for data processing */
 typedef struct {
@@ -242,6 +408,15 @@ db_t* init_db(core_t* core);
 /* load a data batch from disk */
 ret_status_t load_db(core_t* dg, db_t* db);
 
+/* tune the limits of the next batch from the timers of the last batch */
+void adapt_batch(core_t* core);
+
+/* set the memory held by the reference, check it against --max-mem */
+void set_fixed_mem(core_t* core, int64_t bytes);
+
+/* account the freq table against --max-mem, spill it if it does not fit */
+void check_map_mem(core_t* core);
+
 /* process a single read in the given batch db */
 void work_per_single_read(core_t* core,db_t* db, int32_t i);
 
@@ -254,9 +429,15 @@ void process_db(core_t* core, db_t* db);
 /* write the output for a processed data batch */
 void output_db(core_t* core, db_t* db);
 
+/* print the skipped reads by reason, after the totals of a run */
+void print_skipped_reads(core_t* core, const char *func);
+
 /* merge db data into the core map */
 void merge_db(core_t* core, db_t* db);
 
+/* merge or write a processed batch into each output of multi */
+void sink_db(core_t* core, db_t* db);
+
 /* write the output for a all processed data batches */
 void output_core(core_t* core);
 
@@ -272,4 +453,7 @@ void free_core(core_t* core,opt_t opt);
 /* free user specified options */
 void free_opt(opt_t* opt);
 
+/* set the input files from the command line and an optional file of file names */
+void set_bam_files(opt_t* opt, char** files, int32_t n_files, const char* bam_list_file);
+
 #endif
@@ -33,6 +33,11 @@ SOFTWARE.
 #include "error.h"
 #include "khash.h"
 #include "ref.h"
+#include "viewbin.h"
+#include "freqbin.h"
+#include "sitesort.h"
+#include "seqkernel.h"
+#include "profile.h"
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
@@ -53,7 +58,6 @@ SOFTWARE.
 
 #define KEY_SIZE 2
 #define WILDCARD_STR "*"
-#define THRESH_UINT8_TO_DBL(x) ((double)( (x + 0.5) / 256.0 )) // convert uint8 threshold to double with 0.5/256 added for proper rounding
 
 // zero-allocation comparator
 int cmp_key_fast(const char *key_a, const char *key_b) {
@@ -86,10 +90,14 @@ int cmp_key_fast(const char *key_a, const char *key_b) {
     return start_a - start_b;
 }
 
-#define freq_kv_lt(a, b) (cmp_key_fast((a).key, (b).key) < 0)
-#define view_kv_lt(a, b) (cmp_key_fast((a).key, (b).key) < 0)
+// total order: contig, position, then strand, mod code, ins_offset and haplotype
+static inline int cmp_key_total(const char *key_a, const char *key_b) {
+    int cmp = cmp_key_fast(key_a, key_b);
+    return cmp != 0 ? cmp : sitesort_cmp_tail(key_a, key_b);
+}
+
+#define view_kv_lt(a, b) (cmp_key_total((a).key, (b).key) < 0)
 
-KSORT_INIT(freq, freq_kv_t, freq_kv_lt)
 KSORT_INIT(view, view_kv_t, view_kv_lt)
 
 static const int valid_bases[256] = { ['A'] = 1, ['C'] = 1, ['G'] = 1, ['T'] = 1, ['U'] = 1, ['N'] = 1, ['a'] = 1, ['c'] = 1, ['g'] = 1, ['t'] = 1, ['u'] = 1, ['n'] = 1 };
@@ -425,35 +433,49 @@ void warn_untested_cases(opt_t * opt) {
     }
 }
 
+/* key of a site. the ins_offset and haplotype fields are left empty for the common case
+ * (not an inserted base, no haplotype), so only inserted bases pay for the offset */
 char* make_key(const char *chrom, int pos, uint16_t ins_offset, char * mod_code, char strand, int haplotype){
+    char offset_str[8] = "";
+    char haplotype_str[12] = "";
+    if(ins_offset != 0){
+        snprintf(offset_str, sizeof(offset_str), "%u", ins_offset);
+    }
+    if(haplotype != -1){
+        snprintf(haplotype_str, sizeof(haplotype_str), "%d", haplotype);
+    }
     int start_strlen = snprintf(NULL, 0, "%d", pos);
-    int offset_strlen = snprintf(NULL, 0, "%d", ins_offset);
-    int mod_code_strlen = strlen(mod_code);
-    int haplotype_strlen = snprintf(NULL, 0, "%d", haplotype);
-    int key_strlen = strlen(chrom) + start_strlen  + offset_strlen + mod_code_strlen + haplotype_strlen + 7;
+    int key_strlen = strlen(chrom) + start_strlen + strlen(offset_str) + strlen(mod_code) + strlen(haplotype_str) + 7;
 
     char* key = (char *)malloc(key_strlen * sizeof(char));
     MALLOC_CHK(key);
-    snprintf(key, key_strlen, "%s\t%d\t%c\t%s\t%u\t%d", chrom, pos, strand, mod_code, ins_offset, haplotype);
+    snprintf(key, key_strlen, "%s\t%d\t%c\t%s\t%s\t%s", chrom, pos, strand, mod_code, offset_str, haplotype_str);
     return key;
 }
 
+/* split a key made by make_key, the key is modified. an empty ins_offset is 0 and an empty haplotype is -1 */
 void decode_key(char *key, char **chrom, int *pos, uint16_t * ins_offset, char **mod_code, char *strand, int *haplotype){
-    char* token = strtok(key, "\t");
-    *chrom = calloc(strlen(token)+1, sizeof(char));
+    char *fields[6];
+    fields[0] = key;
+    for(int i = 1; i < 6; i++){ // strtok would skip the empty fields
+        char *tab = strchr(fields[i-1], '\t');
+        *tab = '\0';
+        fields[i] = tab + 1;
+    }
+
+    *chrom = calloc(strlen(fields[0])+1, sizeof(char));
     MALLOC_CHK(*chrom);
-    strcpy(*chrom, token);
+    strcpy(*chrom, fields[0]);
 
-    *pos = atoi(strtok(NULL, "\t"));
-    *strand = strtok(NULL, "\t")[0];
-    
-    token = strtok(NULL, "\t");
-    *mod_code = calloc(strlen(token)+1, sizeof(char));
+    *pos = atoi(fields[1]);
+    *strand = fields[2][0];
+
+    *mod_code = calloc(strlen(fields[3])+1, sizeof(char));
     MALLOC_CHK(*mod_code);
-    strcpy(*mod_code, token);
+    strcpy(*mod_code, fields[3]);
 
-    *ins_offset = strtoul(strtok(NULL, "\t"), NULL, 10);
-    *haplotype = atoi(strtok(NULL, "\t"));
+    *ins_offset = fields[4][0] != '\0' ? strtoul(fields[4], NULL, 10) : 0;
+    *haplotype = fields[5][0] != '\0' ? atoi(fields[5]) : -1;
 }
 
 // /* Split tab-delimited keys for sorting*/
@@ -544,23 +566,65 @@ void print_view_options(opt_t *opt) {
 }
 
 void print_view_header(core_t* core) {
+    if(core->opt.read_level){
+        fprintf(sink_fp(&core->opt, VIEW), "read_id\tref_contig\tref_start\tref_end\tstrand\tmod_code\tn_sites\tn_called\tn_mod\tmean_prob%s%s\n",
+            core->opt.haplotypes ? "\thaplotype" : "", core->opt.per_sample ? "\tsample" : "");
+        return;
+    }
+    if(core->opt.binary_out){ // binary header holds the contig dictionary instead
+        core->view_bin = viewbin_init(sink_fp(&core->opt, VIEW), core->bam_hdrs[0], core->opt.insertions, core->opt.haplotypes);
+        return;
+    }
     char * common = "ref_contig\tref_pos\tstrand\tread_id\tread_pos\tmod_code\tmod_prob";
     char * ins_offset = "";
     char * haplotype = "";
+    char * sample = "";
     if(core->opt.insertions){
         ins_offset = "\tins_offset";
     }
     if(core->opt.haplotypes){
         haplotype = "\thaplotype";
     }
+    if(core->opt.per_sample){
+        sample = "\tsample";
+    }
 
-    fprintf(core->opt.output_fp, "%s%s%s\n", common, ins_offset, haplotype);
+    fprintf(sink_fp(&core->opt, VIEW), "%s%s%s%s\n", common, ins_offset, haplotype, sample);
+}
+
+// one row per read and mod code, in the order the codes were first seen in the read
+static void print_read_level_output(core_t* core, db_t* db) {
+    FILE *out_fp = sink_fp(&core->opt, VIEW);
+    for(int i = 0; i < db->n_bam_recs; i++) {
+        bam1_t *record = db->bam_recs[i];
+        bam_hdr_t *hdr = core->bam_hdrs[db->bam_idx[i]];
+        const char *tname = record->core.tid >= 0 ? hdr->target_name[record->core.tid] : "*";
+        for(int j = 0; j < db->n_read_mods[i]; j++) {
+            readmod_t *r = &db->read_mods[i][j];
+            fprintf(out_fp, "%s\t%s\t%ld\t%ld\t%c\t%s\t%u\t%u\t%u\t%f", bam_get_qname(record), tname,
+                (long)record->core.pos, (long)bam_endpos(record), bam_is_rev(record) ? '-' : '+', r->mod_code,
+                r->n_sites, r->n_called, r->n_mod, r->n_sites ? r->prob_sum / r->n_sites : 0);
+            if(core->opt.haplotypes){
+                fprintf(out_fp, "\t%d", db->hps[i]);
+            }
+            if(core->opt.per_sample){
+                fprintf(out_fp, "\t%s", core->sample_names[db->bam_idx[i]]);
+            }
+            fputc('\n', out_fp);
+        }
+    }
 }
 
 void print_view_output(core_t* core, db_t* db) {
-    FILE *out_fp = core->opt.output_fp;
+    if(core->opt.read_level){
+        print_read_level_output(core, db);
+        return;
+    }
+    FILE *out_fp = sink_fp(&core->opt, VIEW);
     int do_insertions = core->opt.insertions == 1;
     int do_haplotypes = core->opt.haplotypes == 1;
+    int do_samples = core->opt.per_sample == 1;
+    viewbin_t *view_bin = core->view_bin;
 
     // Reusable buffer
     int max_arr_capacity = 0;
@@ -592,6 +656,19 @@ void print_view_output(core_t* core, db_t* db) {
         // qsort(sorted_arr, size, sizeof(view_kv_t), cmp_view_kv);
         ks_introsort_view(size, sorted_arr);
 
+        uint32_t read_idx = 0;
+        int32_t contig_id = record->core.tid;
+        if(view_bin){
+            read_idx = viewbin_add_read(view_bin, qname);
+            if(db->bam_idx[i] != 0){ // the contig dictionary is from the first input file
+                contig_id = bam_name2id(core->bam_hdrs[0], core->bam_hdrs[db->bam_idx[i]]->target_name[record->core.tid]);
+                if(contig_id < 0){
+                    ERROR("Contig %s of %s is not in the header of %s", core->bam_hdrs[db->bam_idx[i]]->target_name[record->core.tid], core->opt.bam_files[db->bam_idx[i]], core->opt.bam_files[0]);
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+
         for (int j = 0; j < size; j++) {
             view_t* view = sorted_arr[j].view;
             char *tname = NULL;
@@ -603,13 +680,23 @@ void print_view_output(core_t* core, db_t* db) {
             char * key = sorted_arr[j].key;
             decode_key(key, &tname, &ref_pos, &ins_offset, &mod_code, &strand, &haplotype);
 
+            if(view_bin){
+                viewbin_add_row(view_bin, contig_id, ref_pos, strand, read_idx, view->read_pos, mod_code, view->mod_prob, ins_offset, haplotype);
+                free(tname);
+                free(mod_code);
+                continue;
+            }
+
             fprintf(out_fp, "%s\t%d\t%c\t%s\t%d\t%s\t%f", tname, ref_pos, strand, qname, view->read_pos, mod_code, THRESH_UINT8_TO_DBL(view->mod_prob));
             if(do_insertions){
-                fprintf(out_fp, "\t%d", db->ins_offset[i][view->read_pos]);
+                fprintf(out_fp, "\t%d", ins_offset);
             }
             if(do_haplotypes){
                 fprintf(out_fp, "\t%d", haplotype);
             }
+            if(do_samples){
+                fprintf(out_fp, "\t%s", core->sample_names[db->bam_idx[i]]);
+            }
             fputc('\n', out_fp);
             free(tname);
             free(mod_code);
@@ -620,12 +707,17 @@ void print_view_output(core_t* core, db_t* db) {
         free(sorted_arr);
     }
 
-    if(out_fp != stdout){
-        fclose(out_fp);
+    if(view_bin){
+        viewbin_flush(view_bin);
     }
 }
 
 void print_freq_header(core_t * core) {
+    if(core->opt.bin_size > 0 || core->opt.regions_file){ // sites are summed into windows or regions
+        core->freq_bin = freqbin_init(sink_fp(&core->opt, FREQ), core->opt.bin_size, core->opt.regions_file);
+        fprintf(sink_fp(&core->opt, FREQ), "contig\tstart\tend\tmod_code\tn_sites\tn_called\tn_mod\tmean_cov\tmean_freq%s\n", core->opt.regions_file ? "\tname" : "");
+        return;
+    }
     if(!core->opt.bedmethyl_out) { // tsv output header, no header for bedmethyl
         char * common = "contig\tstart\tend\tstrand\tn_called\tn_mod\tfreq\tmod_code";
         char * ins_offset = "";
@@ -637,8 +729,96 @@ void print_freq_header(core_t * core) {
             haplotype = "\thaplotype";
         }
 
-        fprintf(core->opt.output_fp, "%s%s%s\n", common, ins_offset, haplotype);
+        fprintf(sink_fp(&core->opt, FREQ), "%s%s%s", common, ins_offset, haplotype);
+        if(core->opt.per_sample){ // pooled counts first, then the counts of each sample
+            for(int32_t b = 0; b < core->n_bams; b++){
+                const char *name = core->sample_names[b];
+                fprintf(sink_fp(&core->opt, FREQ), "\t%s_n_called\t%s_n_mod\t%s_freq", name, name, name);
+            }
+        }
+        fputc('\n', sink_fp(&core->opt, FREQ));
+    }
+}
+
+/* print one site, freq is an array of the counts of each sample with --per-sample */
+void print_freq_site(core_t * core, const char *contig, int ref_pos, char strand, const char *mod_code, uint16_t ins_offset, int haplotype, freq_t *freq) {
+    FILE *out_fp = sink_fp(&core->opt, FREQ);
+
+    if(core->freq_bin) {
+        if(haplotype != -1) return; // the haplotype -1 entry already has the counts of all haplotypes
+        uint32_t n_called = freq->n_called, n_mod = freq->n_mod;
+        for(int32_t b = 1; core->opt.per_sample && b < core->n_bams; b++){ // pooled counts
+            n_called += freq[b].n_called;
+            n_mod += freq[b].n_mod;
+        }
+        freqbin_add(core->freq_bin, contig, ref_pos, mod_code, n_called, n_mod);
+        return;
+    }
+
+    if(core->opt.bedmethyl_out) {
+        double freq_value = (double)freq->n_mod*100/freq->n_called;
+        int end = ref_pos+1;
+        fprintf(out_fp, "%s\t%d\t%d\t%s\t%d\t%c\t%d\t%d\t255,0,0\t%d\t%f\n", contig, ref_pos, end, mod_code, freq->n_called, strand, ref_pos, end, freq->n_called, freq_value);
+        return;
+    }
+
+    int do_samples = core->opt.per_sample;
+    int32_t n_samples = core->n_bams;
+    freq_t *sample_freqs = freq;
+    freq_t pooled;
+    if(do_samples){ // freq points to the counts of each sample
+        pooled.n_called = 0;
+        pooled.n_mod = 0;
+        for(int32_t b = 0; b < n_samples; b++){
+            pooled.n_called += freq[b].n_called;
+            pooled.n_mod += freq[b].n_mod;
+        }
+        freq = &pooled;
+    }
+    double freq_value = (double)freq->n_mod / freq->n_called;
+
+    fprintf(out_fp, "%s\t%d\t%d\t%c\t%d\t%d\t%f\t%s", contig, ref_pos, ref_pos, strand, freq->n_called, freq->n_mod, freq_value, mod_code);
+
+    if(core->opt.insertions){
+        fprintf(out_fp, "\t%d", ins_offset);
+    }
+    if(core->opt.haplotypes) {
+        if(haplotype == -1){
+            fputs("\t*", out_fp);
+        } else {
+            fprintf(out_fp, "\t%d", haplotype);
+        }
+    }
+    if(do_samples){
+        for(int32_t b = 0; b < n_samples; b++){
+            if(sample_freqs[b].n_called == 0){
+                fputs("\t0\t0\tNA", out_fp);
+            } else {
+                fprintf(out_fp, "\t%d\t%d\t%f", sample_freqs[b].n_called, sample_freqs[b].n_mod, (double)sample_freqs[b].n_mod / sample_freqs[b].n_called);
+            }
+        }
+    }
+    fputc('\n', out_fp);
+}
+
+/* print the rows of a site, with --haplotypes a row for each haplotype with calls and the * row */
+static void print_freq_counts(core_t * core, const char *contig, int ref_pos, char strand, const char *mod_code, uint16_t ins_offset, freq_t *counts) {
+    if(!core->opt.haplotypes){
+        print_freq_site(core, contig, ref_pos, strand, mod_code, ins_offset, -1, counts);
+        return;
+    }
+    int32_t n_samples = core->opt.per_sample ? core->n_bams : 1;
+    for(int hp = 0; hp < FREQ_HP_ALL; hp++){
+        freq_t *hp_counts = &counts[hp * n_samples];
+        int has_calls = 0;
+        for(int32_t b = 0; b < n_samples; b++){
+            has_calls |= hp_counts[b].n_called > 0;
+        }
+        if(has_calls){
+            print_freq_site(core, contig, ref_pos, strand, mod_code, ins_offset, hp, hp_counts);
+        }
     }
+    print_freq_site(core, contig, ref_pos, strand, mod_code, ins_offset, -1, &counts[FREQ_HP_ALL * n_samples]);
 }
 
 void print_freq_output(core_t * core) {
@@ -659,65 +839,29 @@ void print_freq_output(core_t * core) {
             size++;
         }
     }
-    // qsort(sorted_arr, size, sizeof(freq_kv_t), cmp_freq_kv);
-    ks_introsort_freq(size, sorted_arr);
+    // by header order and position, on the processing threads
+    sitesort(core, sorted_arr, size, sizeof(freq_kv_t));
     core->sort_time = realtime() - sort_start;
 
     double output_start = realtime();
 
-    FILE *out_fp = core->opt.output_fp;
-    int do_insertions = core->opt.insertions;
-    int do_haplotypes = core->opt.haplotypes;
-
-    if(core->opt.bedmethyl_out) {
-        for (int i = 0; i < size; i++) {
-            freq_t* freq = sorted_arr[i].freq;
-            double freq_value = (double)freq->n_mod*100/freq->n_called;
-            char *contig = NULL;
-            int ref_pos;
-            uint16_t ins_offset;
-            char *mod_code;
-            char strand;
-            int haplotype;
-            char * key = sorted_arr[i].key;
-            decode_key(key, &contig, &ref_pos, &ins_offset, &mod_code, &strand, &haplotype);
-            int end = ref_pos+1;
-            fprintf(core->opt.output_fp, "%s\t%d\t%d\t%s\t%d\t%c\t%d\t%d\t255,0,0\t%d\t%f\n", contig, ref_pos, end, mod_code, freq->n_called, strand, ref_pos, end, freq->n_called, freq_value);
-            free(contig);
-            free(mod_code);
-        }
-        
-    } else {
-        for (int i = 0; i < size; i++) {
-            freq_t* freq = sorted_arr[i].freq;
-            double freq_value = (double)freq->n_mod / freq->n_called;
-            char * contig = NULL;
-            int ref_pos;
-            uint16_t ins_offset;
-            char * mod_code;
-            char strand;
-            int haplotype;
-            char * key = sorted_arr[i].key;
-            decode_key(key, &contig, &ref_pos, &ins_offset, &mod_code, &strand, &haplotype);
-
-            fprintf(out_fp, "%s\t%d\t%d\t%c\t%d\t%d\t%f\t%s", contig, ref_pos, ref_pos, strand, freq->n_called, freq->n_mod, freq_value, mod_code);
-
-            if(do_insertions){
-                fprintf(out_fp, "\t%d", ins_offset);
-            } 
-            if(do_haplotypes) {
-                if(haplotype == -1){
-                    fputs("\t*", out_fp);
-                } else {
-                    fprintf(out_fp, "\t%d", haplotype);
-                }
-            }
-            fputc('\n', out_fp);
-            free(contig);
-            free(mod_code);
-        }
+    for (int i = 0; i < size; i++) {
+        char *contig = NULL;
+        int ref_pos;
+        uint16_t ins_offset;
+        char *mod_code;
+        char strand;
+        int haplotype;
+        decode_key(sorted_arr[i].key, &contig, &ref_pos, &ins_offset, &mod_code, &strand, &haplotype);
+        print_freq_counts(core, contig, ref_pos, strand, mod_code, ins_offset, sorted_arr[i].freq);
+        free(contig);
+        free(mod_code);
     }
 
+    FILE *out_fp = sink_fp(&core->opt, FREQ);
+    if(core->freq_bin){
+        freqbin_write(core->freq_bin);
+    }
     if(out_fp != stdout){
         fclose(out_fp);
     }
@@ -727,6 +871,29 @@ void print_freq_output(core_t * core) {
     core->output_time += (realtime()-output_start);
 }
 
+#define SITE_PREFETCH_DIST 8 // keys between a bucket prefetch and its lookup
+
+#ifdef __GNUC__
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr) ((void)(addr))
+#endif
+
+// the first probe of a key with the given hash
+#define PREFETCH_BUCKET(h, hash) do { \
+        khint_t i_ = (hash) & ((h)->n_buckets - 1); \
+        PREFETCH(&(h)->flags[i_ >> 4]); \
+        PREFETCH(&(h)->keys[i_]); \
+        PREFETCH(&(h)->vals[i_]); \
+    } while (0)
+
+// grow h so that n more keys go in without a rehash
+#define RESERVE_KEYS(name, h, n) do { \
+        if ((h)->n_occupied + (n) >= (h)->upper_bound) { \
+            kh_resize(name, h, (khint_t)(((h)->size + (n)) / __ac_HASH_UPPER) + 1); \
+        } \
+    } while (0)
+
 void destroy_freq_map(khash_t(freqm)* freq_map){
     khint_t k;
     for (k = kh_begin(freq_map); k != kh_end(freq_map); k++) {
@@ -742,37 +909,88 @@ void destroy_freq_map(khash_t(freqm)* freq_map){
 
 void merge_freq_maps(core_t* core, db_t* db) {
     khash_t(freqm) *core_map = core->freq_map;
+    int32_t n_samples = core->opt.per_sample ? core->n_bams : 1;
+    int32_t n_counts = freq_n_counts(core);
+    static int warned_hp = 0; // merging is single threaded
+    khint_t *live = NULL; // buckets of the keys of a read
+    int32_t cap_live = 0;
     
     for (int i = 0; i < db->n_bam_recs; i++) {
         khash_t(freqm) *rec_map = db->freq_maps[i];
+        int32_t sample = core->opt.per_sample ? db->bam_idx[i] : 0;
+        int hp_slot = core->opt.haplotypes ? freq_hp_slot(db->hps[i]) : FREQ_HP_ALL;
+        if (hp_slot < 0 && !warned_hp) {
+            WARNING("HP tag %d of read %s is above %d, reads like this are only counted in the * haplotype rows", db->hps[i], bam_get_qname(db->bam_recs[i]), FREQ_HP_ALL - 1);
+            warned_hp = 1;
+        }
         
         if (kh_size(rec_map) == 0) continue;
 
+        // the core map is far larger than the cache, so its buckets are prefetched a few keys ahead of the merge
+        int32_t n_live = 0;
+        if ((int32_t)kh_size(rec_map) > cap_live) {
+            cap_live = kh_size(rec_map);
+            live = (khint_t *)realloc(live, cap_live * sizeof(khint_t));
+            MALLOC_CHK(live);
+        }
         for (khint_t k = kh_begin(rec_map); k != kh_end(rec_map); ++k) {
-            if (kh_exist(rec_map, k)) {
-                char *key = (char *) kh_key(rec_map, k);
-                freq_t *db_freq = kh_value(rec_map, k);
-                
-                int ret;
-                khint_t core_k = kh_put(freqm, core_map, key, &ret);
-                
-                if (ret == 0) {
-                    // key already exists in core_map
-                    freq_t *core_freq = kh_value(core_map, core_k);
+            if (kh_exist(rec_map, k)) live[n_live++] = k;
+        }
+        RESERVE_KEYS(freqm, core_map, n_live);
+        for (int32_t j = 0; j < n_live && j < SITE_PREFETCH_DIST; j++) {
+            PREFETCH_BUCKET(core_map, kh_str_hash_func(kh_key(rec_map, live[j])));
+        }
+
+        for (int32_t j = 0; j < n_live; j++) {
+            if (j + SITE_PREFETCH_DIST < n_live) {
+                PREFETCH_BUCKET(core_map, kh_str_hash_func(kh_key(rec_map, live[j + SITE_PREFETCH_DIST])));
+            }
+            khint_t k = live[j];
+            char *key = (char *) kh_key(rec_map, k);
+            freq_t *db_freq = kh_value(rec_map, k);
+            
+            int ret;
+            khint_t core_k = kh_put(freqm, core_map, key, &ret);
+            
+            if (n_counts > 1) {
+                // core_map holds an array of counters, haplotype slot major, one per sample in each slot
+                if (ret != 0) {
+                    freq_t *counts = (freq_t *)calloc(n_counts, sizeof(freq_t));
+                    MALLOC_CHK(counts);
+                    kh_value(core_map, core_k) = counts;
+                }
+                freq_t *counts = kh_value(core_map, core_k);
+                freq_t *core_freq = core->opt.haplotypes ? &counts[FREQ_HP_ALL * n_samples + sample] : &counts[sample];
+                core_freq->n_called += db_freq->n_called;
+                core_freq->n_mod += db_freq->n_mod;
+                if (core->opt.haplotypes && hp_slot >= 0 && hp_slot != FREQ_HP_ALL) {
+                    core_freq = &counts[hp_slot * n_samples + sample];
                     core_freq->n_called += db_freq->n_called;
                     core_freq->n_mod += db_freq->n_mod;
-                    
-                } else {
-                    // key does not exist, insert
-                    kh_value(core_map, core_k) = db_freq;
-                    // remove from rec_map to avoid double free later
+                }
+                if (ret != 0) {
+                    // key is now owned by core_map
                     kh_del(freqm, rec_map, k);
+                    free(db_freq);
                 }
+            } else if (ret == 0) {
+                // key already exists in core_map
+                freq_t *core_freq = kh_value(core_map, core_k);
+                core_freq->n_called += db_freq->n_called;
+                core_freq->n_mod += db_freq->n_mod;
+                
+            } else {
+                // key does not exist, insert
+                kh_value(core_map, core_k) = db_freq;
+                // remove from rec_map to avoid double free later
+                kh_del(freqm, rec_map, k);
             }
         }
     }
+    free(live);
 }
 
+// build the read consuming CIGAR segments of a read in the read order
 static void get_aln(core_t * core, db_t *db, bam_hdr_t *hdr, bam1_t *record, int bam_i){
     int32_t tid = record->core.tid;
     assert(tid < hdr->n_targets);
@@ -791,22 +1009,16 @@ static void get_aln(core_t * core, db_t *db, bam_hdr_t *hdr, bam1_t *record, int
 
     ref_t *ref = get_ref(tname);
         ASSERT_MSG(ref != NULL, "Contig %s not found in reference provided\n", tname);
-  
+
+    // whole alignment must be within the reference, checked once instead of per base
+    ASSERT_MSG(ref->ref_seq_length == hdr->target_len[tid], "ref_len:%d target_len:%d\n", ref->ref_seq_length, hdr->target_len[tid]);
+    ASSERT_MSG(pos >= 0 && end <= ref->ref_seq_length, "ref_pos:%d ref_end:%d ref_len:%d\n", pos, end, ref->ref_seq_length);
+
     int read_pos = 0;
     int ref_pos = pos;
 
-    int * aligned_pairs = db->aln[bam_i];
-    //fill the aligned_pairs array with -1
-    for(int i=0;i<seq_len;i++){
-        aligned_pairs[i] = -1;
-    }
-
-    if(core->opt.insertions){
-        for(int i=0;i<seq_len;i++){
-            db->ins[bam_i][i] = -1;
-            db->ins_offset[bam_i][i] = 0;
-        }
-    }
+    aln_seg_t *segs = db->aln_segs[bam_i];
+    int n_segs = 0;
 
     for (uint32_t ci = 0; ci < n_cigar; ++ci) {
         uint32_t c = cigar[ci];
@@ -820,23 +1032,21 @@ static void get_aln(core_t * core, db_t *db, bam_hdr_t *hdr, bam1_t *record, int
         // based on the cigar operation
         int read_inc = 0;
         int ref_inc = 0;
+        int seg_op = -1;
 
-        // Process match between the read and the reference
-        int8_t is_aligned = 0, is_inserted = 0;
         if(cigar_op == BAM_CMATCH || cigar_op == BAM_CEQUAL || cigar_op == BAM_CDIFF) {
-            is_aligned = 1;
+            seg_op = BAM_CMATCH;
             read_inc = 1;
             ref_inc = 1;
         } else if(cigar_op == BAM_CDEL) {
             ref_inc = 1;
         } else if(cigar_op == BAM_CREF_SKIP) {
-            // end the current segment and start a new one
-            //out.push_back(AlignedSegment());
             ref_inc = 1;
         } else if(cigar_op == BAM_CINS) {
+            seg_op = BAM_CINS;
             read_inc = 1;
-            is_inserted = 1;
         } else if(cigar_op == BAM_CSOFT_CLIP) {
+            seg_op = BAM_CSOFT_CLIP;
             read_inc = 1;
         } else if(cigar_op == BAM_CHARD_CLIP) { // TODO: use MN tag (seq len at the time MM value was last written) to check this?
             read_inc = 0;
@@ -847,52 +1057,71 @@ static void get_aln(core_t * core, db_t *db, bam_hdr_t *hdr, bam1_t *record, int
             exit(EXIT_FAILURE);
         }
 
-        // Iterate over the pairs of aligned bases
-        for(int j = 0; j < cigar_len; ++j) {
-            if(is_aligned) {
-                ASSERT_MSG(read_pos < seq_len, "read_pos:%d seq_len:%d\n", read_pos, seq_len);
-                int start = ref_pos;
-                if(rev) {
-                    start = pos + end - ref_pos - 1;
-                }
-                aligned_pairs[read_pos] = start;
+        if(seg_op != -1 && cigar_len > 0) {
+            segs[n_segs].read_start = read_pos;
+            segs[n_segs].ref_start = ref_pos;
+            segs[n_segs].len = cigar_len;
+            segs[n_segs].op = seg_op;
+            n_segs++;
+        }
 
-                ASSERT_MSG(ref_pos >= 0 && ref_pos < ref->ref_seq_length, "ref_pos:%d ref_len:%d\n", ref_pos, ref->ref_seq_length);
-                ASSERT_MSG(ref->ref_seq_length == hdr->target_len[tid], "ref_len:%d target_len:%d\n", ref->ref_seq_length, hdr->target_len[tid]);
-            }
+        read_pos += read_inc * cigar_len;
+        ref_pos += ref_inc * cigar_len;
+    }
 
-            if(core->opt.insertions && is_inserted) {
-                ASSERT_MSG(read_pos < seq_len, "read_pos:%d seq_len:%d\n", read_pos, seq_len);
-                int start = ref_pos-1;
-                int offset = j+1;
-                if(rev) {
-                    start = pos + end - ref_pos - 1;
-                    offset = cigar_len - j;
-                }
-                db->ins[bam_i][read_pos] = start;
-                db->ins_offset[bam_i][read_pos] = offset;
-            }
+    ASSERT_MSG(read_pos <= seq_len, "read_pos:%d seq_len:%d\n", read_pos, seq_len);
+    db->n_aln_segs[bam_i] = n_segs;
+}
 
-            // increment
-            read_pos += read_inc;
-            ref_pos += ref_inc;
+// segment containing read_pos, NULL if read_pos is past the last segment
+static inline const aln_seg_t *find_aln_seg(const aln_seg_t *segs, int n_segs, int read_pos) {
+    int lo = 0, hi = n_segs - 1;
+    if(n_segs == 0 || read_pos < segs[0].read_start) return NULL;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) >> 1;
+        if (segs[mid].read_start <= read_pos) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
         }
     }
+    if(read_pos >= segs[lo].read_start + segs[lo].len) return NULL;
+    return &segs[lo];
+}
+
+// reference position aligned to read_pos, -1 if not aligned
+static inline int get_aligned_ref_pos(const aln_seg_t *segs, int n_segs, int read_pos, int8_t rev, int32_t pos, int32_t end) {
+    const aln_seg_t *seg = find_aln_seg(segs, n_segs, read_pos);
+    if(seg == NULL || seg->op != BAM_CMATCH) return -1;
+    int ref_pos = seg->ref_start + (read_pos - seg->read_start);
+    return rev ? pos + end - ref_pos - 1 : ref_pos;
 }
 
-static void update_freq_map(khash_t(freqm) *freq_map, const char *tname, int ref_pos, int ins_offset, char *mod_code, char strand, int haplotype, int is_called, int is_mod) {
-    char * key = make_key(tname, ref_pos, ins_offset, mod_code, strand, haplotype);
-    khiter_t k = kh_get(freqm, freq_map, key);
-    if (k == kh_end(freq_map)) { // not found, add
+// reference position an inserted read_pos is anchored to and its offset, -1 (offset 0) if not inserted
+static inline int get_inserted_ref_pos(const aln_seg_t *segs, int n_segs, int read_pos, int8_t rev, int32_t pos, int32_t end, int *ins_offset) {
+    const aln_seg_t *seg = find_aln_seg(segs, n_segs, read_pos);
+    *ins_offset = 0;
+    if(seg == NULL || seg->op != BAM_CINS) return -1;
+    int j = read_pos - seg->read_start;
+    if(rev) {
+        *ins_offset = seg->len - j;
+        return pos + end - seg->ref_start - 1;
+    }
+    *ins_offset = j + 1;
+    return seg->ref_start - 1;
+}
+
+// the counts of a read are not split by haplotype, merge_freq_maps adds them to the slot of the read's HP tag. the key is owned by the map or freed
+static void update_freq_map(khash_t(freqm) *freq_map, char *key, int is_called, int is_mod, prof_stat_t *ps) {
+    int ret;
+    khiter_t k = kh_put(freqm, freq_map, key, &ret);
+    if (ret != 0) { // not found, add
         freq_t * freq = (freq_t *)malloc(sizeof(freq_t));
         MALLOC_CHK(freq);
         freq->n_called = is_called;
         freq->n_mod = is_mod;
-        int ret;
-        k = kh_put(freqm, freq_map, key, &ret);
         kh_value(freq_map, k) = freq;
     } else { // found, update
-        free(key);
         freq_t * freq = kh_value(freq_map, k);
         freq->n_called += is_called;
         freq->n_mod += is_mod;
@@ -901,55 +1130,336 @@ static void update_freq_map(khash_t(freqm) *freq_map, const char *tname, int ref
             ERROR("n_called overflowed for key %s. Please report this issue.", key);
             exit(EXIT_FAILURE);
         }
+        free(key);
     }
 
-    if(haplotype != -1) {
-        char * key = make_key(tname, ref_pos, ins_offset, mod_code, strand, -1); // aggregate all haplotypes
-        khiter_t k = kh_get(freqm, freq_map, key);
-        if (k == kh_end(freq_map)) { // not found, add
-            freq_t * freq = (freq_t *)malloc(sizeof(freq_t));
-            MALLOC_CHK(freq);
-            freq->n_called = is_called;
-            freq->n_mod = is_mod;
-            int ret;
-            k = kh_put(freqm, freq_map, key, &ret);
-            kh_value(freq_map, k) = freq;
-        } else { // found, update
-            free(key);
-            freq_t * freq = kh_value(freq_map, k);
-            freq->n_called += is_called;
-            freq->n_mod += is_mod;
-            // check if freq->n_called overflows
-            if(freq->n_called == 0){
-                ERROR("n_called overflowed for key %s. Please report this issue.", key);
-                exit(EXIT_FAILURE);
-            }
-        }
+    if(ps) {
+        ps->sites++;
+        ps->hash_lookups++;
+        ps->allocs += 1 + (ret != 0); // a key per site and a freq_t if new
     }
 }
 
-static void add_view_entry(khash_t(viewm) *view_map, const char *tname, int ref_pos, int ins_offset, char *mod_code, char strand, int haplotype, uint8_t mod_prob, int read_pos) {
-
-    char *key = make_key(tname, ref_pos, ins_offset, mod_code, strand, haplotype);
-    khiter_t k = kh_get(viewm, view_map, key);
-    if (k == kh_end(view_map)) { // not found, add
+// the first entry of a site is kept. the key is owned by the map or freed
+static void add_view_entry(khash_t(viewm) *view_map, char *key, uint8_t mod_prob, int read_pos, prof_stat_t *ps) {
+    int ret;
+    khiter_t k = kh_put(viewm, view_map, key, &ret);
+    if (ret != 0) { // not found, add
         view_t *view = (view_t *)malloc(sizeof(view_t));
         MALLOC_CHK(view);
         view->mod_prob = mod_prob;
         view->read_pos = read_pos;
-        int ret;
-        k = kh_put(viewm, view_map, key, &ret);
         kh_value(view_map, k) = view;
-    } else { // found, update
+    } else { // found, keep the first
         free(key);
     }
+
+    if(ps) {
+        ps->sites++;
+        ps->hash_lookups++;
+        ps->allocs += 1 + (ret != 0);
+    }
+}
+
+/* sites of a read are gathered and then committed to the per read maps in one go: all keys are built and
+ * hashed first, the maps are sized for them, and the bucket of each key is prefetched a few sites ahead of
+ * its update, so that the cache misses of the lookups overlap instead of stalling one after the other */
+typedef struct {
+    char *mod_code; // points into db->mod_codes, valid until the next MM group
+    int32_t ref_pos;
+    int32_t read_pos;
+    uint16_t ins_offset;
+    uint8_t mod_prob;
+    uint8_t is_mod;
+    uint8_t to_freq;
+    uint8_t to_view;
+    khint_t freq_hash;
+    khint_t view_hash;
+    char *freq_key;
+    char *view_key;
+} pending_site_t;
+
+typedef struct {
+    pending_site_t *a;
+    int32_t n;
+    int32_t cap;
+} pending_sites_t;
+
+static inline void gather_site(pending_sites_t *sites, char *mod_code, int ref_pos, int ins_offset, int read_pos, uint8_t mod_prob, int is_mod, int to_freq, int to_view) {
+    if (sites->n == sites->cap) {
+        sites->cap = sites->cap ? sites->cap * 2 : 256;
+        sites->a = (pending_site_t *)realloc(sites->a, sites->cap * sizeof(pending_site_t));
+        MALLOC_CHK(sites->a);
+    }
+    pending_site_t *site = &sites->a[sites->n++];
+    site->mod_code = mod_code;
+    site->ref_pos = ref_pos;
+    site->read_pos = read_pos;
+    site->ins_offset = ins_offset;
+    site->mod_prob = mod_prob;
+    site->is_mod = is_mod;
+    site->to_freq = to_freq;
+    site->to_view = to_view;
+}
+
+// add the gathered sites to the maps in the order they were gathered, as the view keeps the first entry of a site
+static void commit_sites(khash_t(freqm) *freq_map, khash_t(viewm) *view_map, const char *tname, char strand, int haplotype, pending_sites_t *sites, prof_stat_t *ps) {
+    if (sites->n == 0) return;
+    double start = ps ? realtime() : 0;
+    int32_t n = sites->n;
+    int32_t n_freq = 0, n_view = 0;
+
+    for (int32_t s = 0; s < n; s++) {
+        pending_site_t *site = &sites->a[s];
+        if (site->to_freq) {
+            site->freq_key = make_key(tname, site->ref_pos, site->ins_offset, site->mod_code, strand, -1);
+            site->freq_hash = kh_str_hash_func(site->freq_key);
+            n_freq++;
+        }
+        if (site->to_view) {
+            site->view_key = make_key(tname, site->ref_pos, site->ins_offset, site->mod_code, strand, haplotype);
+            site->view_hash = kh_str_hash_func(site->view_key);
+            n_view++;
+        }
+    }
+
+    // buckets do not move once the maps are sized, so a prefetched bucket is the one probed
+    if (n_freq) RESERVE_KEYS(freqm, freq_map, n_freq);
+    if (n_view) RESERVE_KEYS(viewm, view_map, n_view);
+
+    for (int32_t s = 0; s < n && s < SITE_PREFETCH_DIST; s++) {
+        if (sites->a[s].to_freq) PREFETCH_BUCKET(freq_map, sites->a[s].freq_hash);
+        if (sites->a[s].to_view) PREFETCH_BUCKET(view_map, sites->a[s].view_hash);
+    }
+    for (int32_t s = 0; s < n; s++) {
+        if (s + SITE_PREFETCH_DIST < n) {
+            pending_site_t *ahead = &sites->a[s + SITE_PREFETCH_DIST];
+            if (ahead->to_freq) PREFETCH_BUCKET(freq_map, ahead->freq_hash);
+            if (ahead->to_view) PREFETCH_BUCKET(view_map, ahead->view_hash);
+        }
+        pending_site_t *site = &sites->a[s];
+        if (site->to_freq) update_freq_map(freq_map, site->freq_key, 1, site->is_mod, ps);
+        if (site->to_view) add_view_entry(view_map, site->view_key, site->mod_prob, site->read_pos, ps);
+    }
+    sites->n = 0;
+
+    if(ps) {
+        ps->hash_time += realtime() - start;
+    }
+}
+
+// count a site towards the per read counters of its mod code, used instead of add_view_entry in view --read-level
+static void add_read_mod(readmod_t **mods, int *n_mods, int *cap_mods, const char *mod_code, uint8_t mod_prob, double thresh, prof_stat_t *ps) {
+    readmod_t *r = NULL;
+    for(int i = 0; i < *n_mods; i++) { // a read carries only a few codes
+        if(strcmp((*mods)[i].mod_code, mod_code) == 0) {
+            r = &(*mods)[i];
+            break;
+        }
+    }
+    if(r == NULL) {
+        if(*n_mods == *cap_mods) {
+            *cap_mods = *cap_mods ? *cap_mods * 2 : 2;
+            *mods = (readmod_t *)realloc(*mods, sizeof(readmod_t) * (*cap_mods));
+            MALLOC_CHK(*mods);
+        }
+        r = &(*mods)[(*n_mods)++];
+        memset(r, 0, sizeof(readmod_t));
+        strncpy(r->mod_code, mod_code, MOD_CODE_LEN);
+        r->mod_code[MOD_CODE_LEN] = '\0';
+    }
+
+    double mod_prob_dbl = THRESH_UINT8_TO_DBL(mod_prob);
+    r->n_sites++;
+    r->prob_sum += mod_prob_dbl;
+    if(mod_prob_dbl >= thresh){ // same calling rule as freq
+        r->n_called++;
+        r->n_mod++;
+    } else if(mod_prob_dbl <= 1 - thresh){
+        r->n_called++;
+    }
+
+    if(ps) {
+        ps->sites++;
+    }
+}
+
+/* streaming cursor over the bases of a read that match a canonical base, in the read order or reverse */
+typedef struct {
+    const uint8_t *seq; // 4-bit packed sequence
+    int32_t seq_len;
+    int8_t rev; // walk from the end of the sequence
+    uint16_t mask; // bit n is set if the nibble code n is counted as the base
+    int32_t next; // next read position to examine
+    int32_t rank; // rank of the last matched base, -1 before the first
+} base_cursor_t;
+
+#define NIBBLE_LSB 0x1111111111111111ULL
+
+// nibble codes that base_idx_lookup maps to the same index as base
+static inline uint16_t get_base_mask(char base) {
+    int idx = base_idx_lookup[(int)base];
+    uint16_t mask = 0;
+    for(int n = 0; n < 16; n++) {
+        if(base_idx_lookup[(int)seq_nt16_str[n]] == idx) {
+            mask |= 1 << n;
+        }
+    }
+    return mask;
+}
+
+// number of nibbles in w equal to code
+static inline int count_nibbles_eq(uint64_t w, int code) {
+    uint64_t y = w ^ (NIBBLE_LSB * code);
+    uint64_t nonzero = (y | y >> 1 | y >> 2 | y >> 3) & NIBBLE_LSB;
+    return 16 - __builtin_popcountll(nonzero);
+}
+
+// number of nibbles in w whose code is set in mask
+static inline int count_nibbles(uint64_t w, uint16_t mask) {
+    int invert = __builtin_popcount(mask) > 8; // fewer compares on the complement
+    uint16_t m = invert ? (uint16_t)~mask : mask;
+    int count = 0;
+    while(m) {
+        count += count_nibbles_eq(w, __builtin_ctz(m));
+        m &= m - 1;
+    }
+    return invert ? 16 - count : count;
+}
+
+static inline void init_base_cursor(base_cursor_t *cur, const uint8_t *seq, int32_t seq_len, int8_t rev, uint16_t mask) {
+    cur->seq = seq;
+    cur->seq_len = seq_len;
+    cur->rev = rev;
+    cur->mask = mask;
+    cur->next = rev ? seq_len - 1 : 0;
+    cur->rank = -1;
+}
+
+// read position of the base with the given rank, -1 if the read has fewer such bases. ranks must increase between calls
+static inline int32_t seek_base_cursor(base_cursor_t *cur, int32_t rank) {
+    while(1) {
+        int32_t p;
+        if(!cur->rev) {
+            if(cur->next >= cur->seq_len) return -1;
+            if((cur->next & 63) == 0 && cur->next + 64 <= cur->seq_len) { // whole 64 base chunk, counted with the vector kernel
+                int count = seq_count_base(cur->seq, cur->next, cur->next + 64, cur->mask);
+                if(cur->rank + count < rank) {
+                    cur->rank += count;
+                    cur->next += 64;
+                    continue;
+                }
+            }
+            if((cur->next & 15) == 0 && cur->next + 16 <= cur->seq_len) { // whole 16 base word, skip if the rank is not in it
+                uint64_t w;
+                memcpy(&w, cur->seq + (cur->next >> 1), sizeof(uint64_t));
+                int count = count_nibbles(w, cur->mask);
+                if(cur->rank + count < rank) {
+                    cur->rank += count;
+                    cur->next += 16;
+                    continue;
+                }
+            }
+            p = cur->next++;
+        } else {
+            if(cur->next < 0) return -1;
+            if((cur->next & 63) == 63) {
+                int count = seq_count_base(cur->seq, cur->next - 63, cur->next + 1, cur->mask);
+                if(cur->rank + count < rank) {
+                    cur->rank += count;
+                    cur->next -= 64;
+                    continue;
+                }
+            }
+            if((cur->next & 15) == 15) {
+                uint64_t w;
+                memcpy(&w, cur->seq + ((cur->next - 15) >> 1), sizeof(uint64_t));
+                int count = count_nibbles(w, cur->mask);
+                if(cur->rank + count < rank) {
+                    cur->rank += count;
+                    cur->next -= 16;
+                    continue;
+                }
+            }
+            p = cur->next--;
+        }
+        if((cur->mask >> bam_seqi(cur->seq, p)) & 1) {
+            if(++cur->rank == rank) return p;
+        }
+    }
+}
+
+// number of bases in the read matching mask
+static inline int32_t count_bases(const uint8_t *seq, int32_t seq_len, uint16_t mask) {
+    return seq_count_base(seq, 0, seq_len, mask);
+}
+
+// parse the next skip count of the current MM group, -1 at the end of the group (i is left at ';')
+static inline int next_skip_count(const char *mm_string, int mm_str_len, int *i) {
+    while(*i < mm_str_len && mm_string[*i] == ',') {
+        (*i)++;
+    }
+    if(*i >= mm_str_len || mm_string[*i] == ';') {
+        return -1;
+    }
+
+    char skip_count_str[10];
+    int l = 0;
+    while (*i < mm_str_len && mm_string[*i] != ',' && mm_string[*i] != ';') {
+        skip_count_str[l] = mm_string[*i];
+        (*i)++;
+        l++;
+        assert(l < 10); // if this fails, use dynamic allocation for skip_count_str
+    }
+    skip_count_str[l] = '\0';
+    int skip_count;
+    sscanf(skip_count_str, "%d", &skip_count);
+    ASSERT_MSG(skip_count >= 0, "Skip count cannot be negative: %d.\n", skip_count);
+    return skip_count;
+}
+
+#define REF_WIN_MAX_MODS 8 // one context bit per mod code in the low byte
+#define REF_WIN_BASE_SHIFT 8 // the reference base is in the high byte
+
+/* reference span [pos, end) of a read, win[p - pos] has the context flag of mod code index m on the strand
+ * of the read in bit m and the forward reference base in the high byte. the flags of each mod code and the
+ * bases are read in sequential passes, so the sites of the read look up one buffer of the read's length
+ * instead of n_mods + 1 arrays of the contig. NULL if there are more mod codes than bits */
+static uint16_t *get_ref_window(const ref_t *ref, int n_mods, int8_t rev, int32_t pos, int32_t end) {
+    if(n_mods > REF_WIN_MAX_MODS || end <= pos) return NULL;
+    int32_t len = end - pos;
+    uint16_t *win = (uint16_t *)malloc(len * sizeof(uint16_t));
+    MALLOC_CHK(win);
+    const uint8_t *bases = (const uint8_t *)ref->forward + pos;
+    for(int32_t p = 0; p < len; p++) { // plain loops over bytes, vectorised by the compiler
+        win[p] = (uint16_t)(bases[p] << REF_WIN_BASE_SHIFT);
+    }
+    for(int m = 0; m < n_mods; m++) {
+        const uint8_t *ctx = (rev ? ref->is_context_rev[m] : ref->is_context[m]) + pos;
+        for(int32_t p = 0; p < len; p++) {
+            win[p] |= (uint16_t)(ctx[p] << m);
+        }
+    }
+    return win;
+}
+
+// context flag of a site, from the read's window if there is one
+static inline int is_ref_context(const ref_t *ref, const uint16_t *win, int32_t pos, int8_t rev, int mod_idx, int ref_pos) {
+    if(win) return (win[ref_pos - pos] >> mod_idx) & 1;
+    return rev ? ref->is_context_rev[mod_idx][ref_pos] : ref->is_context[mod_idx][ref_pos];
+}
+
+// forward reference base of a site, from the read's window if there is one
+static inline char ref_base(const ref_t *ref, const uint16_t *win, int32_t pos, int ref_pos) {
+    if(win) return (char)(win[ref_pos - pos] >> REF_WIN_BASE_SHIFT);
+    return ref->forward[ref_pos];
 }
 
 void freq_view_single(core_t * core, db_t *db, int32_t bam_i) {
     bam1_t *record = db->bam_recs[bam_i];
     // const char *qname = bam_get_qname(record);
     int8_t rev = bam_is_rev(record);
-    bam_hdr_t *hdr = core->bam_hdr;
+    bam_hdr_t *hdr = core->bam_hdrs[db->bam_idx[bam_i]];
     int32_t tid = record->core.tid;
     assert(tid < hdr->n_targets);
     const char *tname = (tid >= 0) ? hdr->target_name[tid] : "*";
@@ -960,41 +1470,46 @@ void freq_view_single(core_t * core, db_t *db, int32_t bam_i) {
     const char *mm_string = db->mm[bam_i];
     uint32_t ml_len = db->ml_lens[bam_i];
     uint8_t *ml = db->ml[bam_i];
-    int haplotype = core->opt.haplotypes ? get_hp_tag(record) : -1;
-    int * aln_pairs = db->aln[bam_i];
+    int haplotype = -1;
+    if(core->opt.haplotypes) { // read once, also used by merge_freq_maps and the read level view
+        db->hps[bam_i] = get_hp_tag(record);
+        haplotype = db->hps[bam_i];
+    }
+    prof_stat_t *ps = db->prof ? &db->prof[bam_i] : NULL; // only with --profile
 
-    // get the aligned positions and insertions
+    // get the aligned segments
+    double cigar_start = ps ? realtime() : 0;
     get_aln(core, db, hdr, record, bam_i);
-    
-    // 5 int arrays to keep base pos of A, C, G, T, N bases.
-    // A: 0, C: 1, G: 2, T: 3, U:4, N: 5
-    // so that, nth base of A is at base_pos[0][n] and so on.
-    int **bases_pos = db->bases_pos[bam_i];
-    int bases_pos_lens[N_BASES] = {0};
+    if(ps) {
+        ps->cigar_time = realtime() - cigar_start;
+        ps->bases = seq_len;
+    }
+    const aln_seg_t *segs = db->aln_segs[bam_i];
+    int n_segs = db->n_aln_segs[bam_i];
+    int32_t pos = record->core.pos;
+    int32_t end = bam_endpos(record);
+
     memset(db->mod_codes[bam_i], 0, core->opt.n_mods);
 
-    int i;
-    for(i=0;i<seq_len;i++){
-        int base_char = seq_nt16_str[bam_seqi(seq, i)];
-        int idx = base_idx_lookup[(int)base_char];
-        bases_pos[idx][bases_pos_lens[idx]++] = i;
-    }
+    // contexts are not checked with --insertions
+    uint16_t *ref_win = core->opt.insertions ? NULL : get_ref_window(ref, core->opt.n_mods, rev, pos, end);
+    pending_sites_t sites = {NULL, 0, 0};
+    // the per read maps of the outputs in use, the arrays of the others are not allocated
+    khash_t(freqm) *freq_map = HAS_OUTPUT(core->opt, FREQ) ? db->freq_maps[bam_i] : NULL;
+    khash_t(viewm) *view_map = HAS_OUTPUT(core->opt, VIEW) && !core->opt.read_level ? db->view_maps[bam_i] : NULL;
 
     int mm_str_len = strlen(mm_string);
-    i = 0;
+    int i = 0;
     int ml_start_idx = 0;
 
     char modbase;
     // char mod_strand;
     char * mod_codes = db->mod_codes[bam_i];
     int mod_codes_len;
-    int * skip_counts = db->skip_counts[bam_i];
-    int skip_counts_len;
     char status_flag;
 
     while (i < mm_str_len) {
-        // reset skip counts and mod codes
-        skip_counts_len = 0;
+        // reset mod codes
         mod_codes_len = 0;
 
         // set default status flag to '.' (when not present or '.' in the MM string)
@@ -1061,57 +1576,23 @@ void freq_view_single(core_t * core, db_t *db, int32_t bam_i) {
             status_flag = '.';
         }
 
-        // get skip counts
-        int k = 0;
-        while (i < mm_str_len && mm_string[i] != ';') {
+        // skip counts are parsed while walking the read, remember where they start for the skipped bases
+        int skip_counts_start = i;
 
-            // skip if a comma
-            if(i < mm_str_len && mm_string[i] == ',') {
-                i++;
-                continue;
-            }
+        char mb = rev? base_complement_lookup[(int)modbase] : modbase;
+        uint16_t base_mask = modbase == 'N' ? 0xffff : get_base_mask(mb); // N matches any base
 
-            char skip_count_str[10];
-            int l = 0;
-            while (i < mm_str_len && mm_string[i] != ',' && mm_string[i] != ';') {
-                skip_count_str[l] = mm_string[i];
-                i++;
-                l++;
-                assert(l < 10); // if this fails, use dynamic allocation for skip_count_str
-            }
-            skip_count_str[l] = '\0';
-            ASSERT_MSG(l > 0, "Invalid skip count:%d.\n", l);
-            sscanf(skip_count_str, "%d", &skip_counts[k]);
-            ASSERT_MSG(skip_counts[k] >= 0, "Skip count cannot be negative: %d.\n", skip_counts[k]);
-            
-            k++;
-        }
-        skip_counts_len = k;
-        i++;
+        base_cursor_t cursor;
+        init_base_cursor(&cursor, seq, seq_len, rev, base_mask);
 
-        char mb = rev? base_complement_lookup[(int)modbase] : modbase;
-        int idx = base_idx_lookup[(int)mb];
-        
         int ml_idx = ml_start_idx;
         int base_rank = -1; // 0-based rank
-        for(int c=0; c<skip_counts_len; c++) {
-            base_rank += skip_counts[c] + 1;
-
-            int read_pos;
+        int skip_count;
+        int c = 0;
+        while((skip_count = next_skip_count(mm_string, mm_str_len, &i)) >= 0) {
+            base_rank += skip_count + 1;
 
-            if (modbase == 'N') {
-                if(rev) {
-                    read_pos = seq_len - base_rank - 1;
-                } else {
-                    read_pos = base_rank;
-                }
-            } else {
-                if(rev) {
-                    read_pos = bases_pos[idx][bases_pos_lens[idx] - base_rank - 1];
-                } else {
-                    read_pos = bases_pos[idx][base_rank];
-                }
-            }
+            int read_pos = seek_base_cursor(&cursor, base_rank);
 
             ASSERT_MSG(read_pos>=0 && read_pos < seq_len, "Read pos cannot exceed seq len. read_pos: %d seq_len: %d\n", read_pos, seq_len);
 
@@ -1119,15 +1600,14 @@ void freq_view_single(core_t * core, db_t *db, int32_t bam_i) {
 
             int fastq_read_pos = rev ? (seq_len - read_pos -1) : read_pos;
 
-            int ref_pos = aln_pairs[fastq_read_pos];
-            if(core->opt.insertions) {
-                ref_pos = ref_pos == -1 ? db->ins[bam_i][fastq_read_pos] : ref_pos;
-            } 
+            int ins_offset = 0;
+            int ref_pos = get_aligned_ref_pos(segs, n_segs, fastq_read_pos, rev, pos, end);
+            if(core->opt.insertions && ref_pos == -1) {
+                ref_pos = get_inserted_ref_pos(segs, n_segs, fastq_read_pos, rev, pos, end, &ins_offset);
+            }
 
             if(ref_pos == -1) { // not aligned nor insertion
-                if(mod_codes_len > 0) {
-                    ml_idx = ml_start_idx + c*mod_codes_len + mod_codes_len - 1;
-                }
+                c++;
                 continue;
             }
 
@@ -1159,25 +1639,25 @@ void freq_view_single(core_t * core, db_t *db, int32_t bam_i) {
 
                 modcodem_t *req_mod = kh_value(core->opt.modcodes_map, mk);
 
-                int req_all_contexts = strcmp(req_mod->context, WILDCARD_STR) == 0;
-                int is_in_context = (rev && ref->is_context_rev[req_mod->index][ref_pos]) || (!rev && ref->is_context[req_mod->index][ref_pos]);
-                int matches_reference = req_all_contexts || mb == 'N' || ref->forward[ref_pos] == read_base;
-
-
-                if(core->opt.insertions) { // no need to check context for insertions
-
-                } else if (is_in_context && matches_reference) { // in context and mod_base matches reference
-                } else {
-                    continue;
+                if(!core->opt.insertions) { // no need to check context for insertions
+                    int req_all_contexts = strcmp(req_mod->context, WILDCARD_STR) == 0;
+                    int is_in_context = is_ref_context(ref, ref_win, pos, rev, req_mod->index, ref_pos);
+                    int matches_reference = req_all_contexts || mb == 'N' || ref_base(ref, ref_win, pos, ref_pos) == read_base;
+                    if(!(is_in_context && matches_reference)) { // not in context or mod_base does not match reference
+                        continue;
+                    }
                 }
 
                 ASSERT_MSG(ml_idx<ml_len, "read_id:%s mod prob index mismatch. ml_idx:%d ml_len:%d \n", bam_get_qname(record), ml_idx, ml_len);
                 uint8_t mod_prob = ml[ml_idx];
                 ASSERT_MSG(mod_prob <= 255 && mod_prob>=0, "Invalid mod_prob:%d\n", mod_prob);
 
-                int ins_offset = core->opt.insertions ? db->ins_offset[bam_i][fastq_read_pos] : 0;
-                if(core->opt.subtool == FREQ) {
-                    uint8_t is_mod = 0, is_called = 0;
+                if(HAS_OUTPUT(core->opt, VIEW) && core->opt.read_level) {
+                    add_read_mod(&db->read_mods[bam_i], &db->n_read_mods[bam_i], &db->cap_read_mods[bam_i], mod_code, mod_prob, req_mod->thresh, ps);
+                }
+
+                uint8_t is_mod = 0, is_called = 0;
+                if(HAS_OUTPUT(core->opt, FREQ)) {
                     double thresh = req_mod->thresh;
                     double mod_prob_dbl = THRESH_UINT8_TO_DBL(mod_prob);
                     
@@ -1186,121 +1666,49 @@ void freq_view_single(core_t * core, db_t *db, int32_t bam_i) {
                         is_mod = 1;
                     } else if(mod_prob_dbl <= 1 - thresh){ // not modified with mod_code
                         is_called = 1;
-                    } else { // ambiguous
-                        continue;
-                    }
-                    
-                    update_freq_map(db->freq_maps[bam_i], tname, ref_pos, ins_offset, mod_code, strand, haplotype, is_called, is_mod);
-                } else if (core->opt.subtool == VIEW) {
-                    add_view_entry(db->view_maps[bam_i], tname, ref_pos, ins_offset, mod_code, strand, haplotype, mod_prob, fastq_read_pos);
+                    } // else ambiguous, not counted
+                }
+
+                int to_view = HAS_OUTPUT(core->opt, VIEW) && !core->opt.read_level;
+                if(is_called || to_view) {
+                    gather_site(&sites, mod_code, ref_pos, ins_offset, fastq_read_pos, mod_prob, is_mod, is_called, to_view);
                 }
             }
+            c++;
 
         }
-        if(skip_counts_len > 0) ml_start_idx = ml_idx + 1;
+        int skip_counts_len = c;
+        i++;
+        ml_start_idx += skip_counts_len*mod_codes_len;
 
-        // skipped bases
+        // skipped bases, walked after the explicit bases so that entries are added in the same order as before
         if (status_flag == '.') {
-            int skip_base_rank = -1; // 0-based rank
-            int prev_skip_base_rank = -1; 
-            for(int c=0; c<skip_counts_len; c++) {
-                skip_base_rank += skip_counts[c] + 1;
-            
-                // modification probability is 0 for skipped bases
-                for(int s=prev_skip_base_rank+1; s<skip_base_rank; s++) {
-                    int skip_read_pos;
-                    if (modbase == 'N') {
-                        if(rev) {
-                            skip_read_pos = seq_len - s - 1;
-                        } else {
-                            skip_read_pos = s;
-                        }
+            // for N, skipped bases after the last skip count are only taken up to the number of N bases in the read
+            int last_rank = modbase == 'N' ? count_bases(seq, seq_len, get_base_mask('N')) : INT32_MAX;
+            int skip_i = skip_counts_start;
+            int next_explicit_rank = next_skip_count(mm_string, mm_str_len, &skip_i);
+            int explicit_rank = next_explicit_rank;
+
+            init_base_cursor(&cursor, seq, seq_len, rev, base_mask);
+            int s = 0;
+            for(s = 0; ; s++) {
+                if(s == explicit_rank) { // not a skipped base
+                    next_explicit_rank = next_skip_count(mm_string, mm_str_len, &skip_i);
+                    if(next_explicit_rank >= 0) {
+                        explicit_rank += next_explicit_rank + 1;
                     } else {
-                        if(rev) {
-                            skip_read_pos = bases_pos[idx][bases_pos_lens[idx] - s - 1];
-                        } else {
-                            skip_read_pos = bases_pos[idx][s];
-                        }
-                    }
-
-                    ASSERT_MSG(skip_read_pos>=0 && skip_read_pos < seq_len, "Read pos cannot exceed seq len. read_pos: %d seq_len: %d\n", skip_read_pos, seq_len);
-
-                    char skip_read_base = seq_nt16_str[bam_seqi(seq, skip_read_pos)];
-
-                    int skip_fastq_read_pos = rev ? (seq_len - skip_read_pos -1) : skip_read_pos;
-
-                    int skip_ref_pos = aln_pairs[skip_fastq_read_pos];
-                    if(core->opt.insertions) {
-                        skip_ref_pos = skip_ref_pos == -1 ? db->ins[bam_i][skip_read_pos] : skip_ref_pos;
-                    }
-
-                    if(skip_ref_pos == -1) { // not aligned nor insertion
-                        continue;
-                    }
-
-                    // mod prob per each mod code.
-                    for(int m=0; m<mod_codes_len; m++) {
-
-                        // check required mod codes
-                        khint_t mk;
-
-                        mk = kh_get(modcodesm, core->opt.modcodes_map, WILDCARD_STR); // check for wildcard first
-                        char * mod_code = NULL;
-                        if (has_nums) { // chebi id
-                            mod_code = mod_codes;
-                        } else { // not chebi id, need to check for each mod code
-                            mod_code = &(mod_codes[m]);
-                        }
-                        if (mk != kh_end(core->opt.modcodes_map)) { // wildcard present, all mod codes are required
-                            // do nothing, just proceed
-                        } else {
-                            mk = kh_get(modcodesm, core->opt.modcodes_map, mod_code);
-                            if(mk == kh_end(core->opt.modcodes_map)) {
-                                continue; // mod code not required
-                            }
-                        }
-
-                        modcodem_t *req_mod = kh_value(core->opt.modcodes_map, mk);
-
-                        int req_all_contexts = strcmp(req_mod->context, WILDCARD_STR) == 0;
-                        int skip_is_in_context = (rev && ref->is_context_rev[req_mod->index][skip_ref_pos]) || (!rev && ref->is_context[req_mod->index][skip_ref_pos]);
-                        int skip_matches_reference = req_all_contexts || mb == 'N' || ref->forward[skip_ref_pos] == skip_read_base;
-
-                        if(core->opt.insertions) { // no need to check context for insertions
-
-                        } else if (skip_is_in_context && skip_matches_reference) { // in context and mod_base matches reference
-                        } else {
-                            continue;
-                        }
-
-                        int ins_offset = core->opt.insertions ? db->ins_offset[bam_i][skip_fastq_read_pos] : 0;
-
-                        if(core->opt.subtool == FREQ) {
-                            uint8_t is_mod = 0, is_called = 1; // skipped bases are called as unmodified
-                            update_freq_map(db->freq_maps[bam_i], tname, skip_ref_pos, ins_offset, mod_code, strand, haplotype, is_called, is_mod);
-                        } else if (core->opt.subtool == VIEW) {
-                            add_view_entry(db->view_maps[bam_i], tname, skip_ref_pos, ins_offset, mod_code, strand, haplotype, 0, skip_fastq_read_pos);
-                        }
+                        explicit_rank = -1; // past the last skip count
                     }
+                    continue;
+                }
+                if(explicit_rank == -1 && s >= last_rank) {
+                    break;
                 }
-                prev_skip_base_rank = skip_base_rank;
-            }
 
-            // handle skipped bases after the last skip count
-            for(int s=prev_skip_base_rank+1; s<bases_pos_lens[idx]; s++) {
-                int skip_read_pos;
-                if (modbase == 'N') {
-                    if(rev) {
-                        skip_read_pos = seq_len - s - 1;
-                    } else {
-                        skip_read_pos = s;
-                    }
-                } else {
-                    if(rev) {
-                        skip_read_pos = bases_pos[idx][bases_pos_lens[idx] - s - 1];
-                    } else {
-                        skip_read_pos = bases_pos[idx][s];
-                    }
+                int skip_read_pos = seek_base_cursor(&cursor, s);
+                if(skip_read_pos < 0) { // no more bases of this kind
+                    ASSERT_MSG(explicit_rank == -1, "Read pos cannot exceed seq len. read_pos: %d seq_len: %d\n", skip_read_pos, seq_len);
+                    break;
                 }
 
                 ASSERT_MSG(skip_read_pos>=0 && skip_read_pos < seq_len, "Read pos cannot exceed seq len. read_pos: %d seq_len: %d\n", skip_read_pos, seq_len);
@@ -1309,9 +1717,13 @@ void freq_view_single(core_t * core, db_t *db, int32_t bam_i) {
 
                 int skip_fastq_read_pos = rev ? (seq_len - skip_read_pos -1) : skip_read_pos;
 
-                int skip_ref_pos = aln_pairs[skip_fastq_read_pos];
-                if(core->opt.insertions) {
-                    skip_ref_pos = skip_ref_pos == -1 ? db->ins[bam_i][skip_read_pos] : skip_ref_pos;
+                int skip_ins_offset = 0;
+                int skip_ref_pos = get_aligned_ref_pos(segs, n_segs, skip_fastq_read_pos, rev, pos, end);
+                if(core->opt.insertions && skip_ref_pos == -1) {
+                    // anchor is taken at skip_read_pos and the offset at skip_fastq_read_pos, as with the former per base arrays
+                    int anchor_offset;
+                    skip_ref_pos = get_inserted_ref_pos(segs, n_segs, skip_read_pos, rev, pos, end, &anchor_offset);
+                    get_inserted_ref_pos(segs, n_segs, skip_fastq_read_pos, rev, pos, end, &skip_ins_offset);
                 }
 
                 if(skip_ref_pos == -1) { // not aligned nor insertion
@@ -1342,60 +1754,146 @@ void freq_view_single(core_t * core, db_t *db, int32_t bam_i) {
 
                     modcodem_t *req_mod = kh_value(core->opt.modcodes_map, mk);
 
-                    int req_all_contexts = strcmp(req_mod->context, WILDCARD_STR) == 0;
-                    int skip_is_in_context = (rev && ref->is_context_rev[req_mod->index][skip_ref_pos]) || (!rev && ref->is_context[req_mod->index][skip_ref_pos]);
-                    int skip_matches_reference = req_all_contexts || mb == 'N' || ref->forward[skip_ref_pos] == skip_read_base;
-
-                    if(core->opt.insertions) { // no need to check context for insertions
-
-                    } else if (skip_is_in_context && skip_matches_reference) { // in context and mod_base matches reference
-                    } else {
-                        continue;
+                    if(!core->opt.insertions) { // no need to check context for insertions
+                        int req_all_contexts = strcmp(req_mod->context, WILDCARD_STR) == 0;
+                        int skip_is_in_context = is_ref_context(ref, ref_win, pos, rev, req_mod->index, skip_ref_pos);
+                        int skip_matches_reference = req_all_contexts || mb == 'N' || ref_base(ref, ref_win, pos, skip_ref_pos) == skip_read_base;
+                        if(!(skip_is_in_context && skip_matches_reference)) { // not in context or mod_base does not match reference
+                            continue;
+                        }
                     }
 
-                    int ins_offset = core->opt.insertions ? db->ins_offset[bam_i][skip_fastq_read_pos] : 0;
-
-                    if(core->opt.subtool == FREQ) {
-                        uint8_t is_mod = 0, is_called = 1; // skipped bases are called as unmodified
-                        update_freq_map(db->freq_maps[bam_i], tname, skip_ref_pos, ins_offset, mod_code, strand, haplotype, is_called, is_mod);
-                    } else if (core->opt.subtool == VIEW) {
-                        add_view_entry(db->view_maps[bam_i], tname, skip_ref_pos, ins_offset, mod_code, strand, haplotype, 0, skip_fastq_read_pos);
+                    // skipped bases are called as unmodified
+                    int to_freq = HAS_OUTPUT(core->opt, FREQ);
+                    int to_view = HAS_OUTPUT(core->opt, VIEW) && !core->opt.read_level;
+                    if (HAS_OUTPUT(core->opt, VIEW) && core->opt.read_level) {
+                        add_read_mod(&db->read_mods[bam_i], &db->n_read_mods[bam_i], &db->cap_read_mods[bam_i], mod_code, 0, req_mod->thresh, ps);
+                    }
+                    if (to_freq || to_view) {
+                        gather_site(&sites, mod_code, skip_ref_pos, skip_ins_offset, skip_fastq_read_pos, 0, 0, to_freq, to_view);
                     }
                 }
             }
         
         }
-        
+
+        // mod_code of the gathered sites points into mod_codes, which the next MM group overwrites
+        commit_sites(freq_map, view_map, tname, strand, haplotype, &sites, ps);
     }
+
+    free(sites.a);
+    free(ref_win);
 }
 
 void print_summary_header(core_t* core) {
-    fprintf(core->opt.output_fp, "read_id\t modifications\n");
+    if(core->opt.ml_hist){
+        fprintf(sink_fp(&core->opt, SUMMARY), "read_id\tread_len\tmod_base\tmod_code\tn_sites\tn_called\tn_mod\tfrac_called\tfrac_mod\tsites_per_kb\n");
+        return;
+    }
+    fprintf(sink_fp(&core->opt, SUMMARY), "read_id\t modifications\n");
+}
+
+// find or add the histogram of mod_base and mod_code in a growable array
+static modhist_t *get_mod_hist(modhist_t **hists, int *n_hists, int *cap_hists, char mod_base, const char *mod_code) {
+    for(int i = 0; i < *n_hists; i++) {
+        modhist_t *h = &(*hists)[i];
+        if(h->mod_base == mod_base && strcmp(h->mod_code, mod_code) == 0) {
+            return h;
+        }
+    }
+    if(*n_hists == *cap_hists) {
+        *cap_hists = *cap_hists ? *cap_hists * 2 : 4;
+        *hists = (modhist_t *)realloc(*hists, sizeof(modhist_t) * (*cap_hists));
+        MALLOC_CHK(*hists);
+    }
+    modhist_t *h = &(*hists)[(*n_hists)++];
+    memset(h, 0, sizeof(modhist_t));
+    h->mod_base = mod_base;
+    strncpy(h->mod_code, mod_code, MOD_CODE_LEN);
+    h->mod_code[MOD_CODE_LEN] = '\0';
+    return h;
+}
+
+static void print_ml_hist_output(core_t* core, db_t* db) {
+    FILE *out_fp = sink_fp(&core->opt, SUMMARY);
+
+    for(int i = 0; i < db->n_bam_recs; i++) {
+        bam1_t *record = db->bam_recs[i];
+        const char *qname = bam_get_qname(record);
+        int32_t read_len = record->core.l_qseq;
+
+        for(int j = 0; j < db->n_ml_counts[i]; j++) {
+            mlcount_t *rc = &db->ml_counts[i * ML_HIST_READ_CODES + j];
+            double frac_called = rc->n_sites ? (double)rc->n_called / rc->n_sites : 0;
+            double frac_mod = rc->n_called ? (double)rc->n_mod / rc->n_called : 0;
+            double sites_per_kb = rc->n_sites * 1000.0 / read_len;
+            fprintf(out_fp, "%s\t%d\t%c\t%s\t%lu\t%lu\t%lu\t%f\t%f\t%f\n", qname, read_len, rc->mod_base, rc->mod_code, (unsigned long)rc->n_sites, (unsigned long)rc->n_called, (unsigned long)rc->n_mod, frac_called, frac_mod, sites_per_kb);
+
+            // aggregate over the run
+            modhist_t *run = get_mod_hist(&core->mod_hists, &core->n_mod_hists, &core->cap_mod_hists, rc->mod_base, rc->mod_code);
+            run->n_reads++;
+            run->n_sites += rc->n_sites;
+            run->n_called += rc->n_called;
+            run->n_mod += rc->n_mod;
+        }
+        core->ml_hist_bases += read_len;
+    }
+
+    // the ML values were binned per processing thread. emptied once folded, as the db is reused for the next batch
+    for(int t = 0; t < core->opt.num_thread; t++) {
+        for(int j = 0; j < db->n_thread_hists[t]; j++) {
+            modhist_t *h = &db->thread_hists[t][j];
+            modhist_t *run = get_mod_hist(&core->mod_hists, &core->n_mod_hists, &core->cap_mod_hists, h->mod_base, h->mod_code);
+            for(int b = 0; b < ML_HIST_BINS; b++) {
+                run->hist[b] += h->hist[b];
+            }
+        }
+        db->n_thread_hists[t] = 0; // get_mod_hist zeroes an entry when it is taken again
+    }
+}
+
+/* write the run level ML histograms and a one line summary per mod code to stderr */
+void print_ml_hist(core_t* core) {
+    FILE *fp = core->opt.ml_hist_fp;
+    fprintf(fp, "mod_base\tmod_code\tml\tmod_prob\tcount\n");
+    for(int i = 0; i < core->n_mod_hists; i++) {
+        modhist_t *h = &core->mod_hists[i];
+        for(int b = 0; b < ML_HIST_BINS; b++) {
+            fprintf(fp, "%c\t%s\t%d\t%f\t%lu\n", h->mod_base, h->mod_code, b, THRESH_UINT8_TO_DBL(b), (unsigned long)h->hist[b]);
+        }
+        fprintf(stderr, "[%s] %c|%s: %u reads, %lu sites, %.3f called at %.2f, %.3f modified, %.2f sites/kb\n", __func__,
+                h->mod_base, h->mod_code, h->n_reads, (unsigned long)h->n_sites,
+                h->n_sites ? (double)h->n_called / h->n_sites : 0, core->opt.ml_thresh,
+                h->n_called ? (double)h->n_mod / h->n_called : 0,
+                core->ml_hist_bases ? h->n_sites * 1000.0 / core->ml_hist_bases : 0);
+    }
 }
 
 void print_summary_output(core_t* core, db_t* db) {
-    
+
+    if(core->opt.ml_hist){
+        print_ml_hist_output(core, db);
+        return;
+    }
+
+    FILE *out_fp = sink_fp(&core->opt, SUMMARY);
     for(int i =0; i < db->n_bam_recs; i++) {
         bam1_t *record = db->bam_recs[i];
         const char *qname = bam_get_qname(record);
         khash_t(summarym) *summary_map = db->summary_maps[i];
 
-        fprintf(core->opt.output_fp, "%s\t", qname);
+        fprintf(out_fp, "%s\t", qname);
 
         khint_t k;
         for (k = kh_begin(summary_map); k != kh_end(summary_map); k++) {
             if (kh_exist(summary_map, k)) {
                 char * key = (char *) kh_key(summary_map, k);
-                fprintf(core->opt.output_fp, "%s ", key);
+                fprintf(out_fp, "%s ", key);
             }
 
         }
 
-        fprintf(core->opt.output_fp, "\n");
-    }
-
-    if(core->opt.output_fp != stdout){
-        fclose(core->opt.output_fp);
+        fprintf(out_fp, "\n");
     }
 }
 
@@ -1423,33 +1921,70 @@ static void add_summary_entry(khash_t(summarym) *summary_map, char mod_base, cha
     
 }
 
+// find or add the ML counts of mod_base and mod_code in the fixed slots of a read
+static mlcount_t *get_ml_count(db_t *db, int32_t bam_i, char mod_base, const char *mod_code) {
+    mlcount_t *counts = &db->ml_counts[bam_i * ML_HIST_READ_CODES];
+    int *n = &db->n_ml_counts[bam_i];
+    for(int i = 0; i < *n; i++) {
+        if(counts[i].mod_base == mod_base && strcmp(counts[i].mod_code, mod_code) == 0) {
+            return &counts[i];
+        }
+    }
+    if(*n == ML_HIST_READ_CODES) {
+        ERROR("Read %s has more than %d modification codes, which --ml-hist does not support. Please report this issue.", bam_get_qname(db->bam_recs[bam_i]), ML_HIST_READ_CODES);
+        exit(EXIT_FAILURE);
+    }
+    mlcount_t *rc = &counts[(*n)++];
+    memset(rc, 0, sizeof(mlcount_t));
+    rc->mod_base = mod_base;
+    strncpy(rc->mod_code, mod_code, MOD_CODE_LEN);
+    rc->mod_code[MOD_CODE_LEN] = '\0';
+    return rc;
+}
+
+// count the ML values of a MM group into the read's counts and the histograms of the processing thread
+static void add_ml_hist_entries(core_t * core, db_t *db, int32_t bam_i, char mod_base, char * mod_codes, int mod_codes_len, int has_nums, int ml_start_idx, int skip_counts_len) {
+    uint8_t *ml = db->ml[bam_i];
+    uint32_t ml_len = db->ml_lens[bam_i];
+    double thresh = core->opt.ml_thresh;
+    int32_t t = db->rec_threads[bam_i];
+
+    ASSERT_MSG(ml_start_idx + skip_counts_len * mod_codes_len <= ml_len, "read_id:%s mod prob index mismatch. ml_idx:%d ml_len:%d \n", bam_get_qname(db->bam_recs[bam_i]), ml_start_idx + skip_counts_len * mod_codes_len, ml_len);
+
+    for(int m = 0; m < mod_codes_len; m++) {
+        char code[2] = {mod_codes[m], '\0'};
+        const char *mod_code = has_nums ? mod_codes : code;
+        mlcount_t *rc = get_ml_count(db, bam_i, mod_base, mod_code);
+        modhist_t *h = get_mod_hist(&db->thread_hists[t], &db->n_thread_hists[t], &db->cap_thread_hists[t], mod_base, mod_code);
+        for(int c = 0; c < skip_counts_len; c++) {
+            uint8_t mod_prob = ml[ml_start_idx + c * mod_codes_len + m];
+            double mod_prob_dbl = THRESH_UINT8_TO_DBL(mod_prob);
+            h->hist[mod_prob]++;
+            if(mod_prob_dbl >= thresh) { // same calling rule as freq
+                rc->n_called++;
+                rc->n_mod++;
+            } else if(mod_prob_dbl <= 1 - thresh) {
+                rc->n_called++;
+            }
+        }
+        rc->n_sites += skip_counts_len;
+    }
+}
+
 void summary_single(core_t * core, db_t *db, int32_t bam_i) {
     bam1_t *record = db->bam_recs[bam_i];
     // int8_t rev = bam_is_rev(record);
-    bam_hdr_t *hdr = core->bam_hdr;
+    bam_hdr_t *hdr = core->bam_hdrs[db->bam_idx[bam_i]];
     int32_t tid = record->core.tid;
     assert(tid < hdr->n_targets);
-    uint8_t *seq = bam_get_seq(record);
-    uint32_t seq_len = record->core.l_qseq;
     // char strand = rev ? '-' : '+';
     const char *mm_string = db->mm[bam_i];
-    
-    // 5 int arrays to keep base pos of A, C, G, T, N bases.
-    // A: 0, C: 1, G: 2, T: 3, U:4, N: 5
-    // so that, nth base of A is at base_pos[0][n] and so on.
-    int **bases_pos = db->bases_pos[bam_i];
-    int bases_pos_lens[N_BASES] = {0};
-    memset(db->mod_codes[bam_i], 0, MOD_CODE_LEN);
 
-    int i;
-    for(i=0;i<seq_len;i++){
-        int base_char = seq_nt16_str[bam_seqi(seq, i)];
-        int idx = base_idx_lookup[(int)base_char];
-        bases_pos[idx][bases_pos_lens[idx]++] = i;
-    }
+    memset(db->mod_codes[bam_i], 0, MOD_CODE_LEN);
 
     int mm_str_len = strlen(mm_string);
-    i = 0;
+    int i = 0;
+    int ml_start_idx = 0;
 
     char modbase;
     // char mod_strand;  // commented for now. might need to revisit
@@ -1551,6 +2086,12 @@ void summary_single(core_t * core, db_t *db, int32_t bam_i) {
             continue;
         }
 
+        if(core->opt.ml_hist) {
+            add_ml_hist_entries(core, db, bam_i, modbase, mod_codes, mod_codes_len, has_nums, ml_start_idx, skip_counts_len);
+            ml_start_idx += skip_counts_len * mod_codes_len;
+            continue;
+        }
+
         add_summary_entry(db->summary_maps[bam_i], modbase, mod_codes, status_flag);
     }
 }
\ No newline at end of file
@@ -43,6 +43,7 @@ typedef struct {
     view_t *view;
 } view_kv_t;
 
+char* make_key(const char *chrom, int pos, uint16_t ins_offset, char * mod_code, char strand, int haplotype);
 uint16_t *get_mod_tag(bam1_t *record, char *tag, uint32_t *len_ptr);
 const char *get_mm_tag_ptr(bam1_t *record);
 uint8_t *get_ml_tag(bam1_t *record, uint32_t *len_ptr);
@@ -51,10 +52,12 @@ void summary_single(core_t * core, db_t *db, int32_t bam_i);
 void merge_freq_maps(core_t* core, db_t* db);
 void print_freq_header(core_t * core);
 void print_freq_output(core_t* core);
+void print_freq_site(core_t * core, const char *contig, int ref_pos, char strand, const char *mod_code, uint16_t ins_offset, int haplotype, freq_t *freq);
 void print_view_header(core_t* core);
 void print_view_output(core_t* core, db_t* db);
 void print_summary_header(core_t* core);
 void print_summary_output(core_t* core, db_t* db);
+void print_ml_hist(core_t* core);
 void destroy_freq_map(khash_t(freqm)* freq_map);
 void parse_mod_codes(opt_t *opt);
 void parse_mod_threshes(opt_t * opt);
@@ -0,0 +1,120 @@
+/**
+ * @file profile.c
+ * @brief per-thread and per-stage profiling report
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+
+#include "profile.h"
+#include "minimod.h"
+#include "misc.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+profile_t *profile_init(int32_t n_threads) {
+    profile_t *prof = (profile_t *)malloc(sizeof(profile_t));
+    MALLOC_CHK(prof);
+    prof->threads = (prof_stat_t *)calloc(n_threads, sizeof(prof_stat_t));
+    MALLOC_CHK(prof->threads);
+    prof->n_threads = n_threads;
+    prof->batches = 0;
+    return prof;
+}
+
+void profile_add(prof_stat_t *dst, const prof_stat_t *src) {
+    dst->reads += src->reads;
+    dst->bases += src->bases;
+    dst->sites += src->sites;
+    dst->hash_lookups += src->hash_lookups;
+    dst->allocs += src->allocs;
+    dst->busy_time += src->busy_time;
+    dst->cigar_time += src->cigar_time;
+    dst->hash_time += src->hash_time;
+}
+
+static void write_stat(FILE *fp, const prof_stat_t *s) {
+    // MM parsing, walking the read and the context checks are what is left of the per read time
+    double mm_time = s->busy_time - s->cigar_time - s->hash_time;
+    fprintf(fp, "\"reads\": %lu, \"bases\": %lu, \"sites\": %lu, \"hash_lookups\": %lu, \"allocs\": %lu, ",
+            (unsigned long)s->reads, (unsigned long)s->bases, (unsigned long)s->sites,
+            (unsigned long)s->hash_lookups, (unsigned long)s->allocs);
+    fprintf(fp, "\"busy_s\": %.6f, \"cigar_s\": %.6f, \"mm_s\": %.6f, \"hash_s\": %.6f, \"reads_per_s\": %.1f",
+            s->busy_time, s->cigar_time, mm_time > 0 ? mm_time : 0, s->hash_time,
+            s->busy_time > 0 ? s->reads / s->busy_time : 0);
+}
+
+/* the report is a single JSON object: run settings, main thread stage times, then one entry per processing thread */
+void profile_write(core_t *core, const char *file) {
+    profile_t *prof = core->prof;
+    FILE *fp = fopen(file, "w");
+    F_CHK(fp, file);
+
+    const char *subtool = core->opt.subtool == FREQ ? "freq" : core->opt.subtool == VIEW ? "view" : core->opt.subtool == MULTI ? "multi" : "summary";
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"version\": \"%s\",\n", MINIMOD_VERSION);
+    fprintf(fp, "  \"subtool\": \"%s\",\n", subtool);
+    fprintf(fp, "  \"threads\": %d,\n", core->opt.num_thread);
+    fprintf(fp, "  \"batch_size\": %d,\n", core->batch_size);
+    fprintf(fp, "  \"batch_size_bases\": %ld,\n", (long)core->batch_size_bases);
+    fprintf(fp, "  \"batches\": %ld,\n", (long)prof->batches);
+    fprintf(fp, "  \"reads\": %lu,\n", (unsigned long)core->processed_reads);
+    fprintf(fp, "  \"bytes\": %lu,\n", (unsigned long)core->processed_bytes);
+    fprintf(fp, "  \"wall_s\": %.3f,\n", realtime() - core->realtime0);
+    fprintf(fp, "  \"cpu_s\": %.3f,\n", cputime());
+    fprintf(fp, "  \"peak_rss_mb\": %.1f,\n", peakrss() / (1024.0 * 1024.0));
+
+    fprintf(fp, "  \"stages\": {\"load_s\": %.6f, \"process_s\": %.6f, \"merge_s\": %.6f, \"sort_s\": %.6f, \"output_s\": %.6f},\n",
+            core->load_db_time, core->process_db_time, core->merge_db_time, core->sort_time, core->output_time);
+
+    prof_stat_t total;
+    memset(&total, 0, sizeof(prof_stat_t));
+    fprintf(fp, "  \"workers\": [\n");
+    for (int32_t t = 0; t < prof->n_threads; t++) {
+        fprintf(fp, "    {\"thread\": %d, ", t);
+        write_stat(fp, &prof->threads[t]);
+        fprintf(fp, "}%s\n", t < prof->n_threads - 1 ? "," : "");
+        profile_add(&total, &prof->threads[t]);
+    }
+    fprintf(fp, "  ],\n");
+
+    fprintf(fp, "  \"total\": {");
+    write_stat(fp, &total);
+    fprintf(fp, "}\n");
+    fprintf(fp, "}\n");
+
+    fclose(fp);
+    INFO("Profile written to %s", file);
+}
+
+void profile_destroy(profile_t *prof) {
+    if (prof == NULL) {
+        return;
+    }
+    free(prof->threads);
+    free(prof);
+}
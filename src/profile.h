@@ -0,0 +1,67 @@
+/**
+ * @file profile.h
+ * @brief per-thread and per-stage profiling report
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include "minimod.h"
+
+/*
+ * Opt-in profiling, enabled with --profile FILE. Each processing thread sums the stats of the reads it
+ * worked on into its own slot, so no locking is needed. Stage times are only taken when profiling is on.
+ */
+
+/* counters and stage times of a read, or summed over the reads of a thread */
+struct prof_stat_s {
+    uint64_t reads;
+    uint64_t bases;
+    uint64_t sites; // entries added to the freq or view maps
+    uint64_t hash_lookups; // kh_get and kh_put calls on the maps
+    uint64_t allocs; // keys and map values allocated
+    double busy_time; // whole of the per read work
+    double cigar_time; // CIGAR walking
+    double hash_time; // key building and map updates
+};
+
+struct profile_s {
+    struct prof_stat_s *threads; // one per processing thread
+    int32_t n_threads;
+    int64_t batches;
+};
+
+/* prof_stat_t and profile_t are typedef'd in minimod.h, which core_t needs them for */
+
+profile_t *profile_init(int32_t n_threads);
+void profile_add(prof_stat_t *dst, const prof_stat_t *src);
+void profile_write(core_t *core, const char *file);
+void profile_destroy(profile_t *prof);
+
+#endif
@@ -228,6 +228,18 @@ void load_ref_contexts(int n_mod_codes, char ** mod_contexts) {
     free(rev_mod_contexts);
 }
 
+/* bytes held by the reference and its context masks, a forward and a reverse mask per mod code */
+int64_t ref_mem(int n_mod_codes) {
+    int64_t bytes = 0;
+    for (khiter_t k = kh_begin(ref_map); k != kh_end(ref_map); ++k) {
+        if (kh_exist(ref_map, k)) {
+            ref_t * ref = kh_value(ref_map, k);
+            bytes += (int64_t)ref->ref_seq_length * (1 + 2 * n_mod_codes) + sizeof(ref_t);
+        }
+    }
+    return bytes;
+}
+
 void destroy_ref_forward() {
     khiter_t k;
     for (k = kh_begin(ref_map); k != kh_end(ref_map); ++k) {
@@ -45,5 +45,6 @@ void destroy_ref(int n_mod_codes);
 ref_t * get_ref(const char * chr);
 void load_ref_contexts(int n_mod_codes, char ** mod_contexts);
 void destroy_ref_forward();
+int64_t ref_mem(int n_mod_codes);
 
 #endif
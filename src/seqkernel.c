@@ -0,0 +1,194 @@
+/**
+ * @file seqkernel.c
+ * @brief scalar, SSE2 and NEON sequence kernels and runtime dispatch
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+#include "seqkernel.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/* scalar */
+
+int32_t seq_count_base_scalar(const uint8_t *seq, int32_t start, int32_t end, uint16_t mask) {
+    int32_t count = 0;
+    for(int32_t i = start; i < end; i++) {
+        count += (mask >> SEQ_NIBBLE(seq, i)) & 1;
+    }
+    return count;
+}
+
+static const seqkernel_t scalar_kernel = {
+    "scalar",
+    seq_count_base_scalar
+};
+
+/* SSE2, 16 bases (8 packed bytes) per step */
+
+#if defined(__SSE2__)
+
+// nibbles of 8 packed bytes to 16 code bytes in read order
+static inline __m128i sse2_unpack16(const uint8_t *p) {
+    __m128i x = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128()); // 0x00XY per 16 bit lane
+    __m128i hi = _mm_srli_epi16(x, 4);
+    __m128i lo = _mm_slli_epi16(_mm_and_si128(x, _mm_set1_epi16(0x0f)), 8);
+    return _mm_or_si128(hi, lo);
+}
+
+// no byte shuffle in SSE2, compare against each code in the mask (or its complement, whichever is shorter)
+typedef struct {
+    __m128i codes[8];
+    int n;
+    int invert;
+} sse2_matcher_t;
+
+static inline void sse2_matcher_init(sse2_matcher_t *mt, uint16_t mask) {
+    mt->invert = __builtin_popcount(mask) > 8;
+    uint16_t m = mt->invert ? (uint16_t)~mask : mask;
+    mt->n = 0;
+    while(m) {
+        mt->codes[mt->n++] = _mm_set1_epi8((char)__builtin_ctz(m));
+        m &= m - 1;
+    }
+}
+
+// bit i set if base i of the 16 matches
+static inline uint32_t sse2_match16(const sse2_matcher_t *mt, __m128i codes) {
+    __m128i eq = _mm_setzero_si128();
+    for(int j = 0; j < mt->n; j++) {
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi8(codes, mt->codes[j]));
+    }
+    uint32_t bits = (uint32_t)_mm_movemask_epi8(eq);
+    return mt->invert ? ~bits & 0xffff : bits;
+}
+
+static int32_t seq_count_base_sse2(const uint8_t *seq, int32_t start, int32_t end, uint16_t mask) {
+    int32_t count = 0;
+    int32_t i = start;
+    if((i & 1) && i < end) {
+        count += (mask >> SEQ_NIBBLE(seq, i)) & 1;
+        i++;
+    }
+    sse2_matcher_t mt;
+    sse2_matcher_init(&mt, mask);
+    for(; i + 16 <= end; i += 16) {
+        count += __builtin_popcount(sse2_match16(&mt, sse2_unpack16(seq + (i >> 1))));
+    }
+    return count + seq_count_base_scalar(seq, i, end, mask);
+}
+
+static const seqkernel_t sse2_kernel = {
+    "sse2",
+    seq_count_base_sse2
+};
+
+#endif
+
+/* NEON (aarch64), 16 bases (8 packed bytes) per step */
+
+#if defined(__aarch64__)
+
+static inline uint8x16_t neon_unpack16(const uint8_t *p) {
+    uint8x8_t x = vld1_u8(p);
+    uint8x8x2_t z = vzip_u8(vshr_n_u8(x, 4), vand_u8(x, vdup_n_u8(0x0f)));
+    return vcombine_u8(z.val[0], z.val[1]);
+}
+
+// 0xff for codes in the mask
+static inline uint8x16_t neon_mask_lut(uint16_t mask) {
+    uint8_t lut[16];
+    for(int c = 0; c < 16; c++) {
+        lut[c] = (mask >> c) & 1 ? 0xff : 0;
+    }
+    return vld1q_u8(lut);
+}
+
+static int32_t seq_count_base_neon(const uint8_t *seq, int32_t start, int32_t end, uint16_t mask) {
+    int32_t count = 0;
+    int32_t i = start;
+    if((i & 1) && i < end) {
+        count += (mask >> SEQ_NIBBLE(seq, i)) & 1;
+        i++;
+    }
+    uint8x16_t lut = neon_mask_lut(mask);
+    uint8x16_t one = vdupq_n_u8(1);
+    for(; i + 16 <= end; i += 16) {
+        uint8x16_t m = vqtbl1q_u8(lut, neon_unpack16(seq + (i >> 1)));
+        count += vaddvq_u8(vandq_u8(m, one));
+    }
+    return count + seq_count_base_scalar(seq, i, end, mask);
+}
+
+static const seqkernel_t neon_kernel = {
+    "neon",
+    seq_count_base_neon
+};
+
+#endif
+
+/* dispatch */
+
+static const seqkernel_t *active_kernel = &scalar_kernel;
+
+int seqkernel_available(const seqkernel_t **impls) {
+    int n = 0;
+    impls[n++] = &scalar_kernel;
+#if defined(__SSE2__)
+    impls[n++] = &sse2_kernel;
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    const seqkernel_t *avx2 = seqkernel_get_avx2();
+    if(avx2 != NULL && __builtin_cpu_supports("avx2")) {
+        impls[n++] = avx2;
+    }
+#endif
+#if defined(__aarch64__)
+    impls[n++] = &neon_kernel;
+#endif
+    return n;
+}
+
+/* select the widest kernel the cpu supports, call once before starting threads */
+void seqkernel_init(void) {
+    const seqkernel_t *impls[SEQKERNEL_MAX_IMPLS];
+    int n = seqkernel_available(impls);
+    active_kernel = impls[n - 1];
+}
+
+const char *seqkernel_name(void) {
+    return active_kernel->name;
+}
+
+int32_t seq_count_base(const uint8_t *seq, int32_t start, int32_t end, uint16_t mask) {
+    return active_kernel->count_base(seq, start, end, mask);
+}
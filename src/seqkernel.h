@@ -0,0 +1,66 @@
+/**
+ * @file seqkernel.h
+ * @brief SIMD kernels over 4-bit packed read sequences
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+#ifndef SEQKERNEL_H
+#define SEQKERNEL_H
+
+#include <stdint.h>
+
+/*
+ * Kernels over the 4-bit packed sequence of a bam record (bam_get_seq). Ranges are
+ * half open [start, end) in read coordinates. A base is given as a 16 bit mask over
+ * the nibble codes of seq_nt16_str, bit n set if the code n is to be matched.
+ *
+ * seq_count_base      number of bases matching mask
+ *
+ * scalar, SSE2, AVX2 and NEON versions are available. seqkernel_init picks the
+ * widest one the CPU supports. The scalar one is used until then.
+ */
+
+typedef struct {
+    const char *name;
+    int32_t (*count_base)(const uint8_t *seq, int32_t start, int32_t end, uint16_t mask);
+} seqkernel_t;
+
+#define SEQKERNEL_MAX_IMPLS 4
+
+#define SEQ_NIBBLE(seq, i) ((seq)[(i) >> 1] >> ((~(i) & 1) << 2) & 0xf) // same as bam_seqi
+
+void seqkernel_init(void);
+const char *seqkernel_name(void);
+int seqkernel_available(const seqkernel_t **impls); // kernels usable on this cpu, scalar first
+
+int32_t seq_count_base(const uint8_t *seq, int32_t start, int32_t end, uint16_t mask);
+
+// used by the vector versions for the unaligned head and tail of a range
+int32_t seq_count_base_scalar(const uint8_t *seq, int32_t start, int32_t end, uint16_t mask);
+
+const seqkernel_t *seqkernel_get_avx2(void); // NULL if not compiled with AVX2
+
+#endif
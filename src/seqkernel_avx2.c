@@ -0,0 +1,91 @@
+/**
+ * @file seqkernel_avx2.c
+ * @brief AVX2 sequence kernels, built with -mavx2 on x86_64
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+#include "seqkernel.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+/* 32 bases (16 packed bytes) per step */
+
+// nibbles of 16 packed bytes to 32 code bytes in read order
+static inline __m256i avx2_unpack32(const uint8_t *p) {
+    __m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p)); // 0x00XY per 16 bit lane
+    __m256i hi = _mm256_srli_epi16(x, 4);
+    __m256i lo = _mm256_slli_epi16(_mm256_and_si256(x, _mm256_set1_epi16(0x0f)), 8);
+    return _mm256_or_si256(hi, lo);
+}
+
+// 0xff for codes in the mask, in both lanes for the byte shuffle
+static inline __m256i avx2_mask_lut(uint16_t mask) {
+    uint8_t lut[16];
+    for(int c = 0; c < 16; c++) {
+        lut[c] = (mask >> c) & 1 ? 0xff : 0;
+    }
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)lut));
+}
+
+// bit i set if base i of the 32 matches
+static inline uint32_t avx2_match32(__m256i lut, __m256i codes) {
+    return (uint32_t)_mm256_movemask_epi8(_mm256_shuffle_epi8(lut, codes));
+}
+
+static int32_t seq_count_base_avx2(const uint8_t *seq, int32_t start, int32_t end, uint16_t mask) {
+    int32_t count = 0;
+    int32_t i = start;
+    if((i & 1) && i < end) {
+        count += (mask >> SEQ_NIBBLE(seq, i)) & 1;
+        i++;
+    }
+    __m256i lut = avx2_mask_lut(mask);
+    for(; i + 32 <= end; i += 32) {
+        count += __builtin_popcount(avx2_match32(lut, avx2_unpack32(seq + (i >> 1))));
+    }
+    return count + seq_count_base_scalar(seq, i, end, mask);
+}
+
+static const seqkernel_t avx2_kernel = {
+    "avx2",
+    seq_count_base_avx2
+};
+
+const seqkernel_t *seqkernel_get_avx2(void) {
+    return &avx2_kernel;
+}
+
+#else
+
+const seqkernel_t *seqkernel_get_avx2(void) {
+    return NULL;
+}
+
+#endif
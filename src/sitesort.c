@@ -0,0 +1,388 @@
+/**
+ * @file sitesort.c
+ * @brief parallel sort of the freq sites by contig and position
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+
+#include "sitesort.h"
+#include "error.h"
+#include "khash.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SITESORT_MIN_CHUNK 65536 // sites per thread, smaller arrays use fewer threads
+#define SITESORT_RADIX_BITS 8
+#define SITESORT_RADIX_SIZE (1 << SITESORT_RADIX_BITS)
+
+KHASH_MAP_INIT_STR(ssctg, uint32_t)
+
+typedef struct {
+    uint64_t key; // contig rank << 32 | pos + 1
+    uint64_t idx; // index of the site in the input array
+} sitesort_rec_t;
+
+typedef struct {
+    const char *name;
+    int32_t tid; // -1 if not in the header
+} sitesort_ctg_t;
+
+typedef struct sitesort_s sitesort_t;
+
+/* state of a thread, a chunk of the input array */
+typedef struct {
+    sitesort_t *ss;
+    int64_t start;
+    int64_t end;
+    khash_t(ssctg) *contigs; // contig name to local id, names are owned by the map
+    uint32_t n_local;
+    uint32_t *rank; // local id to contig rank
+    int64_t *offsets; // per contig rank, the count and then the first output slot of this chunk
+} sitesort_arg_t;
+
+struct sitesort_s {
+    const void *arr;
+    void *out;
+    size_t elem_size;
+    sitesort_rec_t *recs;
+    sitesort_rec_t *tmp;
+    uint32_t n_contigs;
+    int64_t *contig_start; // n_contigs + 1 entries
+    uint32_t next_contig; // next contig to radix sort, under lock
+    pthread_mutex_t lock;
+};
+
+static inline const char *site_key(const sitesort_t *ss, int64_t i) {
+    return *(char * const *)((const char *)ss->arr + (size_t)i * ss->elem_size);
+}
+
+// pack the position and a local contig id of each site of the chunk
+static void *pack_chunk(void *voidargs) {
+    sitesort_arg_t *a = (sitesort_arg_t *)voidargs;
+    sitesort_t *ss = a->ss;
+    const char *last = NULL;
+    size_t last_len = 0;
+    uint32_t last_id = 0;
+    for (int64_t i = a->start; i < a->end; i++) {
+        const char *key = site_key(ss, i);
+        const char *tab = strchr(key, '\t');
+        size_t len = tab - key;
+        uint32_t id;
+        if (last != NULL && len == last_len && strncmp(key, last, len) == 0) { // sites of a contig are often adjacent
+            id = last_id;
+        } else {
+            char *name = (char *)malloc(len + 1);
+            MALLOC_CHK(name);
+            memcpy(name, key, len);
+            name[len] = '\0';
+            int ret;
+            khint_t k = kh_put(ssctg, a->contigs, name, &ret);
+            if (ret == 0) {
+                free(name);
+            } else {
+                kh_value(a->contigs, k) = a->n_local++;
+            }
+            id = kh_value(a->contigs, k);
+            last = key;
+            last_len = len;
+            last_id = id;
+        }
+        uint32_t pos = (uint32_t)(atoi(tab + 1) + 1); // inserted bases before the contig start are at -1
+        ss->recs[i].key = (uint64_t)id << 32 | pos;
+        ss->recs[i].idx = (uint64_t)i;
+    }
+    pthread_exit(0);
+}
+
+// replace the local contig ids by the ranks and count the sites of each contig
+static void *rank_chunk(void *voidargs) {
+    sitesort_arg_t *a = (sitesort_arg_t *)voidargs;
+    sitesort_t *ss = a->ss;
+    for (int64_t i = a->start; i < a->end; i++) {
+        uint64_t rank = a->rank[ss->recs[i].key >> 32];
+        ss->recs[i].key = rank << 32 | (ss->recs[i].key & 0xffffffffu);
+        a->offsets[rank]++;
+    }
+    pthread_exit(0);
+}
+
+// move the sites of the chunk into their contig partitions, keeping their order
+static void *scatter_chunk(void *voidargs) {
+    sitesort_arg_t *a = (sitesort_arg_t *)voidargs;
+    sitesort_t *ss = a->ss;
+    for (int64_t i = a->start; i < a->end; i++) {
+        ss->tmp[a->offsets[ss->recs[i].key >> 32]++] = ss->recs[i];
+    }
+    pthread_exit(0);
+}
+
+// LSD radix sort of recs[0..n) on the position, buf is scratch space. passes where all sites share the digit are skipped
+static void radix_sort_pos(sitesort_rec_t *recs, sitesort_rec_t *buf, int64_t n) {
+    sitesort_rec_t *src = recs, *dst = buf;
+    int64_t count[SITESORT_RADIX_SIZE];
+    for (int shift = 0; shift < 32; shift += SITESORT_RADIX_BITS) {
+        memset(count, 0, sizeof(count));
+        for (int64_t i = 0; i < n; i++) {
+            count[(src[i].key >> shift) & (SITESORT_RADIX_SIZE - 1)]++;
+        }
+        if (count[(src[0].key >> shift) & (SITESORT_RADIX_SIZE - 1)] == n) continue;
+        int64_t sum = 0;
+        for (int d = 0; d < SITESORT_RADIX_SIZE; d++) {
+            int64_t c = count[d];
+            count[d] = sum;
+            sum += c;
+        }
+        for (int64_t i = 0; i < n; i++) {
+            dst[count[(src[i].key >> shift) & (SITESORT_RADIX_SIZE - 1)]++] = src[i];
+        }
+        sitesort_rec_t *t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != recs) {
+        memcpy(recs, src, sizeof(sitesort_rec_t) * n);
+    }
+}
+
+/* order of two keys at the same contig and position: strand, mod code, ins_offset and haplotype,
+ * the same order as the checkpoint records */
+int sitesort_cmp_tail(const char *key_a, const char *key_b) {
+    const char *a = strchr(strchr(key_a, '\t') + 1, '\t') + 1; // strand
+    const char *b = strchr(strchr(key_b, '\t') + 1, '\t') + 1;
+    if (*a != *b) return (uint8_t)*a < (uint8_t)*b ? -1 : 1;
+
+    a += 2; // mod code
+    b += 2;
+    const char *tab_a = strchr(a, '\t');
+    const char *tab_b = strchr(b, '\t');
+    size_t len_a = tab_a - a, len_b = tab_b - b;
+    int cmp = strncmp(a, b, len_a < len_b ? len_a : len_b);
+    if (cmp != 0) return cmp;
+    if (len_a != len_b) return len_a < len_b ? -1 : 1;
+
+    a = tab_a + 1; // ins_offset, empty if 0
+    b = tab_b + 1;
+    long ins_a = *a == '\t' ? 0 : strtol(a, NULL, 10);
+    long ins_b = *b == '\t' ? 0 : strtol(b, NULL, 10);
+    if (ins_a != ins_b) return ins_a < ins_b ? -1 : 1;
+
+    a = strchr(a, '\t') + 1; // haplotype, empty if -1
+    b = strchr(b, '\t') + 1;
+    int hap_a = *a == '\0' ? -1 : atoi(a);
+    int hap_b = *b == '\0' ? -1 : atoi(b);
+    return cmp_haplotype(hap_a, hap_b);
+}
+
+// sites at the same position are few (strands, mod codes, inserted bases), an insertion sort of each run is enough
+static void sort_ties(const sitesort_t *ss, sitesort_rec_t *recs, int64_t n) {
+    int64_t run = 0;
+    for (int64_t i = 1; i <= n; i++) {
+        if (i < n && recs[i].key == recs[run].key) continue;
+        for (int64_t j = run + 1; j < i; j++) {
+            sitesort_rec_t r = recs[j];
+            const char *key = site_key(ss, (int64_t)r.idx);
+            int64_t k = j;
+            while (k > run && sitesort_cmp_tail(site_key(ss, (int64_t)recs[k - 1].idx), key) > 0) {
+                recs[k] = recs[k - 1];
+                k--;
+            }
+            recs[k] = r;
+        }
+        run = i;
+    }
+}
+
+// sort the contig partitions, taking the next unsorted contig until none are left
+static void *sort_contigs(void *voidargs) {
+    sitesort_arg_t *a = (sitesort_arg_t *)voidargs;
+    sitesort_t *ss = a->ss;
+    while (1) {
+        pthread_mutex_lock(&ss->lock);
+        uint32_t c = ss->next_contig++;
+        pthread_mutex_unlock(&ss->lock);
+        if (c >= ss->n_contigs) break;
+        int64_t start = ss->contig_start[c];
+        int64_t len = ss->contig_start[c + 1] - start;
+        if (len > 1) {
+            radix_sort_pos(ss->tmp + start, ss->recs + start, len);
+            sort_ties(ss, ss->tmp + start, len);
+        }
+    }
+    pthread_exit(0);
+}
+
+// copy the sites of the chunk to the output in sorted order
+static void *gather_chunk(void *voidargs) {
+    sitesort_arg_t *a = (sitesort_arg_t *)voidargs;
+    sitesort_t *ss = a->ss;
+    size_t size = ss->elem_size;
+    for (int64_t i = a->start; i < a->end; i++) {
+        memcpy((char *)ss->out + (size_t)i * size, (const char *)ss->arr + (size_t)ss->tmp[i].idx * size, size);
+    }
+    pthread_exit(0);
+}
+
+static void run_threads(sitesort_arg_t *args, int n_threads, void *(*func)(void *)) {
+    pthread_t *tids = (pthread_t *)malloc(sizeof(pthread_t) * n_threads);
+    MALLOC_CHK(tids);
+    for (int t = 0; t < n_threads; t++) {
+        int ret = pthread_create(&tids[t], NULL, func, (void *)(&args[t]));
+        NEG_CHK(ret);
+    }
+    for (int t = 0; t < n_threads; t++) {
+        int ret = pthread_join(tids[t], NULL);
+        NEG_CHK(ret);
+    }
+    free(tids);
+}
+
+static int cmp_ctg(const void *pa, const void *pb) {
+    const sitesort_ctg_t *a = (const sitesort_ctg_t *)pa;
+    const sitesort_ctg_t *b = (const sitesort_ctg_t *)pb;
+    if (a->tid >= 0 && b->tid >= 0) return a->tid < b->tid ? -1 : (a->tid > b->tid);
+    if (a->tid >= 0 || b->tid >= 0) return a->tid >= 0 ? -1 : 1;
+    return strcmp(a->name, b->name);
+}
+
+// rank the contigs of all chunks and set the local id to rank table of each chunk
+static uint32_t rank_contigs(core_t *core, sitesort_arg_t *args, int n_threads) {
+    khash_t(ssctg) *all = kh_init(ssctg);
+    sitesort_ctg_t *ctgs = NULL;
+    uint32_t n_ctgs = 0, cap_ctgs = 0;
+    bam_hdr_t *hdr = core->bam_hdrs ? core->bam_hdrs[0] : NULL; // merge has no header
+
+    for (int t = 0; t < n_threads; t++) {
+        khash_t(ssctg) *local = args[t].contigs;
+        for (khint_t k = kh_begin(local); k != kh_end(local); ++k) {
+            if (!kh_exist(local, k)) continue;
+            int ret;
+            kh_put(ssctg, all, kh_key(local, k), &ret);
+            if (ret == 0) continue;
+            if (n_ctgs == cap_ctgs) {
+                cap_ctgs = cap_ctgs ? cap_ctgs * 2 : 64;
+                ctgs = (sitesort_ctg_t *)realloc(ctgs, sizeof(sitesort_ctg_t) * cap_ctgs);
+                MALLOC_CHK(ctgs);
+            }
+            ctgs[n_ctgs].name = kh_key(local, k);
+            ctgs[n_ctgs].tid = hdr ? bam_name2id(hdr, kh_key(local, k)) : -1;
+            n_ctgs++;
+        }
+    }
+
+    qsort(ctgs, n_ctgs, sizeof(sitesort_ctg_t), cmp_ctg);
+    for (uint32_t r = 0; r < n_ctgs; r++) {
+        khint_t k = kh_get(ssctg, all, ctgs[r].name);
+        kh_value(all, k) = r;
+    }
+
+    for (int t = 0; t < n_threads; t++) {
+        khash_t(ssctg) *local = args[t].contigs;
+        args[t].rank = (uint32_t *)malloc(sizeof(uint32_t) * (args[t].n_local > 0 ? args[t].n_local : 1));
+        MALLOC_CHK(args[t].rank);
+        for (khint_t k = kh_begin(local); k != kh_end(local); ++k) {
+            if (!kh_exist(local, k)) continue;
+            args[t].rank[kh_value(local, k)] = kh_value(all, kh_get(ssctg, all, kh_key(local, k)));
+        }
+        args[t].offsets = (int64_t *)calloc(n_ctgs > 0 ? n_ctgs : 1, sizeof(int64_t));
+        MALLOC_CHK(args[t].offsets);
+    }
+
+    free(ctgs);
+    kh_destroy(ssctg, all); // keys are owned by the chunk maps
+    return n_ctgs;
+}
+
+void sitesort(core_t *core, void *arr, int64_t n, size_t elem_size) {
+    if (n < 2) return;
+
+    int n_threads = core->opt.num_thread;
+    if (n / SITESORT_MIN_CHUNK + 1 < n_threads) {
+        n_threads = (int)(n / SITESORT_MIN_CHUNK + 1);
+    }
+
+    sitesort_t ss;
+    memset(&ss, 0, sizeof(sitesort_t));
+    ss.arr = arr;
+    ss.elem_size = elem_size;
+    ss.recs = (sitesort_rec_t *)malloc(sizeof(sitesort_rec_t) * n);
+    MALLOC_CHK(ss.recs);
+    ss.tmp = (sitesort_rec_t *)malloc(sizeof(sitesort_rec_t) * n);
+    MALLOC_CHK(ss.tmp);
+    pthread_mutex_init(&ss.lock, NULL);
+
+    sitesort_arg_t *args = (sitesort_arg_t *)calloc(n_threads, sizeof(sitesort_arg_t));
+    MALLOC_CHK(args);
+    int64_t chunk = (n + n_threads - 1) / n_threads;
+    for (int t = 0; t < n_threads; t++) {
+        args[t].ss = &ss;
+        args[t].start = t * chunk < n ? t * chunk : n;
+        args[t].end = (t + 1) * chunk < n ? (t + 1) * chunk : n;
+        args[t].contigs = kh_init(ssctg);
+    }
+
+    run_threads(args, n_threads, pack_chunk);
+    ss.n_contigs = rank_contigs(core, args, n_threads);
+    run_threads(args, n_threads, rank_chunk);
+
+    // partition offsets, contig major and chunk minor so that the partitions keep the input order
+    ss.contig_start = (int64_t *)malloc(sizeof(int64_t) * (ss.n_contigs + 1));
+    MALLOC_CHK(ss.contig_start);
+    int64_t sum = 0;
+    for (uint32_t c = 0; c < ss.n_contigs; c++) {
+        ss.contig_start[c] = sum;
+        for (int t = 0; t < n_threads; t++) {
+            int64_t count = args[t].offsets[c];
+            args[t].offsets[c] = sum;
+            sum += count;
+        }
+    }
+    ss.contig_start[ss.n_contigs] = sum;
+
+    run_threads(args, n_threads, scatter_chunk);
+    run_threads(args, n_threads, sort_contigs);
+
+    ss.out = malloc(elem_size * n);
+    MALLOC_CHK(ss.out);
+    run_threads(args, n_threads, gather_chunk);
+    memcpy(arr, ss.out, elem_size * n);
+
+    for (int t = 0; t < n_threads; t++) {
+        khash_t(ssctg) *local = args[t].contigs;
+        for (khint_t k = kh_begin(local); k != kh_end(local); ++k) {
+            if (kh_exist(local, k)) free((char *)kh_key(local, k));
+        }
+        kh_destroy(ssctg, local);
+        free(args[t].rank);
+        free(args[t].offsets);
+    }
+    free(args);
+    free(ss.out);
+    free(ss.contig_start);
+    free(ss.recs);
+    free(ss.tmp);
+    pthread_mutex_destroy(&ss.lock);
+}
@@ -0,0 +1,52 @@
+/**
+ * @file sitesort.h
+ * @brief parallel sort of the freq sites by contig and position
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+
+#ifndef SITESORT_H
+#define SITESORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "minimod.h"
+
+/*
+ * Sorts an array of sites whose elements start with a key made by make_key. Each key is packed
+ * into an integer (contig rank << 32 | pos + 1) where contigs are ranked by their tid in the
+ * header of the first input file, and those not in the header (or all of them, if there is no
+ * header as in merge) follow in name order. The packed keys are partitioned by contig with a
+ * stable counting sort and each contig is then radix sorted on the position on its own thread.
+ *
+ * Sites at the same position are then ordered by sitesort_cmp_tail, so the order is total and
+ * depends neither on the number of threads nor on the order of the input array.
+ */
+
+void sitesort(core_t *core, void *arr, int64_t n, size_t elem_size);
+int sitesort_cmp_tail(const char *key_a, const char *key_b);
+
+#endif
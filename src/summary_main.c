@@ -55,6 +55,11 @@ static struct option long_options[] = {
     {"output",required_argument, 0, 'o'},          //8 output file
     {"allow-secondary",no_argument, 0, 0},         //9 allow secondary alignments
     {"skip-supplementary",no_argument, 0, 0},      //10 skip supplementary alignments
+    {"ml-hist",required_argument, 0, 0},           //11 per read ML statistics and run level ML histogram written to the given file
+    {"mod_thresh", required_argument, 0, 'm'},     //12 modification threshold for --ml-hist 0.0 to 1.0 [0.8]
+    {"io-threads",required_argument, 0, 0},        //13 BAM decompression and decode threads
+    {"min-mapq",required_argument, 0, 0},          //14 skip alignments with a lower MAPQ
+    {"min-length",required_argument, 0, 0},        //15 skip reads with fewer bases
     {0, 0, 0, 0}};
 
 
@@ -71,8 +76,13 @@ static inline void print_help_msg(FILE *fp_help, opt_t opt){
     fprintf(fp_help,"   --version                  print version\n");
     fprintf(fp_help,"   --allow-secondary          allow secondary alignments [%s]\n", (opt.allow_secondary?"yes":"no"));
     fprintf(fp_help,"   --skip-supplementary       skip supplementary alignments [%s]\n", (opt.skip_supplementary?"yes":"no"));
+    fprintf(fp_help,"   --min-mapq INT             skip alignments with a lower MAPQ [%d]\n", opt.min_mapq);
+    fprintf(fp_help,"   --min-length INT           skip reads with fewer bases [%d]\n", opt.min_length);
+    fprintf(fp_help,"   --ml-hist FILE             output per read ML statistics and write the run level ML histogram to FILE\n");
+    fprintf(fp_help,"   -m FLOAT                   modification threshold used by --ml-hist [%.1f]\n", opt.ml_thresh);
 
     fprintf(fp_help,"\nadvanced options:\n");
+    fprintf(fp_help,"   --io-threads INT           BAM decompression and decode threads, apart from -t [-t/4]\n");
     fprintf(fp_help,"   --debug-break INT          break after processing the specified no. of batches\n");
     fprintf(fp_help,"   --profile-cpu=yes|no       process section by section\n");
 }
@@ -157,7 +167,7 @@ int summary_main(int argc, char* argv[]) {
 
     double realtime0 = realtime();
 
-    const char* optstring = "c:t:B:K:v:p:o:hV";
+    const char* optstring = "c:m:t:B:K:v:p:o:hV";
 
     int longindex = 0;
     int32_t c = -1;
@@ -211,6 +221,12 @@ int summary_main(int argc, char* argv[]) {
             fp_help = stdout;
         } else if (c=='c') {
             opt.mod_codes_str = optarg;
+        } else if (c=='m') {
+            opt.ml_thresh = atof(optarg);
+            if (opt.ml_thresh < 0 || opt.ml_thresh > 1) {
+                ERROR("Modification threshold should be between 0.0 and 1.0. You entered %s", optarg);
+                exit(EXIT_FAILURE);
+            }
         } else if(c == 0 && longindex == 7){ //debug break
             opt.debug_break = atoi(optarg);
         } else if(c == 0 && longindex == 8){ //output file
@@ -225,6 +241,33 @@ int summary_main(int argc, char* argv[]) {
             opt.allow_secondary = 1;
         } else if(c == 0 && longindex == 10){ //skip supplementary alignments
             opt.skip_supplementary = 1;
+        } else if(c == 0 && longindex == 11){ //ML histogram
+            FILE *fp = fopen(optarg, "w");
+            if (fp == NULL) {
+                ERROR("Cannot open file %s for writing", optarg);
+                exit(EXIT_FAILURE);
+            }
+            opt.ml_hist = 1;
+            opt.ml_hist_file = optarg;
+            opt.ml_hist_fp = fp;
+        } else if(c == 0 && longindex == 13){ //decompression and decode threads
+            opt.io_threads = atoi(optarg);
+            if (opt.io_threads < 0) {
+                ERROR("Number of I/O threads should be 0 or larger. You entered %d", opt.io_threads);
+                exit(EXIT_FAILURE);
+            }
+        } else if(c == 0 && longindex == 14){ //minimum MAPQ
+            opt.min_mapq = atoi(optarg);
+            if (opt.min_mapq < 0 || opt.min_mapq > 255) {
+                ERROR("Minimum MAPQ should be between 0 and 255. You entered %d", opt.min_mapq);
+                exit(EXIT_FAILURE);
+            }
+        } else if(c == 0 && longindex == 15){ //minimum read length
+            opt.min_length = atoi(optarg);
+            if (opt.min_length < 0) {
+                ERROR("Minimum read length should be 0 or larger. You entered %d", opt.min_length);
+                exit(EXIT_FAILURE);
+            }
         } else {
             print_help_msg(fp_help, opt);
             if(fp_help == stdout){
@@ -244,22 +287,8 @@ int summary_main(int argc, char* argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    opt.bam_file = argv[optind];
-
-    if (opt.bam_file == NULL) {
-        WARNING("%s","BAM file not provided");
-        print_help_msg(fp_help, opt);
-        if(fp_help == stdout){
-            exit(EXIT_SUCCESS);
-        }
-        exit(EXIT_FAILURE);
-    }
-
     // check if the bam file exists
-    if (access(opt.bam_file, F_OK) == -1) {
-        ERROR("BAM file %s does not exist", opt.bam_file);
-        exit(EXIT_FAILURE);
-    }
+    set_bam_files(&opt, &argv[optind], 1, NULL);
 
     //initialise the core data structure
     core_t* core = init_core(opt, realtime0);
@@ -274,8 +303,8 @@ int summary_main(int argc, char* argv[]) {
     //initialise a databatch
     db_t* db = init_db(core);
 
-    ret_status_t status = {core->opt.batch_size,core->opt.batch_size_bases};
-    while (status.num_reads >= core->opt.batch_size || status.num_bases>=core->opt.batch_size_bases) {
+    ret_status_t status = {core->batch_size,core->batch_size_bases};
+    while (status.num_reads >= core->batch_size || status.num_bases>=core->batch_size_bases) {
 
         //load a databatch
         status = load_db(core, db);
@@ -319,13 +348,13 @@ int summary_main(int argc, char* argv[]) {
 
 #else //IO_PROC_INTERLEAVE
 
-    ret_status_t status = {core->opt.batch_size,core->opt.batch_size_bases};
+    ret_status_t status = {core->batch_size,core->batch_size_bases};
     int8_t first_flag_p=0;
     int8_t first_flag_pp=0;
     pthread_t tid_p; //process thread
     pthread_t tid_pp; //post-process thread
 
-    while (status.num_reads >= core->opt.batch_size || status.num_bases>=core->opt.batch_size_bases) {
+    while (status.num_reads >= core->batch_size || status.num_bases>=core->batch_size_bases) {
 
         //init and load a databatch
         db_t* db = init_db(core);
@@ -409,12 +438,22 @@ int summary_main(int argc, char* argv[]) {
 
 #endif
 
+    if(opt.ml_hist){
+        print_ml_hist(core);
+        fclose(opt.ml_hist_fp);
+    }
+    if(opt.output_fp != stdout){
+        fclose(opt.output_fp);
+    }
+
     fprintf(stderr, "[%s] total entries: %ld", __func__,(long)core->total_reads);
     fprintf(stderr,"\n[%s] total bytes: %.1f M",__func__,core->total_bytes/(float)(1000*1000));
     fprintf(stderr,"\n[%s] total skipped entries: %ld",__func__,(long)(core->total_reads-core->processed_reads));
     fprintf(stderr,"\n[%s] total skipped bytes: %.1f M",__func__,(core->total_bytes-core->processed_bytes)/(float)(1000*1000));
+    print_skipped_reads(core, __func__);
     fprintf(stderr,"\n[%s] total processed entries: %ld",__func__,(long)core->processed_reads);
     fprintf(stderr,"\n[%s] total processed bytes: %.1f M",__func__,(core->processed_bytes)/(float)(1000*1000));
+    fprintf(stderr,"\n[%s] total processed bases: %lu",__func__,(unsigned long)core->processed_bases);
 
     fprintf(stderr, "\n[%s] Data loading time: %.3f sec", __func__,core->load_db_time);
     fprintf(stderr, "\n[%s] Data processing time: %.3f sec", __func__,core->process_db_time);
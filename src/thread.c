@@ -35,6 +35,8 @@ SOFTWARE.
 #include "minimod.h"
 #include "error.h"
 #include "misc.h"
+#include "profile.h"
+#include <string.h>
 
 
 /**********************************
@@ -68,6 +70,24 @@ static inline int32_t steal_work(pthread_arg_t* all_args, int32_t n_threads) {
 }
 
 
+/* process a record, with --profile time it and add its stats to those of the thread */
+static inline void work_single(core_t* core, db_t* db, int32_t i, void (*func)(core_t*,db_t*,int), int32_t thread_index) {
+    if (db->rec_threads) { // per thread counters of summary --ml-hist
+        db->rec_threads[i] = thread_index;
+    }
+    if (db->prof == NULL) {
+        func(core,db,i);
+        return;
+    }
+    prof_stat_t *ps = &db->prof[i];
+    double start = realtime();
+    func(core,db,i);
+    ps->busy_time = realtime() - start;
+    ps->reads = 1;
+    profile_add(&core->prof->threads[thread_index], ps);
+    memset(ps, 0, sizeof(prof_stat_t)); // the batch may be reused
+}
+
 void* pthread_single(void* voidargs) {
     int32_t i;
     pthread_arg_t* args = (pthread_arg_t*)voidargs;
@@ -76,7 +96,7 @@ void* pthread_single(void* voidargs) {
 
 #ifndef WORK_STEAL
     for (i = args->starti; i < args->endi; i++) {
-        args->func(core,db,i);
+        work_single(core,db,i,args->func,args->thread_index);
     }
 #else
     pthread_arg_t* all_args = (pthread_arg_t*)(args->all_pthread_args);
@@ -86,10 +106,10 @@ void* pthread_single(void* voidargs) {
 		if (i >= args->endi) {
             break;
         }
-		args->func(core,db,i);
+		work_single(core,db,i,args->func,args->thread_index);
 	}
 	while ((i = steal_work(all_args,core->opt.num_thread)) >= 0){
-		args->func(core,db,i);
+		work_single(core,db,i,args->func,args->thread_index);
     }
 #endif
 
@@ -120,6 +140,7 @@ void pthread_db(core_t* core, db_t* db, void (*func)(core_t*,db_t*,int)){
             pt_args[t].endi = i;
         }
         pt_args[t].func=func;
+        pt_args[t].thread_index=t;
     #ifdef WORK_STEAL
         pt_args[t].all_pthread_args =  (void *)pt_args;
     #endif
@@ -147,7 +168,7 @@ void work_db(core_t* core, db_t* db, void (*func)(core_t*,db_t*,int)){
     if (core->opt.num_thread == 1) {
         int32_t i=0;
         for (i = 0; i < db->n_bam_recs; i++) {
-            func(core,db,i);
+            work_single(core,db,i,func,0);
         }
 
     }
@@ -35,6 +35,8 @@ SOFTWARE.
 #include "error.h"
 #include "misc.h"
 #include "ref.h"
+#include "profile.h"
+#include "viewbin.h"
 #include <assert.h>
 #include <getopt.h>
 #include <pthread.h>
@@ -57,13 +59,25 @@ static struct option long_options[] = {
     {"insertions",no_argument, 0, 0},              //10 enable modifications in insertions
     {"haplotypes",no_argument, 0, 0},              //11 enable haplotype mode
     {"allow-secondary",no_argument, 0, 0},         //12 enable secondary alignments
-    {"include-non-ref",no_argument, 0, 0},         //15 include modifications occuring on non-reference alleles (eg. due to SNPs)
-    {"skip-supplementary",no_argument, 0, 0},      //16 skip supplementary alignments
+    {"include-non-ref",no_argument, 0, 0},         //13 include modifications occuring on non-reference alleles (eg. due to SNPs)
+    {"skip-supplementary",no_argument, 0, 0},      //14 skip supplementary alignments
+    {"binary",no_argument, 0, 0},                  //15 binary columnar output
+    {"bam-list",required_argument, 0, 0},          //16 file with input BAM file names, one per line
+    {"per-sample",no_argument, 0, 0},              //17 add a sample column
+    {"adaptive-batch",required_argument, 0, 0},    //18 tune -K and -B at runtime under this memory cap
+    {"max-mem",required_argument, 0, 0},           //19 memory budget, loading waits and the freq table spills when reached
+    {"profile",required_argument, 0, 0},           //20 per thread and per stage profile report
+    {"read-level",no_argument, 0, 0},              //21 one row per read and mod code
+    {"mod_thresh", required_argument, 0, 'm'},     //22 modification threshold(s) for --read-level [0.8]
+    {"io-threads",required_argument, 0, 0},        //23 BAM decompression and decode threads
+    {"min-mapq",required_argument, 0, 0},          //24 skip alignments with a lower MAPQ
+    {"min-length",required_argument, 0, 0},        //25 skip reads with fewer bases
     {0, 0, 0, 0}};
 
 
 static inline void print_help_msg(FILE *fp_help, opt_t opt){
-    fprintf(fp_help,"Usage: minimod view ref.fa reads.bam\n");
+    fprintf(fp_help,"Usage: minimod view ref.fa reads.bam [reads2.bam ...]\n");
+    fprintf(fp_help,"reads can be SAM, BAM or CRAM. Use - to read from stdin\n");
     fprintf(fp_help,"\nbasic options:\n");
     fprintf(fp_help,"   -c STR                     modification code(s) (eg. m, h or mh or as ChEBI) [%s]\n", opt.mod_codes_str==NULL?"m":opt.mod_codes_str);
     fprintf(fp_help,"   -t INT                     number of processing threads [%d]\n",opt.num_thread);
@@ -79,9 +93,20 @@ static inline void print_help_msg(FILE *fp_help, opt_t opt){
     fprintf(fp_help,"   --allow-secondary          allow secondary alignments [%s]\n", (opt.allow_secondary?"yes":"no"));
     // fprintf(fp_help,"   --include-non-ref          include modifications on bases not matching reference (eg. due to SNPs) [%s]\n", (opt.alt_alleles?"yes":"no"));
     fprintf(fp_help,"   --skip-supplementary       skip supplementary alignments [%s]\n", (opt.skip_supplementary?"yes":"no"));
+    fprintf(fp_help,"   --min-mapq INT             skip alignments with a lower MAPQ [%d]\n", opt.min_mapq);
+    fprintf(fp_help,"   --min-length INT           skip reads with fewer bases [%d]\n", opt.min_length);
+    fprintf(fp_help,"   --binary                   write binary columnar output (convert to tsv with minimod cat) [%s]\n", (opt.binary_out?"yes":"no"));
+    fprintf(fp_help,"   --bam-list FILE            read input BAM files from FILE, one per line\n");
+    fprintf(fp_help,"   --per-sample               sample column with the input file name [%s]\n", (opt.per_sample?"yes":"no"));
+    fprintf(fp_help,"   --read-level               one row per read and modification code with the site counts and mean probability [%s]\n", (opt.read_level?"yes":"no"));
+    fprintf(fp_help,"   -m FLOAT                   modification threshold(s) for the called counts of --read-level. Comma separated values for each modification code given in -c [0.8]\n");
 
     fprintf(fp_help,"\nadvanced options:\n");
+    fprintf(fp_help,"   --io-threads INT           BAM decompression and decode threads, apart from -t [-t/4]\n");
+    fprintf(fp_help,"   --max-mem FLOAT[K/M/G]     memory budget, reading waits when it is reached [no limit]\n");
     fprintf(fp_help,"   --debug-break INT          break after processing the specified no. of batches\n");
+    fprintf(fp_help,"   --profile FILE             write per thread and per stage timers and counters to FILE (JSON)\n");
+    fprintf(fp_help,"   --adaptive-batch FLOAT[K/M/G] tune -K and -B at runtime, keeping the batches in memory under FLOAT bytes\n");
     fprintf(fp_help,"   --profile-cpu=yes|no       process section by section\n");
 }
 
@@ -165,12 +190,13 @@ int view_main(int argc, char* argv[]) {
 
     double realtime0 = realtime();
 
-    const char* optstring = "c:t:B:K:v:p:o:hV";
+    const char* optstring = "c:m:t:B:K:v:p:o:hV";
 
     int longindex = 0;
     int32_t c = -1;
 
     FILE *fp_help = stderr;
+    char *bam_list_file = NULL;
 
     opt_t opt;
     init_opt(&opt); //initialise options to defaults
@@ -220,6 +246,10 @@ int view_main(int argc, char* argv[]) {
             fp_help = stdout;
         } else if (c=='c') {
             opt.mod_codes_str = optarg;
+        } else if (c=='m') {
+            opt.mod_threshes_str = (char *)malloc(strlen(optarg)+1);
+            MALLOC_CHK(opt.mod_threshes_str);
+            strcpy(opt.mod_threshes_str,optarg);
         } else if(c == 0 && longindex == 8){ //debug break
             opt.debug_break = atoi(optarg);
         } else if(c == 0 && longindex == 9){ //output file
@@ -240,6 +270,46 @@ int view_main(int argc, char* argv[]) {
             opt.alt_alleles = 1;
         } else if(c == 0 && longindex == 14){ //skip supplementary alignments
             opt.skip_supplementary = 1;
+        } else if(c == 0 && longindex == 15){ //binary output
+            opt.binary_out = 1;
+        } else if(c == 0 && longindex == 16){ //file of input file names
+            bam_list_file = optarg;
+        } else if(c == 0 && longindex == 17){ //per sample output
+            opt.per_sample = 1;
+        } else if(c == 0 && longindex == 18){ //adaptive batch sizing
+            opt.adaptive_batch = mm_parse_num(optarg);
+            if(opt.adaptive_batch <= 0){
+                ERROR("%s","Memory cap for --adaptive-batch should be larger than 0.");
+                exit(EXIT_FAILURE);
+            }
+        } else if(c == 0 && longindex == 19){ //memory budget
+            opt.max_mem = mm_parse_num(optarg);
+            if(opt.max_mem <= 0){
+                ERROR("%s","--max-mem should be larger than 0.");
+                exit(EXIT_FAILURE);
+            }
+        } else if(c == 0 && longindex == 20){ //profiling report
+            opt.profile_file = optarg;
+        } else if(c == 0 && longindex == 21){ //read level output
+            opt.read_level = 1;
+        } else if(c == 0 && longindex == 23){ //decompression and decode threads
+            opt.io_threads = atoi(optarg);
+            if (opt.io_threads < 0) {
+                ERROR("Number of I/O threads should be 0 or larger. You entered %d", opt.io_threads);
+                exit(EXIT_FAILURE);
+            }
+        } else if(c == 0 && longindex == 24){ //minimum MAPQ
+            opt.min_mapq = atoi(optarg);
+            if (opt.min_mapq < 0 || opt.min_mapq > 255) {
+                ERROR("Minimum MAPQ should be between 0 and 255. You entered %d", opt.min_mapq);
+                exit(EXIT_FAILURE);
+            }
+        } else if(c == 0 && longindex == 25){ //minimum read length
+            opt.min_length = atoi(optarg);
+            if (opt.min_length < 0) {
+                ERROR("Minimum read length should be 0 or larger. You entered %d", opt.min_length);
+                exit(EXIT_FAILURE);
+            }
         } else {
             print_help_msg(fp_help, opt);
             if(fp_help == stdout){
@@ -256,10 +326,22 @@ int view_main(int argc, char* argv[]) {
 
     parse_mod_codes(&opt);
     warn_untested_cases(&opt);
+
+    if(opt.read_level) {
+        if(opt.mod_threshes_str==NULL || strlen(opt.mod_threshes_str)==0){
+            INFO("%s", "Modification threshold not provided. Using default threshold 0.8");
+            opt.mod_threshes_str = (char *)malloc(4);
+            MALLOC_CHK(opt.mod_threshes_str);
+            strcpy(opt.mod_threshes_str,"0.8"); // a single threshold is applied to all codes
+        }
+        parse_mod_threshes(&opt);
+    } else if(opt.mod_threshes_str != NULL) {
+        WARNING("%s", "-m is only used with --read-level, ignored");
+    }
     print_view_options(&opt);
 
     // No arguments given
-    if (argc - optind != 2 || fp_help == stdout) {
+    if (argc - optind < (bam_list_file ? 1 : 2) || fp_help == stdout) {
         WARNING("%s","Missing arguments");
         print_help_msg(fp_help, opt);
         if(fp_help == stdout){
@@ -269,7 +351,6 @@ int view_main(int argc, char* argv[]) {
     }
 
     opt.ref_file = argv[optind];
-    opt.bam_file = argv[optind+1];
 
     if (opt.ref_file == NULL) {
         WARNING("%s","Reference file not provided");
@@ -280,18 +361,16 @@ int view_main(int argc, char* argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    if (opt.bam_file == NULL) {
-        WARNING("%s","BAM file not provided");
-        print_help_msg(fp_help, opt);
-        if(fp_help == stdout){
-            exit(EXIT_SUCCESS);
-        }
+    // input files after the reference, checked for existence
+    set_bam_files(&opt, &argv[optind+1], argc - optind - 1, bam_list_file);
+
+    if (opt.binary_out && opt.read_level) {
+        ERROR("%s", "--read-level is not supported with --binary");
         exit(EXIT_FAILURE);
     }
 
-    // check if the bam file exists
-    if (access(opt.bam_file, F_OK) == -1) {
-        ERROR("BAM file %s does not exist", opt.bam_file);
+    if (opt.binary_out && opt.per_sample) {
+        ERROR("%s", "--per-sample is not supported with --binary");
         exit(EXIT_FAILURE);
     }
 
@@ -319,6 +398,7 @@ int view_main(int argc, char* argv[]) {
 
     //initialise the core data structure
     core_t* core = init_core(opt, realtime0);
+    set_fixed_mem(core, ref_mem(opt.n_mods));
 
     int32_t counter=0;
 
@@ -330,8 +410,14 @@ int view_main(int argc, char* argv[]) {
     //initialise a databatch
     db_t* db = init_db(core);
 
-    ret_status_t status = {core->opt.batch_size,core->opt.batch_size_bases};
-    while (status.num_reads >= core->opt.batch_size || status.num_bases>=core->opt.batch_size_bases) {
+    ret_status_t status = {core->batch_size,core->batch_size_bases};
+    while (status.num_reads >= core->batch_size || status.num_bases>=core->batch_size_bases) {
+
+        //the batch is reused, reallocate it if adapt_batch changed the read limit
+        if(db->cap_bam_recs != core->next_batch_size){
+            free_db(core, db);
+            db = init_db(core);
+        }
 
         //load a databatch
         status = load_db(core, db);
@@ -344,6 +430,8 @@ int view_main(int argc, char* argv[]) {
 
         free_db_tmp(core, db);
 
+        adapt_batch(core);
+
         //print progress
         int32_t skipped_reads = db->total_reads-db->n_bam_recs;
         int64_t skipped_bytes = db->total_bytes-db->processed_bytes;
@@ -375,13 +463,13 @@ int view_main(int argc, char* argv[]) {
 
 #else //IO_PROC_INTERLEAVE
 
-    ret_status_t status = {core->opt.batch_size,core->opt.batch_size_bases};
+    ret_status_t status = {core->batch_size,core->batch_size_bases};
     int8_t first_flag_p=0;
     int8_t first_flag_pp=0;
     pthread_t tid_p; //process thread
     pthread_t tid_pp; //post-process thread
 
-    while (status.num_reads >= core->opt.batch_size || status.num_bases>=core->opt.batch_size_bases) {
+    while (status.num_reads >= core->batch_size || status.num_bases>=core->batch_size_bases) {
 
         //init and load a databatch
         db_t* db = init_db(core);
@@ -428,6 +516,7 @@ int view_main(int argc, char* argv[]) {
                 realtime() - realtime0, cputime() / (realtime() - realtime0),
                 (long)tid_pp);
             }
+            adapt_batch(core); // the previous batch is finished, tune the next load
         }
         first_flag_pp=1;
 
@@ -465,7 +554,13 @@ int view_main(int argc, char* argv[]) {
 
 #endif
 
-
+    if(core->view_bin){
+        viewbin_destroy(core->view_bin);
+        core->view_bin = NULL;
+    }
+    if(opt.output_fp != stdout){
+        fclose(opt.output_fp);
+    }
 
     destroy_ref(opt.n_mods);
 
@@ -473,15 +568,24 @@ int view_main(int argc, char* argv[]) {
     fprintf(stderr,"\n[%s] total bytes: %.1f M",__func__,core->total_bytes/(float)(1000*1000));
     fprintf(stderr,"\n[%s] total skipped entries: %ld",__func__,(long)(core->total_reads-core->processed_reads));
     fprintf(stderr,"\n[%s] total skipped bytes: %.1f M",__func__,(core->total_bytes-core->processed_bytes)/(float)(1000*1000));
+    print_skipped_reads(core, __func__);
     fprintf(stderr,"\n[%s] total processed entries: %ld",__func__,(long)core->processed_reads);
     fprintf(stderr,"\n[%s] total processed bytes: %.1f M",__func__,(core->processed_bytes)/(float)(1000*1000));
+    fprintf(stderr,"\n[%s] total processed bases: %lu",__func__,(unsigned long)core->processed_bases);
 
     fprintf(stderr, "\n[%s] Data loading time: %.3f sec", __func__,core->load_db_time);
     fprintf(stderr, "\n[%s] Data processing time: %.3f sec", __func__,core->process_db_time);
     fprintf(stderr, "\n[%s] Data output time: %.3f sec", __func__,core->output_time);
+    if(opt.max_mem > 0){
+        fprintf(stderr, "\n[%s] Peak memory estimate: %.1f M of --max-mem %.1f M", __func__,core->mem_peak/(float)(1000*1000),opt.max_mem/(float)(1000*1000));
+    }
 
     fprintf(stderr,"\n");
 
+    if(core->prof){
+        profile_write(core, opt.profile_file);
+    }
+
     //free the core data structure
     free_core(core,opt);
 
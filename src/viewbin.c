@@ -0,0 +1,330 @@
+/**
+ * @file viewbin.c
+ * @brief binary columnar output format for view
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+#include "viewbin.h"
+#include "minimod.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define VIEWBIN_INIT_ROWS 4096
+#define VIEWBIN_INIT_READS 256
+
+static inline void vb_write(viewbin_t *vb, const void *ptr, size_t size, size_t n) {
+    if (n == 0) return;
+    if (fwrite(ptr, size, n, vb->fp) != n) {
+        ERROR("%s", "Writing binary view output failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static inline int vb_read(FILE *fp, void *ptr, size_t size, size_t n) {
+    if (n == 0) return 0;
+    return fread(ptr, size, n, fp) == n ? 0 : -1;
+}
+
+static void vb_grow_rows(viewbin_t *vb) {
+    vb->cap_rows = vb->cap_rows ? vb->cap_rows * 2 : VIEWBIN_INIT_ROWS;
+    vb->contig_id = (int32_t *)realloc(vb->contig_id, sizeof(int32_t) * vb->cap_rows);
+    MALLOC_CHK(vb->contig_id);
+    vb->ref_pos = (int32_t *)realloc(vb->ref_pos, sizeof(int32_t) * vb->cap_rows);
+    MALLOC_CHK(vb->ref_pos);
+    vb->strand = (uint8_t *)realloc(vb->strand, sizeof(uint8_t) * vb->cap_rows);
+    MALLOC_CHK(vb->strand);
+    vb->read_idx = (uint32_t *)realloc(vb->read_idx, sizeof(uint32_t) * vb->cap_rows);
+    MALLOC_CHK(vb->read_idx);
+    vb->read_pos = (int32_t *)realloc(vb->read_pos, sizeof(int32_t) * vb->cap_rows);
+    MALLOC_CHK(vb->read_pos);
+    vb->code_id = (uint8_t *)realloc(vb->code_id, sizeof(uint8_t) * vb->cap_rows);
+    MALLOC_CHK(vb->code_id);
+    vb->mod_prob = (uint8_t *)realloc(vb->mod_prob, sizeof(uint8_t) * vb->cap_rows);
+    MALLOC_CHK(vb->mod_prob);
+    if (vb->flags & VIEWBIN_FLAG_INS) {
+        vb->ins_offset = (uint16_t *)realloc(vb->ins_offset, sizeof(uint16_t) * vb->cap_rows);
+        MALLOC_CHK(vb->ins_offset);
+    }
+    if (vb->flags & VIEWBIN_FLAG_HAP) {
+        vb->haplotype = (uint8_t *)realloc(vb->haplotype, sizeof(uint8_t) * vb->cap_rows);
+        MALLOC_CHK(vb->haplotype);
+    }
+}
+
+viewbin_t *viewbin_init(FILE *fp, bam_hdr_t *hdr, int insertions, int haplotypes) {
+    viewbin_t *vb = (viewbin_t *)calloc(1, sizeof(viewbin_t));
+    MALLOC_CHK(vb);
+
+    vb->fp = fp;
+    vb->flags = (insertions ? VIEWBIN_FLAG_INS : 0) | (haplotypes ? VIEWBIN_FLAG_HAP : 0);
+
+    vb_grow_rows(vb);
+    vb->cap_reads = VIEWBIN_INIT_READS;
+    vb->read_names = (const char **)malloc(sizeof(const char *) * vb->cap_reads);
+    MALLOC_CHK(vb->read_names);
+
+    // file header with the contig dictionary
+    uint16_t version = VIEWBIN_VERSION;
+    uint32_t n_contigs = hdr->n_targets;
+    vb_write(vb, VIEWBIN_MAGIC, 1, 4);
+    vb_write(vb, &version, sizeof(uint16_t), 1);
+    vb_write(vb, &vb->flags, sizeof(uint16_t), 1);
+    vb_write(vb, &n_contigs, sizeof(uint32_t), 1);
+    for (uint32_t i = 0; i < n_contigs; i++) {
+        uint32_t len = strlen(hdr->target_name[i]);
+        vb_write(vb, &len, sizeof(uint32_t), 1);
+        vb_write(vb, hdr->target_name[i], 1, len);
+    }
+
+    return vb;
+}
+
+uint32_t viewbin_add_read(viewbin_t *vb, const char *qname) {
+    if (vb->n_reads == vb->cap_reads) {
+        vb->cap_reads *= 2;
+        vb->read_names = (const char **)realloc(vb->read_names, sizeof(const char *) * vb->cap_reads);
+        MALLOC_CHK(vb->read_names);
+    }
+    vb->read_names[vb->n_reads] = qname;
+    return vb->n_reads++;
+}
+
+static inline uint8_t viewbin_code_id(viewbin_t *vb, const char *mod_code) {
+    for (uint32_t i = 0; i < vb->n_codes; i++) {
+        if (strcmp(vb->codes[i], mod_code) == 0) return i;
+    }
+    if (vb->n_codes == VIEWBIN_MAX_CODES) {
+        ERROR("More than %d distinct modification codes in a batch", VIEWBIN_MAX_CODES);
+        exit(EXIT_FAILURE);
+    }
+    size_t len = strlen(mod_code);
+    vb->codes[vb->n_codes] = (char *)malloc(len + 1);
+    MALLOC_CHK(vb->codes[vb->n_codes]);
+    memcpy(vb->codes[vb->n_codes], mod_code, len + 1);
+    return vb->n_codes++;
+}
+
+void viewbin_add_row(viewbin_t *vb, int32_t contig_id, int32_t ref_pos, char strand, uint32_t read_idx, int32_t read_pos, const char *mod_code, uint8_t mod_prob, uint16_t ins_offset, uint8_t haplotype) {
+    if (vb->n_rows == vb->cap_rows) {
+        vb_grow_rows(vb);
+    }
+    uint32_t r = vb->n_rows++;
+    vb->contig_id[r] = contig_id;
+    vb->ref_pos[r] = ref_pos;
+    vb->strand[r] = (uint8_t)strand;
+    vb->read_idx[r] = read_idx;
+    vb->read_pos[r] = read_pos;
+    vb->code_id[r] = viewbin_code_id(vb, mod_code);
+    vb->mod_prob[r] = mod_prob;
+    if (vb->flags & VIEWBIN_FLAG_INS) vb->ins_offset[r] = ins_offset;
+    if (vb->flags & VIEWBIN_FLAG_HAP) vb->haplotype[r] = haplotype;
+}
+
+/* write the current block and reset the per-block dictionaries */
+void viewbin_flush(viewbin_t *vb) {
+    if (vb->n_rows > 0) {
+        vb_write(vb, &vb->n_rows, sizeof(uint32_t), 1);
+        vb_write(vb, &vb->n_reads, sizeof(uint32_t), 1);
+        vb_write(vb, &vb->n_codes, sizeof(uint32_t), 1);
+
+        for (uint32_t i = 0; i < vb->n_reads; i++) {
+            size_t len = strlen(vb->read_names[i]);
+            uint16_t len16 = (uint16_t)len;
+            ASSERT_MSG(len16 == len, "Read name too long: %s\n", vb->read_names[i]);
+            vb_write(vb, &len16, sizeof(uint16_t), 1);
+            vb_write(vb, vb->read_names[i], 1, len16);
+        }
+        for (uint32_t i = 0; i < vb->n_codes; i++) {
+            uint8_t len = (uint8_t)strlen(vb->codes[i]);
+            vb_write(vb, &len, sizeof(uint8_t), 1);
+            vb_write(vb, vb->codes[i], 1, len);
+        }
+
+        vb_write(vb, vb->contig_id, sizeof(int32_t), vb->n_rows);
+        vb_write(vb, vb->ref_pos, sizeof(int32_t), vb->n_rows);
+        vb_write(vb, vb->strand, sizeof(uint8_t), vb->n_rows);
+        vb_write(vb, vb->read_idx, sizeof(uint32_t), vb->n_rows);
+        vb_write(vb, vb->read_pos, sizeof(int32_t), vb->n_rows);
+        vb_write(vb, vb->code_id, sizeof(uint8_t), vb->n_rows);
+        vb_write(vb, vb->mod_prob, sizeof(uint8_t), vb->n_rows);
+        if (vb->flags & VIEWBIN_FLAG_INS) vb_write(vb, vb->ins_offset, sizeof(uint16_t), vb->n_rows);
+        if (vb->flags & VIEWBIN_FLAG_HAP) vb_write(vb, vb->haplotype, sizeof(uint8_t), vb->n_rows);
+    }
+
+    for (uint32_t i = 0; i < vb->n_codes; i++) {
+        free(vb->codes[i]);
+    }
+    vb->n_codes = 0;
+    vb->n_reads = 0;
+    vb->n_rows = 0;
+}
+
+void viewbin_destroy(viewbin_t *vb) {
+    viewbin_flush(vb);
+    free(vb->contig_id);
+    free(vb->ref_pos);
+    free(vb->strand);
+    free(vb->read_idx);
+    free(vb->read_pos);
+    free(vb->code_id);
+    free(vb->mod_prob);
+    free(vb->ins_offset);
+    free(vb->haplotype);
+    free(vb->read_names);
+    free(vb);
+}
+
+#define VB_READ_CHK(ret) { \
+    if ((ret) != 0) { \
+        ERROR("Truncated or corrupted binary view file %s", in_file); \
+        exit(EXIT_FAILURE); \
+    } \
+}
+
+/* convert a binary view file back to the view tsv, returns the number of rows written */
+int64_t viewbin_to_tsv(FILE *in_fp, const char *in_file, FILE *out_fp, int print_header) {
+    char magic[4];
+    uint16_t version, flags;
+    uint32_t n_contigs;
+
+    if (vb_read(in_fp, magic, 1, 4) != 0 || memcmp(magic, VIEWBIN_MAGIC, 4) != 0) {
+        ERROR("%s is not a minimod binary view file", in_file);
+        exit(EXIT_FAILURE);
+    }
+    VB_READ_CHK(vb_read(in_fp, &version, sizeof(uint16_t), 1));
+    if (version != VIEWBIN_VERSION) {
+        ERROR("Unsupported binary view file version %d in %s", version, in_file);
+        exit(EXIT_FAILURE);
+    }
+    VB_READ_CHK(vb_read(in_fp, &flags, sizeof(uint16_t), 1));
+    VB_READ_CHK(vb_read(in_fp, &n_contigs, sizeof(uint32_t), 1));
+
+    char **contigs = (char **)malloc(sizeof(char *) * (n_contigs > 0 ? n_contigs : 1));
+    MALLOC_CHK(contigs);
+    for (uint32_t i = 0; i < n_contigs; i++) {
+        uint32_t len;
+        VB_READ_CHK(vb_read(in_fp, &len, sizeof(uint32_t), 1));
+        contigs[i] = (char *)malloc(len + 1);
+        MALLOC_CHK(contigs[i]);
+        VB_READ_CHK(vb_read(in_fp, contigs[i], 1, len));
+        contigs[i][len] = '\0';
+    }
+
+    int do_insertions = (flags & VIEWBIN_FLAG_INS) != 0;
+    int do_haplotypes = (flags & VIEWBIN_FLAG_HAP) != 0;
+    if (print_header) fprintf(out_fp, "ref_contig\tref_pos\tstrand\tread_id\tread_pos\tmod_code\tmod_prob%s%s\n", do_insertions ? "\tins_offset" : "", do_haplotypes ? "\thaplotype" : "");
+
+    viewbin_t vb;
+    memset(&vb, 0, sizeof(viewbin_t));
+    vb.flags = flags;
+    char **read_names = NULL;
+    uint32_t cap_names = 0;
+    char *codes[VIEWBIN_MAX_CODES];
+    int64_t n_total = 0;
+
+    uint32_t n_rows;
+    while (vb_read(in_fp, &n_rows, sizeof(uint32_t), 1) == 0) {
+        uint32_t n_reads, n_codes;
+        VB_READ_CHK(vb_read(in_fp, &n_reads, sizeof(uint32_t), 1));
+        VB_READ_CHK(vb_read(in_fp, &n_codes, sizeof(uint32_t), 1));
+        if (n_codes > VIEWBIN_MAX_CODES) VB_READ_CHK(-1);
+
+        if (n_reads > cap_names) {
+            cap_names = n_reads;
+            read_names = (char **)realloc(read_names, sizeof(char *) * cap_names);
+            MALLOC_CHK(read_names);
+        }
+        for (uint32_t i = 0; i < n_reads; i++) {
+            uint16_t len;
+            VB_READ_CHK(vb_read(in_fp, &len, sizeof(uint16_t), 1));
+            read_names[i] = (char *)malloc(len + 1);
+            MALLOC_CHK(read_names[i]);
+            VB_READ_CHK(vb_read(in_fp, read_names[i], 1, len));
+            read_names[i][len] = '\0';
+        }
+        for (uint32_t i = 0; i < n_codes; i++) {
+            uint8_t len;
+            VB_READ_CHK(vb_read(in_fp, &len, sizeof(uint8_t), 1));
+            codes[i] = (char *)malloc(len + 1);
+            MALLOC_CHK(codes[i]);
+            VB_READ_CHK(vb_read(in_fp, codes[i], 1, len));
+            codes[i][len] = '\0';
+        }
+
+        while (vb.cap_rows < n_rows) {
+            vb_grow_rows(&vb);
+        }
+        VB_READ_CHK(vb_read(in_fp, vb.contig_id, sizeof(int32_t), n_rows));
+        VB_READ_CHK(vb_read(in_fp, vb.ref_pos, sizeof(int32_t), n_rows));
+        VB_READ_CHK(vb_read(in_fp, vb.strand, sizeof(uint8_t), n_rows));
+        VB_READ_CHK(vb_read(in_fp, vb.read_idx, sizeof(uint32_t), n_rows));
+        VB_READ_CHK(vb_read(in_fp, vb.read_pos, sizeof(int32_t), n_rows));
+        VB_READ_CHK(vb_read(in_fp, vb.code_id, sizeof(uint8_t), n_rows));
+        VB_READ_CHK(vb_read(in_fp, vb.mod_prob, sizeof(uint8_t), n_rows));
+        if (do_insertions) VB_READ_CHK(vb_read(in_fp, vb.ins_offset, sizeof(uint16_t), n_rows));
+        if (do_haplotypes) VB_READ_CHK(vb_read(in_fp, vb.haplotype, sizeof(uint8_t), n_rows));
+
+        for (uint32_t r = 0; r < n_rows; r++) {
+            int32_t cid = vb.contig_id[r];
+            if (cid >= (int32_t)n_contigs || vb.read_idx[r] >= n_reads || vb.code_id[r] >= n_codes) VB_READ_CHK(-1);
+            const char *contig = cid >= 0 ? contigs[cid] : "*";
+            fprintf(out_fp, "%s\t%d\t%c\t%s\t%d\t%s\t%f", contig, vb.ref_pos[r], vb.strand[r], read_names[vb.read_idx[r]], vb.read_pos[r], codes[vb.code_id[r]], THRESH_UINT8_TO_DBL(vb.mod_prob[r]));
+            if (do_insertions) {
+                fprintf(out_fp, "\t%d", vb.ins_offset[r]);
+            }
+            if (do_haplotypes) {
+                fprintf(out_fp, "\t%d", vb.haplotype[r]);
+            }
+            fputc('\n', out_fp);
+        }
+        n_total += n_rows;
+
+        for (uint32_t i = 0; i < n_reads; i++) {
+            free(read_names[i]);
+        }
+        for (uint32_t i = 0; i < n_codes; i++) {
+            free(codes[i]);
+        }
+    }
+
+    free(vb.contig_id);
+    free(vb.ref_pos);
+    free(vb.strand);
+    free(vb.read_idx);
+    free(vb.read_pos);
+    free(vb.code_id);
+    free(vb.mod_prob);
+    free(vb.ins_offset);
+    free(vb.haplotype);
+    free(read_names);
+    for (uint32_t i = 0; i < n_contigs; i++) {
+        free(contigs[i]);
+    }
+    free(contigs);
+
+    return n_total;
+}
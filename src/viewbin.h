@@ -0,0 +1,94 @@
+/**
+ * @file viewbin.h
+ * @brief binary columnar output format for view
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+#ifndef VIEWBIN_H
+#define VIEWBIN_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <htslib/sam.h>
+
+/*
+ * File layout (integers in host byte order)
+ *
+ *  header : magic "MMVB", uint16 version, uint16 flags,
+ *           uint32 n_contigs, n_contigs x {uint32 len, char name[len]}
+ *  block  : uint32 n_rows, uint32 n_reads, uint32 n_codes,
+ *           n_reads x {uint16 len, char name[len]},
+ *           n_codes x {uint8 len, char code[len]},
+ *           columns of n_rows each:
+ *              int32 contig_id, int32 ref_pos, uint8 strand, uint32 read_idx,
+ *              int32 read_pos, uint8 code_id, uint8 mod_prob (raw ML value),
+ *              uint16 ins_offset (only if VIEWBIN_FLAG_INS),
+ *              uint8 haplotype (only if VIEWBIN_FLAG_HAP)
+ *
+ * One block is written per batch. Read and mod code indices are local to the block.
+ */
+
+#define VIEWBIN_MAGIC "MMVB"
+#define VIEWBIN_VERSION 1
+#define VIEWBIN_FLAG_INS 0x1
+#define VIEWBIN_FLAG_HAP 0x2
+#define VIEWBIN_MAX_CODES 256
+
+struct viewbin_s {
+    FILE *fp;
+    uint16_t flags;
+
+    // columns of the current block
+    uint32_t n_rows;
+    uint32_t cap_rows;
+    int32_t *contig_id;
+    int32_t *ref_pos;
+    uint8_t *strand;
+    uint32_t *read_idx;
+    int32_t *read_pos;
+    uint8_t *code_id;
+    uint8_t *mod_prob;
+    uint16_t *ins_offset;
+    uint8_t *haplotype;
+
+    // dictionaries of the current block
+    uint32_t n_reads;
+    uint32_t cap_reads;
+    const char **read_names; // points to bam records, valid until the batch is freed
+    uint32_t n_codes;
+    char *codes[VIEWBIN_MAX_CODES];
+};
+
+typedef struct viewbin_s viewbin_t;
+
+viewbin_t *viewbin_init(FILE *fp, bam_hdr_t *hdr, int insertions, int haplotypes);
+uint32_t viewbin_add_read(viewbin_t *vb, const char *qname);
+void viewbin_add_row(viewbin_t *vb, int32_t contig_id, int32_t ref_pos, char strand, uint32_t read_idx, int32_t read_pos, const char *mod_code, uint8_t mod_prob, uint16_t ins_offset, uint8_t haplotype);
+void viewbin_flush(viewbin_t *vb);
+void viewbin_destroy(viewbin_t *vb);
+int64_t viewbin_to_tsv(FILE *in_fp, const char *in_file, FILE *out_fp, int print_header);
+
+#endif
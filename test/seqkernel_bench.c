@@ -0,0 +1,81 @@
+/**
+ * @file seqkernel_bench.c
+ * @brief micro-benchmark of the sequence kernels
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+#include "../src/seqkernel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+static double realtime(void) {
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return tp.tv_sec + tp.tv_usec * 1e-6;
+}
+
+int main(int argc, char *argv[]) {
+    int32_t read_len = argc > 1 ? atoi(argv[1]) : 10000;
+    int32_t n_reads = argc > 2 ? atoi(argv[2]) : 1000;
+    int rounds = 20;
+
+    int32_t packed_len = (read_len + 1) / 2;
+    uint8_t *seqs = (uint8_t *)malloc((size_t)packed_len * n_reads);
+    if(seqs == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+    srand(1);
+    for(size_t i = 0; i < (size_t)packed_len * n_reads; i++) {
+        seqs[i] = (uint8_t)((1 << (rand() % 4)) << 4 | (1 << (rand() % 4)));
+    }
+
+    const seqkernel_t *impls[SEQKERNEL_MAX_IMPLS];
+    int n_impls = seqkernel_available(impls);
+    double bases = (double)read_len * n_reads * rounds;
+
+    printf("kernel\tcount_Mbps\n");
+    for(int k = 0; k < n_impls; k++) {
+        const seqkernel_t *impl = impls[k];
+        int64_t sink = 0;
+
+        double t0 = realtime();
+        for(int r = 0; r < rounds; r++) {
+            for(int32_t i = 0; i < n_reads; i++) {
+                sink += impl->count_base(seqs + (size_t)i * packed_len, r & 1, read_len, 0x0002);
+            }
+        }
+        double t_count = realtime() - t0;
+
+        printf("%s\t%.1f\n", impl->name, bases / t_count / 1e6);
+        fprintf(stderr, "[%s] %s checksum %ld\n", __func__, impl->name, (long)sink);
+    }
+
+    free(seqs);
+    return EXIT_SUCCESS;
+}
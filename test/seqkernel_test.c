@@ -0,0 +1,104 @@
+/**
+ * @file seqkernel_test.c
+ * @brief unit tests for the sequence kernels against the scalar path
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+#include "../src/seqkernel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LEN 600
+
+static int n_fail = 0;
+
+#define CHECK(cond, ...) { \
+    if(!(cond)) { \
+        fprintf(stderr, "FAIL %s:%d ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        n_fail++; \
+    } \
+}
+
+static void random_seq(uint8_t *seq, int32_t len) {
+    memset(seq, 0, (MAX_LEN + 1) / 2);
+    for(int32_t i = 0; i < len; i++) {
+        // mostly A C G T (1 2 4 8), sometimes N (15) or another code
+        int r = rand() % 20;
+        int code = r < 18 ? 1 << (r % 4) : (r == 18 ? 15 : rand() % 16);
+        seq[i >> 1] |= code << ((~i & 1) << 2);
+    }
+}
+
+static void test_kernel(const seqkernel_t *ref, const seqkernel_t *k, const uint8_t *seq, int32_t start, int32_t end, uint16_t mask) {
+    int32_t count_ref = ref->count_base(seq, start, end, mask);
+    int32_t count = k->count_base(seq, start, end, mask);
+    CHECK(count == count_ref, "%s count_base [%d,%d) mask %04x: %d vs %d", k->name, start, end, mask, count, count_ref);
+}
+
+int main(int argc, char *argv[]) {
+    const seqkernel_t *impls[SEQKERNEL_MAX_IMPLS];
+    int n_impls = seqkernel_available(impls);
+    const seqkernel_t *ref = impls[0];
+
+    uint16_t masks[] = {0x0002, 0x0004, 0x0010, 0x0100, 0x8000, 0xfffe, 0xffff, 0x0000, 0x8116, 0x7ff1};
+    int n_masks = sizeof(masks) / sizeof(masks[0]);
+
+    uint8_t seq[(MAX_LEN + 1) / 2];
+    srand(1);
+    for(int t = 0; t < 2000; t++) {
+        int32_t len = t < 200 ? t : rand() % MAX_LEN;
+        random_seq(seq, len);
+        int32_t start = len ? rand() % (len + 1) : 0;
+        int32_t end = start + (len - start ? rand() % (len - start + 1) : 0);
+        for(int i = 1; i < n_impls; i++) {
+            for(int m = 0; m < n_masks; m++) {
+                test_kernel(ref, impls[i], seq, 0, len, masks[m]);
+                test_kernel(ref, impls[i], seq, start, end, masks[m]);
+            }
+        }
+    }
+
+    // the dispatched functions should agree with the scalar ones
+    seqkernel_init();
+    random_seq(seq, MAX_LEN);
+    CHECK(seq_count_base(seq, 3, MAX_LEN, 0x0002) == seq_count_base_scalar(seq, 3, MAX_LEN, 0x0002), "dispatched count_base");
+
+    fprintf(stderr, "kernels tested:");
+    for(int i = 0; i < n_impls; i++) {
+        fprintf(stderr, " %s", impls[i]->name);
+    }
+    fprintf(stderr, ", active: %s\n", seqkernel_name());
+
+    if(n_fail) {
+        fprintf(stderr, "%d checks failed\n", n_fail);
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "all checks passed\n");
+    return EXIT_SUCCESS;
+}
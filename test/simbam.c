@@ -0,0 +1,620 @@
+/**
+ * @file simbam.c
+ * @brief synthetic aligned BAM files with MM/ML tags for scaling benchmarks
+
+MIT License
+
+Copyright (c) 2024 Suneth Samarasinghe (imsuneth@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+******************************************************************************/
+
+
+/*
+ * Writes a BAM of reads sampled from a reference, with CIGARs carrying substitutions, insertions, deletions and
+ * soft clips, and MM/ML tags for the requested modification codes. Only meant to produce genome-scale inputs for
+ * benchmarking, the modification calls are random.
+ *
+ * Reads start at exponentially spaced positions along each contig so that the primary alignments come out sorted.
+ * Supplementary records split a read's own alignment in two and secondary records put the whole read at a random
+ * position of the same contig, so with either of them the output is no longer sorted.
+ */
+
+#include <htslib/sam.h>
+#include <htslib/kstring.h>
+#include <zlib.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "../src/kseq.h"
+
+KSEQ_INIT(gzFile, gzread)
+
+#define MAX_MODS 16
+#define SIM_LOW_MAPQ 5 // MAPQ of the alignments made low by --low-mapq
+
+typedef struct {
+    char base; // canonical base in the read orientation, N for any
+    char code[16];
+} sim_mod_t;
+
+typedef struct {
+    double coverage;
+    int32_t mean_len;
+    int32_t len_sd;
+    int32_t min_len;
+    sim_mod_t mods[MAX_MODS];
+    int n_mods;
+    int cpg; // C modifications only at CpG
+    double density; // fraction of candidate bases with an explicit call
+    char status; // MM skip status, '.' or '?'
+    double mod_frac; // fraction of explicit calls that are modified
+    double sub_rate;
+    double ins_rate;
+    double del_rate;
+    int32_t max_clip;
+    double secondary;
+    double supplementary;
+    double unmapped; // fraction of reads written as unmapped
+    double low_mapq; // fraction of primary alignments with MAPQ SIM_LOW_MAPQ
+    int haplotypes;
+    int64_t synth_ref; // bases of the random reference to write first, 0 to read the given one
+    int32_t n_contigs;
+    uint64_t seed;
+    int threads;
+    const char *output;
+} sim_opt_t;
+
+typedef struct {
+    uint64_t records;
+    uint64_t reads;
+    uint64_t bases;
+    uint64_t calls;
+} sim_stat_t;
+
+/* a read aligned to the reference: the read sequence in the reference orientation and its CIGAR */
+typedef struct {
+    int32_t pos;
+    char *seq;
+    int32_t l_seq, m_seq;
+    uint32_t *ops; // bam_cigar_gen encoded
+    int32_t n_ops, m_ops;
+} sim_aln_t;
+
+static struct option long_options[] = {
+    {"output", required_argument, 0, 'o'},          //0 output file
+    {"coverage", required_argument, 0, 'c'},        //1 mean coverage
+    {"read-len", required_argument, 0, 'l'},        //2 mean read length
+    {"mods", required_argument, 0, 'm'},            //3 modification codes
+    {"density", required_argument, 0, 'd'},         //4 fraction of candidate bases with explicit calls
+    {"seed", required_argument, 0, 's'},            //5 random seed
+    {"threads", required_argument, 0, 't'},         //6 compression threads
+    {"help", no_argument, 0, 'h'},                  //7
+    {"len-sd", required_argument, 0, 0},            //8 read length standard deviation
+    {"min-len", required_argument, 0, 0},           //9 min read length
+    {"cpg", no_argument, 0, 0},                     //10 C modifications only at CpG
+    {"status", required_argument, 0, 0},            //11 MM skip status
+    {"mod-frac", required_argument, 0, 0},          //12 fraction of modified calls
+    {"sub-rate", required_argument, 0, 0},          //13 substitution rate
+    {"ins-rate", required_argument, 0, 0},          //14 insertion rate
+    {"del-rate", required_argument, 0, 0},          //15 deletion rate
+    {"clip", required_argument, 0, 0},              //16 max soft clip at each end
+    {"secondary", required_argument, 0, 0},         //17 fraction of reads with a secondary alignment
+    {"supplementary", required_argument, 0, 0},     //18 fraction of reads split into a supplementary alignment
+    {"haplotypes", no_argument, 0, 0},              //19 HP tags
+    {"synth-ref", required_argument, 0, 0},         //20 write a random reference first
+    {"contigs", required_argument, 0, 0},           //21 contigs in the random reference
+    {"unmapped", required_argument, 0, 0},          //22 fraction of unmapped reads
+    {"low-mapq", required_argument, 0, 0},          //23 fraction of primary alignments with a low MAPQ
+    {0, 0, 0, 0}};
+
+static void print_help_msg(FILE *fp_help, sim_opt_t *opt) {
+    fprintf(fp_help,"Usage: simbam [options] ref.fa > sim.bam\n");
+    fprintf(fp_help,"\nbasic options:\n");
+    fprintf(fp_help,"   -o FILE                    output BAM file, SAM if it ends with .sam [stdout]\n");
+    fprintf(fp_help,"   -c FLOAT                   mean coverage [%.1f]\n", opt->coverage);
+    fprintf(fp_help,"   -l INT                     mean read length [%d]\n", opt->mean_len);
+    fprintf(fp_help,"   -m STR                     modifications as comma separated BASE+CODE (eg. C+m,C+h,A+a) [C+m]\n");
+    fprintf(fp_help,"   -d FLOAT                   fraction of candidate bases with an explicit call, the rest are skipped [%.2f]\n", opt->density);
+    fprintf(fp_help,"   -s INT                     random seed [%lu]\n", (unsigned long)opt->seed);
+    fprintf(fp_help,"   -t INT                     BAM compression threads [%d]\n", opt->threads);
+    fprintf(fp_help,"   -h                         help\n");
+    fprintf(fp_help,"   --len-sd INT               read length standard deviation, lengths are log-normal [%d]\n", opt->len_sd);
+    fprintf(fp_help,"   --min-len INT              min read length [%d]\n", opt->min_len);
+    fprintf(fp_help,"   --cpg                      C modifications only at CpG sites [%s]\n", opt->cpg ? "yes" : "no");
+    fprintf(fp_help,"   --status CHAR              status of the skipped bases in MM, . or ? [%c]\n", opt->status);
+    fprintf(fp_help,"   --mod-frac FLOAT           fraction of the explicit calls that are modified [%.2f]\n", opt->mod_frac);
+    fprintf(fp_help,"   --sub-rate FLOAT           substitutions per base [%.3f]\n", opt->sub_rate);
+    fprintf(fp_help,"   --ins-rate FLOAT           insertions per base [%.3f]\n", opt->ins_rate);
+    fprintf(fp_help,"   --del-rate FLOAT           deletions per base [%.3f]\n", opt->del_rate);
+    fprintf(fp_help,"   --clip INT                 max soft clipped bases at each end [%d]\n", opt->max_clip);
+    fprintf(fp_help,"   --secondary FLOAT          fraction of reads with a secondary alignment [%.2f]\n", opt->secondary);
+    fprintf(fp_help,"   --supplementary FLOAT      fraction of reads split into a primary and a supplementary alignment [%.2f]\n", opt->supplementary);
+    fprintf(fp_help,"   --haplotypes               add HP tags of 1 or 2 [%s]\n", opt->haplotypes ? "yes" : "no");
+    fprintf(fp_help,"   --synth-ref FLOAT[K/M/G]   write a random reference of this many bases to ref.fa first\n");
+    fprintf(fp_help,"   --contigs INT              contigs in the random reference [%d]\n", opt->n_contigs);
+    fprintf(fp_help,"   --unmapped FLOAT           fraction of reads written as unmapped, at their position [%.2f]\n", opt->unmapped);
+    fprintf(fp_help,"   --low-mapq FLOAT           fraction of primary alignments with MAPQ %d [%.2f]\n", SIM_LOW_MAPQ, opt->low_mapq);
+}
+
+/* xorshift64*, so that a seed gives the same output on every platform */
+static uint64_t rng_state;
+
+static inline uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static inline double rng_unif(void) {
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static inline char rng_base(void) {
+    return "ACGT"[rng_next() >> 62];
+}
+
+static double rng_normal(void) {
+    double u1 = rng_unif(), u2 = rng_unif();
+    if (u1 < 1e-300) u1 = 1e-300;
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * 3.14159265358979323846 * u2);
+}
+
+static int32_t read_length(sim_opt_t *opt) {
+    double cv = (double)opt->len_sd / opt->mean_len;
+    double sigma2 = log(1.0 + cv * cv);
+    double mu = log((double)opt->mean_len) - sigma2 / 2;
+    int32_t len = (int32_t)exp(mu + sqrt(sigma2) * rng_normal());
+    return len < opt->min_len ? opt->min_len : len;
+}
+
+static inline char complement(char b) {
+    switch (b) {
+        case 'A': return 'T';
+        case 'C': return 'G';
+        case 'G': return 'C';
+        case 'T': return 'A';
+        default: return 'N';
+    }
+}
+
+static int64_t parse_num(const char *str) {
+    double x;
+    char *p;
+    x = strtod(str, &p);
+    if (*p == 'G' || *p == 'g') x *= 1e9;
+    else if (*p == 'M' || *p == 'm') x *= 1e6;
+    else if (*p == 'K' || *p == 'k') x *= 1e3;
+    return (int64_t)(x + .499);
+}
+
+static void die(const char *msg, const char *arg) {
+    fprintf(stderr, "[simbam] %s%s\n", msg, arg ? arg : "");
+    exit(EXIT_FAILURE);
+}
+
+static void parse_mods(sim_opt_t *opt, const char *str) {
+    char *s = (char *)malloc(strlen(str) + 1);
+    if (s == NULL) die("out of memory", NULL);
+    strcpy(s, str);
+    opt->n_mods = 0;
+    for (char *tok = strtok(s, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        if (opt->n_mods == MAX_MODS) die("too many modifications in ", str);
+        sim_mod_t *mod = &opt->mods[opt->n_mods++];
+        if (strlen(tok) < 3 || tok[1] != '+' || strlen(tok + 2) >= sizeof(mod->code) || strchr("ACGTUN", toupper(tok[0])) == NULL) {
+            die("invalid modification, expected BASE+CODE: ", tok);
+        }
+        mod->base = toupper(tok[0]) == 'U' ? 'T' : toupper(tok[0]);
+        strcpy(mod->code, tok + 2);
+    }
+    free(s);
+}
+
+/* a random reference of n_contigs equal contigs named chr1, chr2, ... */
+static void write_synth_ref(const char *file, int64_t size, int32_t n_contigs) {
+    FILE *fp = fopen(file, "w");
+    if (fp == NULL) die("cannot open for writing: ", file);
+    int64_t contig_len = size / n_contigs;
+    char line[61];
+    line[60] = '\0';
+    for (int32_t c = 0; c < n_contigs; c++) {
+        fprintf(fp, ">chr%d\n", c + 1);
+        for (int64_t i = 0; i < contig_len; i += 60) {
+            int n = contig_len - i < 60 ? (int)(contig_len - i) : 60;
+            for (int j = 0; j < n; j++) line[j] = rng_base();
+            line[n] = '\0';
+            fprintf(fp, "%s\n", line);
+        }
+    }
+    fclose(fp);
+    fprintf(stderr, "[simbam] random reference of %ld bases in %d contigs written to %s\n", (long)(contig_len * n_contigs), n_contigs, file);
+}
+
+static void push_base(sim_aln_t *a, char b) {
+    if (a->l_seq == a->m_seq) {
+        a->m_seq = a->m_seq ? a->m_seq * 2 : 1024;
+        a->seq = (char *)realloc(a->seq, a->m_seq + 1);
+        if (a->seq == NULL) die("out of memory", NULL);
+    }
+    a->seq[a->l_seq++] = b;
+}
+
+static void push_op(sim_aln_t *a, int op, int len) {
+    if (a->n_ops > 0 && bam_cigar_op(a->ops[a->n_ops - 1]) == (uint32_t)op) {
+        a->ops[a->n_ops - 1] += (uint32_t)len << BAM_CIGAR_SHIFT;
+        return;
+    }
+    if (a->n_ops == a->m_ops) {
+        a->m_ops = a->m_ops ? a->m_ops * 2 : 64;
+        a->ops = (uint32_t *)realloc(a->ops, a->m_ops * sizeof(uint32_t));
+        if (a->ops == NULL) die("out of memory", NULL);
+    }
+    a->ops[a->n_ops++] = bam_cigar_gen(len, op);
+}
+
+/* align len read bases from ref[pos], returns the reference end */
+static int64_t make_aln(sim_aln_t *a, const char *ref, int64_t ref_len, int64_t pos, int32_t len, sim_opt_t *opt) {
+    a->pos = (int32_t)pos;
+    a->l_seq = 0;
+    a->n_ops = 0;
+
+    int32_t clip = opt->max_clip ? (int32_t)(rng_next() % (opt->max_clip + 1)) : 0;
+    for (int32_t i = 0; i < clip; i++) push_base(a, rng_base());
+    if (clip) push_op(a, BAM_CSOFT_CLIP, clip);
+
+    int64_t r = pos;
+    int32_t q = 0;
+    while (q < len && r < ref_len) {
+        double u = rng_unif();
+        // single base indels between matches, kept off the ends
+        int inner = q > 0 && q < len - 1 && r < ref_len - 1 && bam_cigar_op(a->ops[a->n_ops - 1]) == BAM_CMATCH;
+        if (inner && u < opt->ins_rate) {
+            push_base(a, rng_base());
+            push_op(a, BAM_CINS, 1);
+            q++;
+        } else if (inner && u < opt->ins_rate + opt->del_rate) {
+            push_op(a, BAM_CDEL, 1);
+            r++;
+        } else {
+            char b = toupper(ref[r]);
+            if (u < opt->ins_rate + opt->del_rate + opt->sub_rate) {
+                char s;
+                while ((s = rng_base()) == b);
+                b = s;
+            }
+            push_base(a, b);
+            push_op(a, BAM_CMATCH, 1);
+            q++;
+            r++;
+        }
+    }
+
+    clip = opt->max_clip ? (int32_t)(rng_next() % (opt->max_clip + 1)) : 0;
+    for (int32_t i = 0; i < clip; i++) push_base(a, rng_base());
+    if (clip) push_op(a, BAM_CSOFT_CLIP, clip);
+    a->seq[a->l_seq] = '\0';
+    return r;
+}
+
+/* MM and ML tags of a read, calls are made in the original read orientation */
+static void make_tags(const char *seq, int32_t l_seq, int rev, sim_opt_t *opt, kstring_t *mm, kstring_t *ml, sim_stat_t *stat) {
+    mm->l = ml->l = 0;
+    kputs("MM:Z:", mm);
+    kputs("ML:B:C", ml);
+    int32_t n_calls = 0;
+    for (int m = 0; m < opt->n_mods; m++) {
+        sim_mod_t *mod = &opt->mods[m];
+        ksprintf(mm, "%c+%s", mod->base, mod->code);
+        kputc(opt->status, mm);
+        int32_t skip = 0;
+        for (int32_t k = 0; k < l_seq; k++) {
+            char b = rev ? complement(seq[l_seq - 1 - k]) : seq[k];
+            if (mod->base != 'N' && b != mod->base) continue;
+            if (opt->cpg && mod->base == 'C') {
+                char next = k + 1 < l_seq ? (rev ? complement(seq[l_seq - 2 - k]) : seq[k + 1]) : 'N';
+                if (next != 'G') continue;
+            }
+            if (rng_unif() < opt->density) {
+                int prob = rng_unif() < opt->mod_frac ? 204 + (int)(rng_next() % 52) : (int)(rng_next() % 52);
+                ksprintf(mm, ",%d", skip);
+                ksprintf(ml, ",%d", prob);
+                skip = 0;
+                n_calls++;
+            } else {
+                skip++;
+            }
+        }
+        kputc(';', mm);
+    }
+    if (n_calls == 0) { // no ML values to give, leave the read without tags
+        mm->l = ml->l = 0;
+    }
+    stat->calls += n_calls;
+}
+
+static void put_cigar(kstring_t *ks, const uint32_t *ops, int32_t n_ops) {
+    for (int32_t i = 0; i < n_ops; i++) {
+        ksprintf(ks, "%u%c", bam_cigar_oplen(ops[i]), "MIDNSHP=X"[bam_cigar_op(ops[i])]);
+    }
+}
+
+static void write_record(htsFile *out, bam_hdr_t *hdr, bam1_t *b, kstring_t *line, const char *qname, int flag, const char *contig,
+                         int32_t pos, int mapq, const uint32_t *ops, int32_t n_ops, const char *seq, kstring_t *mm, kstring_t *ml, int hp, sim_stat_t *stat) {
+    line->l = 0;
+    ksprintf(line, "%s\t%d\t%s\t%d\t%d\t", qname, flag, contig, pos + 1, mapq);
+    if (n_ops > 0) {
+        put_cigar(line, ops, n_ops);
+    } else {
+        kputc('*', line);
+    }
+    ksprintf(line, "\t*\t0\t0\t%s\t*", seq);
+    if (mm->l) {
+        ksprintf(line, "\t%s\t%s", mm->s, ml->s);
+    }
+    if (hp) {
+        ksprintf(line, "\tHP:i:%d", hp);
+    }
+    if (sam_parse1(line, hdr, b) < 0) die("could not parse generated record ", qname);
+    if (sam_write1(out, hdr, b) < 0) die("could not write record ", qname);
+    stat->records++;
+}
+
+/* a random match op of 2 or more bases to split a read at, -1 if there is none */
+static int32_t split_op(const sim_aln_t *a) {
+    int32_t start = (int32_t)(rng_next() % a->n_ops);
+    for (int32_t j = 0; j < a->n_ops; j++) {
+        int32_t s = (start + j) % a->n_ops;
+        if (bam_cigar_op(a->ops[s]) == BAM_CMATCH && bam_cigar_oplen(a->ops[s]) >= 2) {
+            return s;
+        }
+    }
+    return -1;
+}
+
+/* a primary alignment and maybe a supplementary and a secondary one for each read */
+static void sim_contig(htsFile *out, bam_hdr_t *hdr, const char *name, const char *ref, int64_t ref_len, int32_t contig_i, sim_opt_t *opt, sim_stat_t *stat) {
+    sim_aln_t a;
+    memset(&a, 0, sizeof(sim_aln_t));
+    kstring_t line = {0, 0, NULL}, mm = {0, 0, NULL}, ml = {0, 0, NULL};
+    bam1_t *b = bam_init1();
+    char qname[64];
+    uint32_t *split_ops = NULL;
+    int32_t m_split = 0;
+
+    double gap = opt->mean_len / opt->coverage; // mean distance between read starts
+    int64_t pos = (int64_t)(-gap * log(1.0 - rng_unif()));
+    uint64_t n = 0;
+    while (1) {
+        int32_t len = read_length(opt);
+        if (pos + len >= ref_len) break;
+
+        make_aln(&a, ref, ref_len, pos, len, opt);
+        int rev = rng_unif() < 0.5;
+        int hp = opt->haplotypes ? 1 + (int)(rng_next() & 1) : 0;
+        make_tags(a.seq, a.l_seq, rev, opt, &mm, &ml, stat);
+        snprintf(qname, sizeof(qname), "sim_%d_%lu", contig_i, (unsigned long)n++);
+
+        // the random draws of --unmapped and --low-mapq are only taken when they are set, so other outputs do not change
+        if (opt->unmapped > 0 && rng_unif() < opt->unmapped) { // placed at the read's position, with no alignment
+            write_record(out, hdr, b, &line, qname, BAM_FUNMAP | (rev ? BAM_FREVERSE : 0), name, a.pos, 0, NULL, 0, a.seq, &mm, &ml, hp, stat);
+            stat->reads++;
+            stat->bases += a.l_seq;
+            pos += 1 + (int64_t)(-gap * log(1.0 - rng_unif()));
+            continue;
+        }
+        int mapq = opt->low_mapq > 0 && rng_unif() < opt->low_mapq ? SIM_LOW_MAPQ : 60;
+
+        int32_t s = rng_unif() < opt->supplementary ? split_op(&a) : -1;
+        if (s >= 0) {
+            // split inside a match op, the other part of the read is soft clipped in each record
+            if (m_split < a.n_ops + 2) {
+                m_split = a.n_ops + 2;
+                split_ops = (uint32_t *)realloc(split_ops, m_split * sizeof(uint32_t));
+                if (split_ops == NULL) die("out of memory", NULL);
+            }
+            int32_t q = 0, r = a.pos;
+            for (int32_t i = 0; i < s; i++) {
+                int op = bam_cigar_op(a.ops[i]);
+                if (op == BAM_CMATCH || op == BAM_CINS || op == BAM_CSOFT_CLIP) q += bam_cigar_oplen(a.ops[i]);
+                if (op == BAM_CMATCH || op == BAM_CDEL) r += bam_cigar_oplen(a.ops[i]);
+            }
+            int32_t k = bam_cigar_oplen(a.ops[s]) / 2; // bases of the op left in the primary record
+            memcpy(split_ops, a.ops, s * sizeof(uint32_t));
+            split_ops[s] = bam_cigar_gen(k, BAM_CMATCH);
+            split_ops[s + 1] = bam_cigar_gen(a.l_seq - q - k, BAM_CSOFT_CLIP);
+            write_record(out, hdr, b, &line, qname, rev ? BAM_FREVERSE : 0, name, a.pos, mapq, split_ops, s + 2, a.seq, &mm, &ml, hp, stat);
+            split_ops[0] = bam_cigar_gen(q + k, BAM_CSOFT_CLIP);
+            split_ops[1] = bam_cigar_gen(bam_cigar_oplen(a.ops[s]) - k, BAM_CMATCH);
+            memcpy(split_ops + 2, a.ops + s + 1, (a.n_ops - s - 1) * sizeof(uint32_t));
+            write_record(out, hdr, b, &line, qname, BAM_FSUPPLEMENTARY | (rev ? BAM_FREVERSE : 0), name, r + k, 60, split_ops, a.n_ops - s + 1, a.seq, &mm, &ml, hp, stat);
+        } else {
+            write_record(out, hdr, b, &line, qname, rev ? BAM_FREVERSE : 0, name, a.pos, mapq, a.ops, a.n_ops, a.seq, &mm, &ml, hp, stat);
+        }
+
+        if (rng_unif() < opt->secondary && ref_len > a.l_seq) {
+            uint32_t op = bam_cigar_gen(a.l_seq, BAM_CMATCH);
+            int32_t sec_pos = (int32_t)(rng_next() % (uint64_t)(ref_len - a.l_seq));
+            write_record(out, hdr, b, &line, qname, BAM_FSECONDARY | (rev ? BAM_FREVERSE : 0), name, sec_pos, 0, &op, 1, a.seq, &mm, &ml, hp, stat);
+        }
+
+        stat->reads++;
+        stat->bases += a.l_seq;
+        pos += 1 + (int64_t)(-gap * log(1.0 - rng_unif()));
+    }
+
+    bam_destroy1(b);
+    free(split_ops);
+    free(line.s);
+    free(mm.s);
+    free(ml.s);
+    free(a.seq);
+    free(a.ops);
+}
+
+int main(int argc, char *argv[]) {
+    sim_opt_t opt;
+    memset(&opt, 0, sizeof(sim_opt_t));
+    opt.coverage = 10;
+    opt.mean_len = 5000;
+    opt.len_sd = 3000;
+    opt.min_len = 200;
+    opt.density = 0.5;
+    opt.status = '.';
+    opt.mod_frac = 0.5;
+    opt.sub_rate = 0.02;
+    opt.ins_rate = 0.01;
+    opt.del_rate = 0.01;
+    opt.n_contigs = 1;
+    opt.seed = 1;
+    opt.threads = 1;
+    opt.output = "-";
+    parse_mods(&opt, "C+m");
+
+    FILE *fp_help = stderr;
+    int longindex = 0;
+    int c;
+    while ((c = getopt_long(argc, argv, "o:c:l:m:d:s:t:h", long_options, &longindex)) >= 0) {
+        if (c == 'o') {
+            opt.output = optarg;
+        } else if (c == 'c') {
+            opt.coverage = atof(optarg);
+            if (opt.coverage <= 0) die("coverage should be larger than 0", NULL);
+        } else if (c == 'l') {
+            opt.mean_len = atoi(optarg);
+            if (opt.mean_len < 1) die("mean read length should be larger than 0", NULL);
+        } else if (c == 'm') {
+            parse_mods(&opt, optarg);
+        } else if (c == 'd') {
+            opt.density = atof(optarg);
+        } else if (c == 's') {
+            opt.seed = strtoull(optarg, NULL, 10);
+        } else if (c == 't') {
+            opt.threads = atoi(optarg);
+        } else if (c == 'h') {
+            fp_help = stdout;
+        } else if (c == 0 && longindex == 8) {
+            opt.len_sd = atoi(optarg);
+        } else if (c == 0 && longindex == 9) {
+            opt.min_len = atoi(optarg);
+            if (opt.min_len < 1) die("min read length should be larger than 0", NULL);
+        } else if (c == 0 && longindex == 10) {
+            opt.cpg = 1;
+        } else if (c == 0 && longindex == 11) {
+            if (strcmp(optarg, ".") != 0 && strcmp(optarg, "?") != 0) die("status should be . or ?, given ", optarg);
+            opt.status = optarg[0];
+        } else if (c == 0 && longindex == 12) {
+            opt.mod_frac = atof(optarg);
+        } else if (c == 0 && longindex == 13) {
+            opt.sub_rate = atof(optarg);
+        } else if (c == 0 && longindex == 14) {
+            opt.ins_rate = atof(optarg);
+        } else if (c == 0 && longindex == 15) {
+            opt.del_rate = atof(optarg);
+        } else if (c == 0 && longindex == 16) {
+            opt.max_clip = atoi(optarg);
+        } else if (c == 0 && longindex == 17) {
+            opt.secondary = atof(optarg);
+        } else if (c == 0 && longindex == 18) {
+            opt.supplementary = atof(optarg);
+        } else if (c == 0 && longindex == 19) {
+            opt.haplotypes = 1;
+        } else if (c == 0 && longindex == 20) {
+            opt.synth_ref = parse_num(optarg);
+        } else if (c == 0 && longindex == 21) {
+            opt.n_contigs = atoi(optarg);
+            if (opt.n_contigs < 1) die("number of contigs should be larger than 0", NULL);
+        } else if (c == 0 && longindex == 22) {
+            opt.unmapped = atof(optarg);
+        } else if (c == 0 && longindex == 23) {
+            opt.low_mapq = atof(optarg);
+        } else {
+            print_help_msg(fp_help, &opt);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc - optind < 1 || fp_help == stdout) {
+        print_help_msg(fp_help, &opt);
+        exit(fp_help == stdout ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    const char *ref_file = argv[optind];
+    if (opt.ins_rate + opt.del_rate + opt.sub_rate >= 1) die("error rates add up to 1 or more", NULL);
+    rng_state = opt.seed * 0x9E3779B97F4A7C15ULL + 1; // never 0
+
+    if (opt.synth_ref > 0) {
+        write_synth_ref(ref_file, opt.synth_ref, opt.n_contigs);
+    }
+
+    // contig names and lengths for the header
+    kstring_t hdr_text = {0, 0, NULL};
+    kputs("@HD\tVN:1.6\tSO:unknown\n", &hdr_text);
+    gzFile fp = gzopen(ref_file, "r");
+    if (fp == NULL) die("cannot open reference ", ref_file);
+    kseq_t *seq = kseq_init(fp);
+    while (kseq_read(seq) >= 0) {
+        ksprintf(&hdr_text, "@SQ\tSN:%s\tLN:%lu\n", seq->name.s, (unsigned long)seq->seq.l);
+    }
+    kseq_destroy(seq);
+    gzclose(fp);
+    ksprintf(&hdr_text, "@PG\tID:simbam\tPN:simbam\tCL:");
+    for (int i = 0; i < argc; i++) ksprintf(&hdr_text, "%s%s", i ? " " : "", argv[i]);
+    kputc('\n', &hdr_text);
+
+    bam_hdr_t *hdr = sam_hdr_parse(hdr_text.l, hdr_text.s);
+    if (hdr == NULL) die("could not make the header", NULL);
+#if !(defined(HTS_VERSION) && HTS_VERSION >= 101000)
+    // older htslib does not keep the text, which is what sam_hdr_write writes
+    hdr->l_text = hdr_text.l;
+    hdr->text = hdr_text.s;
+    hdr_text.s = NULL;
+#endif
+    free(hdr_text.s);
+
+    size_t out_len = strlen(opt.output);
+    int sam_out = out_len > 4 && strcmp(opt.output + out_len - 4, ".sam") == 0;
+    htsFile *out = hts_open(opt.output, sam_out ? "w" : "wb");
+    if (out == NULL) die("cannot open for writing: ", opt.output);
+    if (opt.threads > 1) hts_set_threads(out, opt.threads);
+    if (sam_hdr_write(out, hdr) < 0) die("could not write the header", NULL);
+
+    sim_stat_t stat;
+    memset(&stat, 0, sizeof(sim_stat_t));
+    fp = gzopen(ref_file, "r");
+    if (fp == NULL) die("cannot open reference ", ref_file);
+    seq = kseq_init(fp);
+    for (int32_t i = 0; kseq_read(seq) >= 0; i++) {
+        sim_contig(out, hdr, seq->name.s, seq->seq.s, seq->seq.l, i, &opt, &stat);
+    }
+    kseq_destroy(seq);
+    gzclose(fp);
+
+    hts_close(out);
+    bam_hdr_destroy(hdr);
+
+    fprintf(stderr, "[simbam] %lu reads, %lu records, %.1fM bases, %lu modification calls\n",
+            (unsigned long)stat.reads, (unsigned long)stat.records, stat.bases / 1e6, (unsigned long)stat.calls);
+    return 0;
+}
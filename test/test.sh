@@ -254,6 +254,18 @@ echo -e "${BLUE}${testname}${NC}"
 ex  ./minimod summary test/data/dRNA.bam > test/tmp/test18.tsv || die "${testname} Running the tool failed"
 diff -q test/expected/test18.tsv test/tmp/test18.tsv || die "${testname} diff failed"
 
+testname="Test 18a: summary dRNA ML histogram"
+echo -e "${BLUE}${testname}${NC}"
+ex  ./minimod summary --ml-hist test/tmp/test18a.hist.tsv test/data/dRNA.bam > test/tmp/test18a.tsv || die "${testname} Running the tool failed"
+read_sites=`awk 'NR > 1 { s += $5 } END { print s }' test/tmp/test18a.tsv`
+hist_sites=`awk 'NR > 1 { s += $5 } END { print s }' test/tmp/test18a.hist.tsv`
+echo "Sites in per read output: $read_sites, sites in histogram: $hist_sites"
+if [ -z "$read_sites" ] || [ "$read_sites" -eq 0 ] || [ "$read_sites" -ne "$hist_sites" ]; then
+    die "${testname} per read site counts do not match the histogram"
+fi
+ex  ./minimod summary -K 5 -t 4 --ml-hist test/tmp/test18a.hist.K5.tsv test/data/dRNA.bam > test/tmp/test18a.K5.tsv || die "${testname} Running the tool with -K 5 failed"
+diff -q test/tmp/test18a.hist.tsv test/tmp/test18a.hist.K5.tsv || die "${testname} histogram differs when the batches reuse their histograms"
+
 testname="Test 19: view RNA aligned to genome. Check if both positive and negative strands present"
 echo -e "${BLUE}${testname}${NC}"
 ex  ./minimod view -c a[A] test/tmp/genome_chr22.fa test/data/rna_algn_to_genome.bam > test/tmp/test19.tsv || die "${testname} Running the tool failed"
@@ -265,6 +277,209 @@ if [ "$neg_count" -ne 359 ] || [ "$pos_count" -ne 450 ]; then
     die "${testname} strand counts do not match expected values"
 fi
 
+testname="Test 20: view ont binary output converted back with cat"
+echo -e "${BLUE}${testname}${NC}"
+ex  ./minimod view -K 10 --binary test/tmp/genome_chr22.fa test/data/example-ont.bam -o test/tmp/test20.bin || die "${testname} Running the tool failed"
+ex  ./minimod cat test/tmp/test20.bin > test/tmp/test20.tsv || die "${testname} Running cat failed"
+sort -k1,1 -k2,2n -k3,3 -k6,6 test/tmp/test20.tsv > test/tmp/test20.tsv.sorted
+diff -q test/tmp/test2.exp.tsv.sorted test/tmp/test20.tsv.sorted || die "${testname} diff failed"
+
+testname="Test 20a: view ont binary output with insertions and haplotypes"
+echo -e "${BLUE}${testname}${NC}"
+ex  ./minimod view -c m[CG] --insertions --haplotypes test/tmp/genome_chr1.fa test/data/hap.bam > test/tmp/test20a.tsv || die "${testname} Running the tool failed"
+ex  ./minimod view -c m[CG] --insertions --haplotypes --binary test/tmp/genome_chr1.fa test/data/hap.bam | ./minimod cat - > test/tmp/test20a.cat.tsv || die "${testname} Running cat failed"
+diff -q test/tmp/test20a.tsv test/tmp/test20a.cat.tsv || die "${testname} diff failed"
+
+testname="Test 21: freq ont with the same bam twice, per sample counts"
+echo -e "${BLUE}${testname}${NC}"
+ex  ./minimod freq -K 7 --per-sample test/tmp/genome_chr22.fa test/data/example-ont.bam test/data/example-ont.bam > test/tmp/test21.tsv || die "${testname} Running the tool failed"
+awk 'NR>1 && ($5!=2*$9 || $6!=2*$10 || $9!=$12 || $10!=$13) {exit 1}' test/tmp/test21.tsv || die "${testname} pooled and per sample counts do not add up"
+awk -v OFS='\t' '{print $1,$2,$3,$4,$9,$10,$11,$8}' test/tmp/test21.tsv | tail -n +2 | sort -k1,1 -k2,2n -k4,4 > test/tmp/test21.tsv.sorted
+grep -v "^contig" test/expected/test5.tsv | sort -k1,1 -k2,2n -k4,4 | diff -q - test/tmp/test21.tsv.sorted || die "${testname} diff failed"
+
+testname="Test 21a: view ont with a bam list"
+echo -e "${BLUE}${testname}${NC}"
+printf "test/data/example-ont.bam\n# comment\ntest/data/example-ont.bam\n" > test/tmp/test21a.list
+ex  ./minimod view --bam-list test/tmp/test21a.list --per-sample test/tmp/genome_chr22.fa > test/tmp/test21a.tsv || die "${testname} Running the tool failed"
+[ "$(tail -n +2 test/tmp/test21a.tsv | wc -l)" -eq "$(( 2 * $(tail -n +2 test/tmp/test2.tsv | wc -l) ))" ] || die "${testname} unexpected number of entries"
+awk 'NR>1 && $8!="example-ont" && $8!="example-ont_2" {exit 1}' test/tmp/test21a.tsv || die "${testname} sample column"
+[ "$(awk 'NR>1 && $8=="example-ont_2"' test/tmp/test21a.tsv | wc -l)" -eq "$(tail -n +2 test/tmp/test2.tsv | wc -l)" ] || die "${testname} same file names are not made unique"
+
+testname="Test 22: freq ont checkpoints merged and summed into a run"
+echo -e "${BLUE}${testname}${NC}"
+ex  ./minimod freq --dump test/tmp/test22.ckpt test/tmp/genome_chr22.fa test/data/example-ont.bam > test/tmp/test22.tsv || die "${testname} Running the tool failed"
+ex  ./minimod merge test/tmp/test22.ckpt > test/tmp/test22.merge1.tsv || die "${testname} Running merge failed"
+sort -k1,1 -k2,2n -k4,4 test/tmp/test22.merge1.tsv | diff -q test/tmp/test5.exp.tsv.sorted - || die "${testname} merge of one checkpoint differs"
+ex  ./minimod merge -t 2 test/tmp/test22.ckpt test/tmp/test22.ckpt > test/tmp/test22.merge2.tsv || die "${testname} Running merge failed"
+ex  ./minimod freq --checkpoint-in test/tmp/test22.ckpt test/tmp/genome_chr22.fa test/data/example-ont.bam > test/tmp/test22.sum.tsv || die "${testname} Running the tool with a checkpoint failed"
+diff -q <(sort test/tmp/test22.merge2.tsv) <(sort test/tmp/test22.sum.tsv) || die "${testname} merge and checkpoint-in differ"
+grep -v "^contig" test/expected/test5.tsv | awk -v OFS='\t' '{print $1,$2,$3,$4,2*$5,2*$6,$7,$8}' | sort -k1,1 -k2,2n -k4,4 > test/tmp/test22.exp2.sorted
+tail -n +2 test/tmp/test22.merge2.tsv | sort -k1,1 -k2,2n -k4,4 | diff -q test/tmp/test22.exp2.sorted - || die "${testname} merged counts are not doubled"
+
+testname="Test 23: freq ont streamed from stdin"
+echo -e "${BLUE}${testname}${NC}"
+cat test/data/example-ont.bam | ex ./minimod freq test/tmp/genome_chr22.fa - > test/tmp/test23.tsv || die "${testname} Running the tool failed"
+sort -k1,1 -k2,2n -k4,4 test/tmp/test23.tsv | diff -q test/tmp/test5.exp.tsv.sorted - || die "${testname} diff failed"
+
+testname="Test 24: freq ont from cram, two files sharing the reference"
+echo -e "${BLUE}${testname}${NC}"
+if command -v samtools > /dev/null; then
+    samtools view -C -T test/tmp/genome_chr22.fa -o test/tmp/test24.cram test/data/example-ont.bam || die "${testname} Converting to cram failed"
+    ex  ./minimod freq test/tmp/genome_chr22.fa test/tmp/test24.cram > test/tmp/test24.tsv || die "${testname} Running the tool failed"
+    sort -k1,1 -k2,2n -k4,4 test/tmp/test24.tsv | diff -q test/tmp/test5.exp.tsv.sorted - || die "${testname} diff failed"
+    ex  ./minimod freq -t 4 test/tmp/genome_chr22.fa test/tmp/test24.cram test/tmp/test24.cram > test/tmp/test24.2.tsv || die "${testname} Running the tool on two crams failed"
+    diff -q <(sort test/tmp/test22.merge2.tsv) <(sort test/tmp/test24.2.tsv) || die "${testname} two crams do not match the doubled counts"
+else
+    echo "samtools not found, skipped"
+fi
+
+testname="Test 25: freq ont with adaptive batch sizes"
+echo -e "${BLUE}${testname}${NC}"
+ex  ./minimod freq -K 2 -B 10K --adaptive-batch 1G test/tmp/genome_chr22.fa test/data/example-ont.bam > test/tmp/test25.tsv 2> test/tmp/test25.log || die "${testname} Running the tool failed"
+grep -q "batch size 2 -> " test/tmp/test25.log || die "${testname} batch size was not adapted"
+sort -k1,1 -k2,2n -k4,4 test/tmp/test25.tsv | diff -q test/tmp/test5.exp.tsv.sorted - || die "${testname} diff failed"
+
+testname="Test 26: freq rna under a memory budget, spilled and merged"
+echo -e "${BLUE}${testname}${NC}"
+ex  ./minimod freq -c "a[A]" test/data/transcript_ENST00000249299.7.fa test/data/rna_m5C_2OmeC_inosine_m6A_2OmeA_pseU_2OmeU_2OmeG_mm_trans_ENST00000249299.7.bam > test/tmp/test26.tsv || die "${testname} Running the tool failed"
+ex  ./minimod freq -K 5 --max-mem 200K -c "a[A]" test/data/transcript_ENST00000249299.7.fa test/data/rna_m5C_2OmeC_inosine_m6A_2OmeA_pseU_2OmeU_2OmeG_mm_trans_ENST00000249299.7.bam > test/tmp/test26.spill.tsv 2> test/tmp/test26.log || die "${testname} Running the tool with --max-mem failed"
+grep -q "spilled to disk" test/tmp/test26.log || die "${testname} the table was not spilled"
+diff -q <(sort test/tmp/test26.tsv) <(sort test/tmp/test26.spill.tsv) || die "${testname} diff failed"
+
+testname="Test 27: freq ont with a profiling report"
+echo -e "${BLUE}${testname}${NC}"
+ex  ./minimod freq -t 4 --profile test/tmp/test27.json test/tmp/genome_chr22.fa test/data/example-ont.bam > test/tmp/test27.tsv || die "${testname} Running the tool failed"
+[ "$(grep -c '"thread": ' test/tmp/test27.json)" -eq 4 ] || die "${testname} expected a profile entry per thread"
+grep -q '"stages": ' test/tmp/test27.json || die "${testname} stage times missing"
+sort -k1,1 -k2,2n -k4,4 test/tmp/test27.tsv | diff -q test/tmp/test5.exp.tsv.sorted - || die "${testname} diff failed"
+
+testname="Test 28: freq and view on a synthetic BAM"
+echo -e "${BLUE}${testname}${NC}"
+[ -x build/simbam ] || die "${testname} build/simbam not found, run make simbam or make test"
+build/simbam --synth-ref 200K --contigs 2 -c 5 -l 2000 -m C+m,C+h --cpg --clip 20 --supplementary 0.2 --secondary 0.1 --haplotypes -o test/tmp/test28.bam test/tmp/test28.fa || die "${testname} Generating the BAM failed"
+ex  ./minimod freq -c m[CG],h[CG] -t 1 test/tmp/test28.fa test/tmp/test28.bam > test/tmp/test28.t1.tsv || die "${testname} Running freq failed"
+ex  ./minimod freq -c m[CG],h[CG] -t 4 -K 16 test/tmp/test28.fa test/tmp/test28.bam > test/tmp/test28.t4.tsv || die "${testname} Running freq with 4 threads failed"
+[ "$(wc -l < test/tmp/test28.t1.tsv)" -gt 1000 ] || die "${testname} too few sites"
+diff -q <(sort test/tmp/test28.t1.tsv) <(sort test/tmp/test28.t4.tsv) || die "${testname} diff failed"
+ex  ./minimod view -c m[CG] --haplotypes test/tmp/test28.fa test/tmp/test28.bam > test/tmp/test28.view.tsv || die "${testname} Running view failed"
+
+testname="Test 28a: freq spilled runs of a BAM whose header order is not the name order"
+echo -e "${BLUE}${testname}${NC}"
+build/simbam --synth-ref 1200K --contigs 12 -c 3 -l 2000 -m C+m --cpg -o test/tmp/test28a.bam test/tmp/test28a.fa || die "${testname} Generating the BAM failed"
+ex  ./minimod freq -c m[CG] -K 20 test/tmp/test28a.fa test/tmp/test28a.bam > test/tmp/test28a.tsv || die "${testname} Running the tool failed"
+ex  ./minimod freq -c m[CG] -K 20 --max-mem 300K test/tmp/test28a.fa test/tmp/test28a.bam > test/tmp/test28a.spill.tsv 2> test/tmp/test28a.log || die "${testname} Running the tool with --max-mem failed"
+grep -q "spilled to disk" test/tmp/test28a.log || die "${testname} the table was not spilled"
+[ "$(cut -f1 test/tmp/test28a.tsv | uniq | sed -n 4p)" = "chr3" ] || die "${testname} contigs are not in header order"
+cmp -s test/tmp/test28a.tsv test/tmp/test28a.spill.tsv || die "${testname} spilled rows are not in the order of the in-memory output"
+
+testname="Test 29: view ont read level counts against the per site output"
+echo -e "${BLUE}${testname}${NC}"
+ex  ./minimod view test/tmp/genome_chr22.fa test/data/example-ont.bam > test/tmp/test29.view.tsv || die "${testname} Running view failed"
+ex  ./minimod view --read-level -m 0.8 test/tmp/genome_chr22.fa test/data/example-ont.bam > test/tmp/test29.tsv || die "${testname} Running view --read-level failed"
+head -1 test/tmp/test29.tsv | grep -q "mean_prob" || die "${testname} header missing"
+# supplementary records of a read get their own rows, sum them per read and mod code before comparing
+awk -F'\t' -v OFS='\t' 'NR>1 {k=$4 OFS $6; n[k]++; if($7>=0.8){c[k]++; m[k]++} else if($7<=0.2){c[k]++}} END {for(k in n) print k, n[k], c[k]+0, m[k]+0}' test/tmp/test29.view.tsv | sort > test/tmp/test29.view.agg.tsv
+awk -F'\t' -v OFS='\t' 'NR>1 {k=$1 OFS $6; n[k]+=$7; c[k]+=$8; m[k]+=$9} END {for(k in n) print k, n[k], c[k], m[k]}' test/tmp/test29.tsv | sort > test/tmp/test29.agg.tsv
+diff -q test/tmp/test29.view.agg.tsv test/tmp/test29.agg.tsv || die "${testname} diff failed"
+
+testname="Test 30: freq ont in windows and BED regions"
+echo -e "${BLUE}${testname}${NC}"
+ex  ./minimod freq --bin-size 1K test/tmp/genome_chr22.fa test/data/example-ont.bam > test/tmp/test30.tsv || die "${testname} Running the tool failed"
+awk -F'\t' -v OFS='\t' '$1!="contig" {b=int($2/1000); k=$1 OFS b*1000 OFS (b+1)*1000 OFS $8; n[k]++; c[k]+=$5; m[k]+=$6} END {for(k in n) print k, n[k], c[k], m[k]}' test/tmp/test5.exp.tsv.sorted | sort > test/tmp/test30.exp.tsv
+tail -n +2 test/tmp/test30.tsv | cut -f1-7 | sort | diff -q test/tmp/test30.exp.tsv - || die "${testname} diff failed"
+echo -e "chr22\t0\t51000000\tall\nchr22\t0\t10\tnone" > test/tmp/test30.bed
+ex  ./minimod freq --regions test/tmp/test30.bed test/tmp/genome_chr22.fa test/data/example-ont.bam > test/tmp/test30.bed.tsv || die "${testname} Running the tool with --regions failed"
+[ "$(awk -F'\t' '$10=="all" {print $5}' test/tmp/test30.bed.tsv)" -eq "$(grep -vc "^contig" test/tmp/test5.exp.tsv.sorted)" ] || die "${testname} sites missing from the region"
+[ "$(awk -F'\t' '$10=="none" {print $9}' test/tmp/test30.bed.tsv)" = "NA" ] || die "${testname} empty region not reported"
+
+testname="Test 31: multi ont against separate view, freq and summary runs"
+echo -e "${BLUE}${testname}${NC}"
+ex  ./minimod multi -t 4 --view test/tmp/test31.view.tsv --freq test/tmp/test31.freq.tsv --summary test/tmp/test31.summary.tsv test/tmp/genome_chr22.fa test/data/example-ont.bam || die "${testname} Running the tool failed"
+sort -k1,1 -k2,2n -k4,4 test/tmp/test31.freq.tsv | diff -q test/tmp/test5.exp.tsv.sorted - || die "${testname} freq diff failed"
+diff -q <(sort test/tmp/test29.view.tsv) <(sort test/tmp/test31.view.tsv) || die "${testname} view diff failed"
+ex  ./minimod summary test/data/example-ont.bam > test/tmp/test31.summary.exp.tsv || die "${testname} Running summary failed"
+diff -q <(sort test/tmp/test31.summary.exp.tsv) <(sort test/tmp/test31.summary.tsv) || die "${testname} summary diff failed"
+
+testname="Test 32: freq ont with haplotypes through checkpoints and spills"
+echo -e "${BLUE}${testname}${NC}"
+ex  ./minimod freq --haplotypes --dump test/tmp/test32.ckpt test/tmp/genome_chr1.fa test/data/hap.bam > test/tmp/test32.tsv || die "${testname} Running the tool failed"
+ex  ./minimod merge test/tmp/test32.ckpt > test/tmp/test32.merge.tsv || die "${testname} Running merge failed"
+sort -k1,1 -k2,2n -k4,4 test/tmp/test32.merge.tsv | diff -q test/tmp/test5c.exp.tsv.sorted - || die "${testname} merge of the checkpoint differs"
+ex  ./minimod freq --haplotypes -K 5 --max-mem 200K test/tmp/genome_chr1.fa test/data/hap.bam > test/tmp/test32.spill.tsv || die "${testname} Running the tool with --max-mem failed"
+sort -k1,1 -k2,2n -k4,4 test/tmp/test32.spill.tsv | diff -q test/tmp/test5c.exp.tsv.sorted - || die "${testname} spilled output differs"
+cmp -s test/tmp/test32.tsv test/tmp/test32.merge.tsv || die "${testname} merge rows are not in the order of the in-memory output"
+cmp -s test/tmp/test32.tsv test/tmp/test32.spill.tsv || die "${testname} spilled rows are not in the order of the in-memory output"
+
+testname="Test 33: freq ont bedmethyl output sorted by position"
+echo -e "${BLUE}${testname}${NC}"
+ex  ./minimod freq -b -t 4 -K 50 test/tmp/genome_chr22.fa test/data/example-ont.bam > test/tmp/test33.bedmethyl || die "${testname} Running the tool failed"
+sort -s -k1,1 -k2,2n test/tmp/test33.bedmethyl | diff -q test/tmp/test33.bedmethyl - || die "${testname} output is not sorted"
+
+testname="Test 34: freq and view ont identical with 1 and 32 threads"
+echo -e "${BLUE}${testname}${NC}"
+for t in 1 32; do
+    ex  ./minimod freq -t $t -c m[CG],h[CG] --insertions test/tmp/genome_chr22.fa test/data/example-ont.bam > test/tmp/test34.freq.t$t.tsv || die "${testname} Running freq with -t $t failed"
+    ex  ./minimod view -t $t -c m[CG],h[CG] --insertions test/tmp/genome_chr22.fa test/data/example-ont.bam > test/tmp/test34.view.t$t.tsv || die "${testname} Running view with -t $t failed"
+done
+cmp -s test/tmp/test34.freq.t1.tsv test/tmp/test34.freq.t32.tsv || die "${testname} freq outputs differ"
+cmp -s test/tmp/test34.view.t1.tsv test/tmp/test34.view.t32.tsv || die "${testname} view outputs differ"
+for t in 1 32; do
+    ex  ./minimod freq -t $t --haplotypes --insertions test/tmp/genome_chr1.fa test/data/hap.bam > test/tmp/test34.hapfreq.t$t.tsv || die "${testname} Running freq with haplotypes and -t $t failed"
+    ex  ./minimod view -t $t --haplotypes --insertions test/tmp/genome_chr1.fa test/data/hap.bam > test/tmp/test34.hapview.t$t.tsv || die "${testname} Running view with haplotypes and -t $t failed"
+done
+cmp -s test/tmp/test34.hapfreq.t1.tsv test/tmp/test34.hapfreq.t32.tsv || die "${testname} freq outputs with haplotypes differ"
+cmp -s test/tmp/test34.hapview.t1.tsv test/tmp/test34.hapview.t32.tsv || die "${testname} view outputs with haplotypes differ"
+# enough sites for the output sort to split into several chunks of SITESORT_MIN_CHUNK (65536) sites, on one thread per chunk
+build/simbam --synth-ref 1200K --contigs 12 -c 3 -l 2000 -m C+m,C+h --cpg -o test/tmp/test34.bam test/tmp/test34.fa || die "${testname} Generating the BAM failed"
+for t in 1 8; do
+    ex  ./minimod freq -t $t -c m[CG],h[CG] test/tmp/test34.fa test/tmp/test34.bam > test/tmp/test34.simfreq.t$t.tsv || die "${testname} Running freq on the synthetic BAM with -t $t failed"
+done
+[ "$(wc -l < test/tmp/test34.simfreq.t1.tsv)" -gt 200000 ] || die "${testname} too few sites to sort in several chunks"
+cmp -s test/tmp/test34.simfreq.t1.tsv test/tmp/test34.simfreq.t8.tsv || die "${testname} freq outputs of the synthetic BAM differ"
+
+testname="Test 35: view ont identical with and without decompression and decode threads"
+echo -e "${BLUE}${testname}${NC}"
+for io in 0 8; do
+    ex  ./minimod view -t 4 --io-threads $io -c m[CG],h[CG] --insertions test/tmp/genome_chr22.fa test/data/example-ont.bam > test/tmp/test35.io$io.tsv || die "${testname} Running the tool with --io-threads $io failed"
+    cmp -s test/tmp/test34.view.t1.tsv test/tmp/test35.io$io.tsv || die "${testname} output with --io-threads $io differs"
+done
+
+testname="Test 36: skipped reads by reason add up to the skipped total"
+echo -e "${BLUE}${testname}${NC}"
+ex  ./minimod freq --min-mapq 30 --min-length 500 test/tmp/genome_chr22.fa test/data/example-ont.bam > test/tmp/test36.tsv 2> test/tmp/test36.log || die "${testname} Running the tool failed"
+total=$(grep "total skipped entries:" test/tmp/test36.log | sed 's/.*: *//')
+sum=$(grep "skipped entries by reason:" test/tmp/test36.log | sed 's/.*reason://' | tr ',' '\n' | awk '{s += $NF} END {print s}')
+[ "${total}" -eq "${sum}" ] || die "${testname} reasons add up to ${sum}, not ${total}"
+
+testname="Test 36a: records of a BAM skipped before reading them, as when read from SAM"
+echo -e "${BLUE}${testname}${NC}"
+for f in bam sam; do
+    build/simbam --synth-ref 300K --contigs 2 -c 5 -l 2000 -m C+m --cpg --secondary 0.2 --supplementary 0.1 --unmapped 0.1 --low-mapq 0.2 -o test/tmp/test36a.$f test/tmp/test36a.fa || die "${testname} Generating the $f failed"
+    ex  ./minimod freq -K 7 --min-mapq 20 --min-length 1000 --skip-supplementary test/tmp/test36a.fa test/tmp/test36a.$f > test/tmp/test36a.$f.tsv 2> test/tmp/test36a.$f.log || die "${testname} Running the tool on the $f failed"
+    grep "skipped entries by reason:\|total skipped bytes:" test/tmp/test36a.$f.log | sed 's/.*\] //' > test/tmp/test36a.$f.skipped
+done
+cmp -s test/tmp/test36a.bam.tsv test/tmp/test36a.sam.tsv || die "${testname} outputs of the BAM and the SAM differ"
+cmp -s test/tmp/test36a.bam.skipped test/tmp/test36a.sam.skipped || die "${testname} skipped records of the BAM and the SAM differ"
+# the reasons in the order minimod checks them
+awk -v q=20 -v l=1000 '!/^@/ {
+    if (int($2 / 4) % 2) u++; else if (int($2 / 256) % 2) s++; else if (int($2 / 2048) % 2) p++; else if ($10 == "*") z++;
+    else if ($5 < q) m++; else if (length($10) < l) sh++; else if ($0 !~ /\tM[Mm]:Z:/) n++ }
+    END { printf "skipped entries by reason: unmapped %d, secondary %d, supplementary %d, zero length %d, low MAPQ %d, short %d, no MM tag %d\n", u, s, p, z, m, sh, n }' test/tmp/test36a.sam > test/tmp/test36a.exp
+grep "skipped entries by reason:" test/tmp/test36a.bam.skipped | diff -q test/tmp/test36a.exp - || die "${testname} unexpected skipped counts"
+for r in unmapped secondary supplementary "low MAPQ" short; do
+    grep -q "$r [1-9]" test/tmp/test36a.exp || die "${testname} no $r records in the test data"
+done
+
+testname="Test 37: view, freq and a freq only multi with only their own per read maps"
+echo -e "${BLUE}${testname}${NC}"
+ex  ./minimod view -t 4 -c m[CG] test/tmp/genome_chr22.fa test/data/example-ont.bam > test/tmp/test37.view.tsv || die "${testname} Running view failed"
+sort -k1,1 -k2,2n -k3,3 -k6,6 test/tmp/test37.view.tsv | diff -q test/tmp/test2.exp.tsv.sorted - || die "${testname} view diff failed"
+ex  ./minimod freq -t 4 test/tmp/genome_chr22.fa test/data/example-ont.bam > test/tmp/test37.freq.tsv || die "${testname} Running freq failed"
+sort -k1,1 -k2,2n -k4,4 test/tmp/test37.freq.tsv | diff -q test/tmp/test5.exp.tsv.sorted - || die "${testname} freq diff failed"
+ex  ./minimod view -t 4 --read-level test/tmp/genome_chr22.fa test/data/example-ont.bam > test/tmp/test37.read.tsv || die "${testname} Running view --read-level failed"
+ex  ./minimod multi -t 4 --freq test/tmp/test37.multi.tsv test/tmp/genome_chr22.fa test/data/example-ont.bam || die "${testname} Running multi with --freq only failed"
+sort -k1,1 -k2,2n -k4,4 test/tmp/test37.multi.tsv | diff -q test/tmp/test5.exp.tsv.sorted - || die "${testname} multi freq diff failed"
+
 #**** END of OLD TESTS ****
 
 